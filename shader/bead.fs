@@ -2,15 +2,12 @@
 
 out vec4 fragColor;
 
-in mat4 inverseView;
-in mat4 inverseProjection;
+#include "frame_constants.glsl"
+
 in vec3 vNormal;
 in vec3 vPosition;
 
 uniform vec3 uCenter;           // 구 중심 위치
-uniform vec3 uViewPos;          // 카메라 위치
-uniform vec2 uResolution;       // 렌더링 해상도
-uniform vec3 uLightPos;         // 광원 위치
 
 uniform bool uSpecular;
 uniform bool uDiffuse;
@@ -49,11 +46,11 @@ vec3 calculateRayDirection(vec2 fragCoord) {
     vec4 clipSpacePos = vec4((fragCoord / uResolution) * 2.0 - 1.0, -1.0, 1.0);
     
     // 클립 공간에서 뷰 공간으로 변환
-    vec4 viewSpacePos = inverseProjection * clipSpacePos;
+    vec4 viewSpacePos = uInverseProjection * clipSpacePos;
     viewSpacePos = vec4(viewSpacePos.xy, -1.0, 0.0); // 방향 벡터이므로 z = -1, w = 0
     
     // 뷰 공간에서 월드 공간으로 변환 및 정규화
-    vec3 worldSpaceDir = normalize((inverseView * viewSpacePos).xyz);
+    vec3 worldSpaceDir = normalize((uInverseView * viewSpacePos).xyz);
     
     return worldSpaceDir;
 }
@@ -0,0 +1,12 @@
+// 모든 셰이더가 공유하는 프레임 상수, src/frame_constants.h의 FrameConstants와 같은 std140 layout
+// Shader::LoadFile이 #include "frame_constants.glsl" 줄을 이 내용으로 바꿉니다
+layout (std140) uniform FrameConstants {
+    mat4 uView;
+    mat4 uProjection;
+    mat4 uInverseView;
+    mat4 uInverseProjection;
+    vec3 uViewPos;              // 카메라 위치
+    float uTime;                // 시간
+    vec3 uLightPos;             // 광원 위치
+    vec2 uResolution;           // 렌더링 해상도
+};
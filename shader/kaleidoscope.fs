@@ -1,8 +1,8 @@
 #version 330 core
 out vec4 fragColor;
 
-uniform vec2 uResolution;
-uniform float uTime;
+#include "frame_constants.glsl"
+
 
 #define PI 3.141592654
 
@@ -2,21 +2,28 @@
 
 out vec4 fragColor;
 
+#include "frame_constants.glsl"
+
 uniform vec3 uCenter;         // Mandelbox 중심 위치
-uniform vec3 uViewPos;        // 카메라 위치
-uniform vec3 uLightPos;       // 광원 위치
-uniform vec2 uResolution;     // 렌더링 해상도
 
-in mat4 inverseView;
-in mat4 inverseProjection;
-in vec3 vNormal;
+uniform mat4 uModel;
+
+in vec3 vLocalPosition;
 in vec3 vPosition;
 
+// 원점 중심 박스의 면 법선: 절댓값이 가장 큰 축
+vec3 calculateBoxNormal(vec3 p) {
+    vec3 a = abs(p);
+    float m = max(a.x, max(a.y, a.z));
+    vec3 localNormal = sign(p) * step(m, a);
+    return transpose(inverse(mat3(uModel))) * localNormal;
+}
+
 vec3 calculateRayDirection(vec2 fragCoord) {
     vec4 clipSpacePos = vec4((fragCoord / uResolution) * 2.0 - 1.0, -1.0, 1.0);    
-    vec4 viewSpacePos = inverseProjection * clipSpacePos;
+    vec4 viewSpacePos = uInverseProjection * clipSpacePos;
     viewSpacePos = vec4(viewSpacePos.xy, -1.0, 0.0);
-    vec3 worldSpaceDir = normalize((inverseView * viewSpacePos).xyz);
+    vec3 worldSpaceDir = normalize((uInverseView * viewSpacePos).xyz);
     
     return worldSpaceDir;
 }
@@ -114,7 +121,7 @@ float sdBox( vec3 p, vec3 b )
 void main() {
     // 카메라가 구 바깥에 있을때는 레이를 두번 쏘기 때문에 걸러준다    
     vec3 viewToSurface = normalize(vPosition - uViewPos);
-    float alignment = dot(viewToSurface, vNormal);    
+    float alignment = dot(viewToSurface, calculateBoxNormal(vLocalPosition));    
     bool outside = (sdBox(uViewPos - uCenter, vec3(2.0, 2.0, 2.0)) > 0.00);
     if (outside) {
         if (alignment > 0.01) {
@@ -2,22 +2,18 @@
 
 out vec4 fragColor;
 
+#include "frame_constants.glsl"
+
 uniform vec3 uCenter;         // Mandelbox 중심 위치
-uniform vec3 uViewPos;        // 카메라 위치
-uniform vec3 uLightPos;       // 광원 위치
-uniform vec2 uResolution;     // 렌더링 해상도
-uniform float uTime;          // 시간
 
-in mat4 inverseView;
-in mat4 inverseProjection;
 in vec3 vNormal;
 in vec3 vPosition;
 
 vec3 calculateRayDirection(vec2 fragCoord) {
     vec4 clipSpacePos = vec4((fragCoord / uResolution) * 2.0 - 1.0, -1.0, 1.0);    
-    vec4 viewSpacePos = inverseProjection * clipSpacePos;
+    vec4 viewSpacePos = uInverseProjection * clipSpacePos;
     viewSpacePos = vec4(viewSpacePos.xy, -1.0, 0.0);
-    vec3 worldSpaceDir = normalize((inverseView * viewSpacePos).xyz);
+    vec3 worldSpaceDir = normalize((uInverseView * viewSpacePos).xyz);
     
     return worldSpaceDir;
 }
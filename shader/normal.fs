@@ -3,31 +3,33 @@
 in vec2 texCoord;
 in vec3 position;
 in vec3 normal;
-in vec3 tangent;
+in vec4 tangent;
 
 out vec4 fragColor;
 
-uniform vec3 viewPos;
-uniform vec3 lightPos;
+#include "frame_constants.glsl"
 
 uniform sampler2D diffuse;
 uniform sampler2D normalMap;
 
 void main() {
     vec3 texColor = texture(diffuse, texCoord).xyz;
-    vec3 texNorm = texture(normalMap, texCoord).xyz * 2.0 - 1.0;
+    // BC5 normal map은 xy만 저장하므로 z는 단위 길이에서 복원
+    vec2 texNormXY = texture(normalMap, texCoord).xy * 2.0 - 1.0;
+    vec3 texNorm = vec3(texNormXY, sqrt(max(1.0 - dot(texNormXY, texNormXY), 0.0)));
     vec3 N = normalize(normal);
-    vec3 T = normalize(tangent);
-    vec3 B = cross(N, T);
+    vec3 T = normalize(tangent.xyz);
+    // uv가 뒤집힌 면은 bitangent 방향도 뒤집힘
+    vec3 B = cross(N, T) * (tangent.w < 0.0 ? -1.0 : 1.0);
     mat3 TBN = mat3(T, B, N);
     vec3 pixelNorm = normalize(TBN * texNorm);
     vec3 ambient = texColor * 0.2;
 
-    vec3 lightDir = normalize(lightPos - position);
+    vec3 lightDir = normalize(uLightPos - position);
     float diff = max(dot(pixelNorm, lightDir), 0.0);
     vec3 diffuse = diff * texColor * 0.8;
 
-    vec3 viewDir = normalize(viewPos - position);
+    vec3 viewDir = normalize(uViewPos - position);
     vec3 reflectDir = reflect(-lightDir, pixelNorm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = spec * vec3(0.5);
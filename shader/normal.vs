@@ -3,7 +3,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTangent;
+layout (location = 3) in vec4 aTangent;    // w: bitangent 부호
 
 uniform mat4 transform;
 uniform mat4 modelTransform;
@@ -11,7 +11,7 @@ uniform mat4 modelTransform;
 out vec2 texCoord;
 out vec3 position;
 out vec3 normal;
-out vec3 tangent;
+out vec4 tangent;
 
 void main() {
     gl_Position = transform * vec4(aPos, 1.0);
@@ -20,5 +20,5 @@ void main() {
 
     mat4 invTransModelTransform = transpose(inverse(modelTransform));
     normal = (invTransModelTransform * vec4(aNormal, 0.0)).xyz;
-    tangent = (invTransModelTransform * vec4(aTangent, 0.0)).xyz;
+    tangent = vec4((invTransModelTransform * vec4(aTangent.xyz, 0.0)).xyz, aTangent.w);
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 fragColor;
+
+uniform sampler2D tex;          // portal 화면 영역만 렌더링한 텍스처
+uniform vec4 uScreenToUV;       // 화면 픽셀 좌표 -> 텍스처 좌표 (xy: scale, zw: offset)
+
+void main() {
+    vec2 uv = gl_FragCoord.xy * uScreenToUV.xy + uScreenToUV.zw;
+    vec4 pixel = texture(tex, uv);
+    if (pixel.a < 0.01)
+        discard;
+    fragColor = pixel;
+}
@@ -2,7 +2,10 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 transform;
+// quantized mesh 의 position 복원 (그 외 mesh 는 scale 1, offset 0)
+uniform vec3 uPositionScale;
+uniform vec3 uPositionOffset;
 
 void main() {
-    gl_Position = transform * vec4(aPos, 1.0);
+    gl_Position = transform * vec4(aPos * uPositionScale + uPositionOffset, 1.0);
 }
\ No newline at end of file
@@ -2,14 +2,18 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 4) in mat4 aInstanceTransform;  // instance 별 model 행렬 (instancing 이 아니면 단위 행렬)
 
 uniform mat4 transform;
+// quantized mesh 의 position 복원 (그 외 mesh 는 scale 1, offset 0)
+uniform vec3 uPositionScale;
+uniform vec3 uPositionOffset;
 
 out vec4 vertexColor;
 out vec2 texCoord;
 
 void main() {
-    gl_Position = transform * vec4(aPos, 1.0);
+    gl_Position = transform * aInstanceTransform * vec4(aPos * uPositionScale + uPositionOffset, 1.0);
     vertexColor = vec4(aColor, 1.0);
     texCoord = aTexCoord;
-}
\ No newline at end of file
+}
@@ -1,24 +1,20 @@
 #version 330 core
 out vec4 fragColor;
 
-in mat4 inverseView;
-in mat4 inverseProjection;
+#include "frame_constants.glsl"
+
 in vec2 texCoord;
 
 uniform vec3 uCenter;           // object 중심 위치
-uniform vec3 uViewPos;          // 카메라 위치
-uniform vec2 uResolution;       // 렌더링 해상도
-uniform vec3 uLightPos;         // 광원 위치
-uniform float uTime;
 
 uniform sampler2D tex;          // 배경
 uniform samplerCube cubeTex;    // 큐브 배경
 
 vec3 calculateRayDirection(vec2 fragCoord) {
     vec4 clipSpacePos = vec4((fragCoord / uResolution) * 2.0 - 1.0, -1.0, 1.0);    
-    vec4 viewSpacePos = inverseProjection * clipSpacePos;
+    vec4 viewSpacePos = uInverseProjection * clipSpacePos;
     viewSpacePos = vec4(viewSpacePos.xy, -1.0, 0.0);
-    vec3 worldSpaceDir = normalize((inverseView * viewSpacePos).xyz);
+    vec3 worldSpaceDir = normalize((uInverseView * viewSpacePos).xyz);
     
     return worldSpaceDir;
 }
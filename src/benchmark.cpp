@@ -0,0 +1,308 @@
+#include "benchmark.h"
+#include "context.h"
+#include "trace.h"
+#include "image.h"
+#include "model.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+BenchmarkUPtr Benchmark::Create(const BenchmarkConfig& config) {
+    auto benchmark = BenchmarkUPtr(new Benchmark());
+    benchmark->Init(config);
+    return std::move(benchmark);
+}
+
+void Benchmark::Init(const BenchmarkConfig& config) {
+    m_config = config;
+    m_frameTimes.reserve(m_config.frameCount);
+}
+
+BenchmarkSummary Benchmark::Summarize(std::vector<double> samples) {
+    BenchmarkSummary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) {
+        // nearest-rank percentile
+        size_t rank = (size_t)std::ceil(p / 100.0 * (double)samples.size());
+        rank = std::clamp<size_t>(rank, 1, samples.size());
+        return samples[rank - 1];
+    };
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / (double)samples.size();
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    summary.min = samples.front();
+    summary.max = samples.back();
+    return summary;
+}
+
+void Benchmark::Run(Context* context) {
+    auto& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2((float)m_config.width, (float)m_config.height);
+    io.DeltaTime = m_config.timeStep;
+
+    context->SetTimeStep(m_config.timeStep);
+    context->SetMeshLod(m_config.meshLod);
+    context->Reshape(m_config.width, m_config.height);
+
+    SPDLOG_INFO("run benchmark: {} frames ({} warmup) at {} x {}, mesh lod {}",
+        m_config.frameCount, m_config.warmupFrameCount, m_config.width, m_config.height,
+        m_config.meshLod ? "on" : "off");
+
+    auto profiler = context->GetGpuProfiler();
+    m_frameTimes.clear();
+    m_modelTriangles.clear();
+    int totalFrameCount = m_config.warmupFrameCount + m_config.frameCount;
+    for (int i = 0; i < totalFrameCount; i++) {
+        // set before the frame is issued, so the history holds the measured frames only
+        if (i == m_config.warmupFrameCount)
+            profiler->SetRecordHistory(true);
+        auto start = std::chrono::steady_clock::now();
+        TRACE_SCOPE("Frame");
+
+        ImGui::NewFrame();
+        context->Render();
+        ImGui::Render();
+        glFinish();
+
+        auto end = std::chrono::steady_clock::now();
+        if (i >= m_config.warmupFrameCount) {
+            m_frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            // counted since Render reset it at the start of the frame
+            m_modelTriangles.push_back((double)Model::GetSubmittedTriangleCount());
+        }
+    }
+
+    profiler->Flush();
+    profiler->SetRecordHistory(false);
+    m_passTimes = profiler->GetTimeHistory();
+    m_passFragments = profiler->GetFragmentHistory();
+
+    auto summary = Summarize(m_frameTimes);
+    SPDLOG_INFO("frame time (ms) mean: {:.3f}, p50: {:.3f}, p95: {:.3f}, p99: {:.3f}",
+        summary.mean, summary.p50, summary.p95, summary.p99);
+    auto triangles = Summarize(m_modelTriangles);
+    SPDLOG_INFO("model triangles per frame mean: {:.0f}, min: {:.0f}, max: {:.0f}",
+        triangles.mean, triangles.min, triangles.max);
+}
+
+bool Benchmark::WriteJson(const std::string& filename) const {
+    std::ofstream fout(filename);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", filename);
+        return false;
+    }
+
+    auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    auto summary = Summarize(m_frameTimes);
+
+    fout << "{\n";
+    fout << fmt::format("  \"renderer\": \"{}\",\n", renderer ? renderer : "unknown");
+    fout << fmt::format("  \"width\": {},\n", m_config.width);
+    fout << fmt::format("  \"height\": {},\n", m_config.height);
+    fout << fmt::format("  \"frameCount\": {},\n", m_config.frameCount);
+    fout << fmt::format("  \"warmupFrameCount\": {},\n", m_config.warmupFrameCount);
+    fout << fmt::format("  \"timeStep\": {},\n", m_config.timeStep);
+    fout << fmt::format("  \"meshLod\": {},\n", m_config.meshLod ? "true" : "false");
+    fout << "  \"frameTimeMs\": {\n";
+    fout << fmt::format("    \"mean\": {:.4f},\n", summary.mean);
+    fout << fmt::format("    \"p50\": {:.4f},\n", summary.p50);
+    fout << fmt::format("    \"p95\": {:.4f},\n", summary.p95);
+    fout << fmt::format("    \"p99\": {:.4f},\n", summary.p99);
+    fout << fmt::format("    \"min\": {:.4f},\n", summary.min);
+    fout << fmt::format("    \"max\": {:.4f}\n", summary.max);
+    fout << "  },\n";
+    auto triangles = Summarize(m_modelTriangles);
+    fout << "  \"modelTriangles\": {\n";
+    fout << fmt::format("    \"mean\": {:.1f},\n", triangles.mean);
+    fout << fmt::format("    \"p50\": {:.0f},\n", triangles.p50);
+    fout << fmt::format("    \"min\": {:.0f},\n", triangles.min);
+    fout << fmt::format("    \"max\": {:.0f}\n", triangles.max);
+    fout << "  },\n";
+    fout << "  \"passes\": {";
+    bool firstPass = true;
+    for (auto& [name, times]: m_passTimes) {
+        auto passSummary = Summarize(times);
+        double fragments = 0.0;
+        auto fragmentIt = m_passFragments.find(name);
+        if (fragmentIt != m_passFragments.end())
+            fragments = Summarize(fragmentIt->second).mean;
+        fout << (firstPass ? "\n" : ",\n");
+        fout << fmt::format("    \"{}\": {{ \"gpuTimeMs\": {{ \"mean\": {:.4f}, \"p50\": {:.4f}, "
+            "\"p95\": {:.4f}, \"p99\": {:.4f} }}, \"fragmentInvocations\": {:.0f} }}",
+            name, passSummary.mean, passSummary.p50, passSummary.p95, passSummary.p99, fragments);
+        firstPass = false;
+    }
+    fout << "\n  },\n";
+    fout << "  \"frames\": [";
+    for (size_t i = 0; i < m_frameTimes.size(); i++) {
+        fout << (i == 0 ? "" : ", ") << fmt::format("{:.4f}", m_frameTimes[i]);
+    }
+    fout << "]\n";
+    fout << "}\n";
+
+    SPDLOG_INFO("benchmark result written: {}", filename);
+    return true;
+}
+
+bool Benchmark::RunHdrDecode(const BenchmarkConfig& config) {
+    auto threadPool = ThreadPool::Create();
+    SPDLOG_INFO("run hdr decode benchmark: {} x {}", config.hdrPath, config.repeatCount);
+
+    std::vector<double> stbTimes, floatTimes, halfTimes;
+    double maxError = 0.0;
+    int width = 0;
+    int height = 0;
+    auto measure = [](std::vector<double>& times, auto&& load) {
+        auto start = std::chrono::steady_clock::now();
+        auto image = load();
+        times.push_back(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+        return image;
+    };
+    for (int i = 0; i < config.repeatCount; i++) {
+        auto reference = measure(stbTimes, [&]() {
+            return Image::Load(config.hdrPath);
+        });
+        auto image = measure(floatTimes, [&]() {
+            return Image::LoadHdr(config.hdrPath, threadPool.get());
+        });
+        measure(halfTimes, [&]() {
+            return Image::LoadHdr(config.hdrPath, threadPool.get(), true, IMAGE_STORAGE_HALF);
+        });
+        if (!reference || !image || reference->GetChannelCount() != 3 ||
+            reference->GetWidth() != image->GetWidth() || reference->GetHeight() != image->GetHeight()) {
+            SPDLOG_ERROR("failed to decode: {}", config.hdrPath);
+            return false;
+        }
+        if (i == 0) {
+            width = image->GetWidth();
+            height = image->GetHeight();
+            auto expected = (const float*)reference->GetData();
+            auto decoded = (const float*)image->GetData();
+            for (size_t j = 0; j < (size_t)width * height * 3; j++)
+                maxError = std::max(maxError, (double)std::abs(expected[j] - decoded[j]));
+        }
+    }
+
+    auto stb = Summarize(stbTimes);
+    auto parallelFloat = Summarize(floatTimes);
+    auto parallelHalf = Summarize(halfTimes);
+    SPDLOG_INFO("hdr decode (ms) stb: {:.2f}, parallel float: {:.2f}, parallel half: {:.2f} "
+        "({} threads, max error {})", stb.mean, parallelFloat.mean, parallelHalf.mean,
+        threadPool->GetThreadCount(), maxError);
+
+    std::ofstream fout(config.outputPath);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", config.outputPath);
+        return false;
+    }
+    auto writeSummary = [&](const char* name, const BenchmarkSummary& summary, bool last) {
+        fout << fmt::format("    \"{}\": {{ \"mean\": {:.4f}, \"p50\": {:.4f}, \"min\": {:.4f}, "
+            "\"max\": {:.4f} }}{}\n", name, summary.mean, summary.p50, summary.min, summary.max,
+            last ? "" : ",");
+    };
+    fout << "{\n";
+    fout << fmt::format("  \"file\": \"{}\",\n", config.hdrPath);
+    fout << fmt::format("  \"width\": {},\n", width);
+    fout << fmt::format("  \"height\": {},\n", height);
+    fout << fmt::format("  \"threadCount\": {},\n", threadPool->GetThreadCount());
+    fout << fmt::format("  \"repeatCount\": {},\n", config.repeatCount);
+    fout << fmt::format("  \"maxAbsError\": {},\n", maxError);
+    fout << "  \"decodeTimeMs\": {\n";
+    writeSummary("stb", stb, false);
+    writeSummary("parallelFloat", parallelFloat, false);
+    writeSummary("parallelHalf", parallelHalf, true);
+    fout << "  }\n";
+    fout << "}\n";
+
+    SPDLOG_INFO("benchmark result written: {}", config.outputPath);
+    return true;
+}
+
+bool Benchmark::RunObjLoad(const BenchmarkConfig& config) {
+    auto threadPool = ThreadPool::Create();
+    SPDLOG_INFO("run obj load benchmark: {} x {}", config.objPath, config.repeatCount);
+
+    struct LoadResult {
+        std::vector<double> times;
+        size_t vertexCount { 0 };
+        size_t triangleCount { 0 };
+    };
+    auto measure = [&](LoadResult& result, auto&& load) {
+        std::vector<CookedMeshData> meshes;
+        std::vector<CookedMaterial> materials;
+        auto start = std::chrono::steady_clock::now();
+        if (!load(meshes, materials))
+            return false;
+        result.times.push_back(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+        result.vertexCount = result.triangleCount = 0;
+        for (auto& mesh: meshes) {
+            result.vertexCount += mesh.vertices.size();
+            result.triangleCount += mesh.indices.size() / 3;
+        }
+        return true;
+    };
+    LoadResult assimp, serial, parallel;
+    for (int i = 0; i < config.repeatCount; i++) {
+        bool loaded = measure(assimp, [&](auto& meshes, auto& materials) {
+            return Model::LoadByAssimp(config.objPath, meshes, materials);
+        });
+        loaded = loaded && measure(serial, [&](auto& meshes, auto& materials) {
+            return ObjLoader::Load(config.objPath, meshes, materials);
+        });
+        loaded = loaded && measure(parallel, [&](auto& meshes, auto& materials) {
+            return ObjLoader::Load(config.objPath, meshes, materials, threadPool.get());
+        });
+        if (!loaded) {
+            SPDLOG_ERROR("failed to load: {}", config.objPath);
+            return false;
+        }
+    }
+    if (assimp.triangleCount != parallel.triangleCount)
+        SPDLOG_WARN("triangle count differs: assimp {}, obj loader {}", assimp.triangleCount, parallel.triangleCount);
+
+    auto assimpSummary = Summarize(assimp.times);
+    auto serialSummary = Summarize(serial.times);
+    auto parallelSummary = Summarize(parallel.times);
+    SPDLOG_INFO("obj load (ms) assimp: {:.2f}, obj loader: {:.2f}, parallel obj loader: {:.2f} "
+        "({} threads, #face: {}, #vert assimp: {}, deduplicated: {})", assimpSummary.mean,
+        serialSummary.mean, parallelSummary.mean, threadPool->GetThreadCount(),
+        parallel.triangleCount, assimp.vertexCount, parallel.vertexCount);
+
+    std::ofstream fout(config.outputPath);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", config.outputPath);
+        return false;
+    }
+    auto writeSummary = [&](const char* name, const BenchmarkSummary& summary, bool last) {
+        fout << fmt::format("    \"{}\": {{ \"mean\": {:.4f}, \"p50\": {:.4f}, \"min\": {:.4f}, "
+            "\"max\": {:.4f} }}{}\n", name, summary.mean, summary.p50, summary.min, summary.max,
+            last ? "" : ",");
+    };
+    fout << "{\n";
+    fout << fmt::format("  \"file\": \"{}\",\n", config.objPath);
+    fout << fmt::format("  \"triangleCount\": {},\n", parallel.triangleCount);
+    fout << fmt::format("  \"assimpVertexCount\": {},\n", assimp.vertexCount);
+    fout << fmt::format("  \"objLoaderVertexCount\": {},\n", parallel.vertexCount);
+    fout << fmt::format("  \"threadCount\": {},\n", threadPool->GetThreadCount());
+    fout << fmt::format("  \"repeatCount\": {},\n", config.repeatCount);
+    fout << "  \"loadTimeMs\": {\n";
+    writeSummary("assimp", assimpSummary, false);
+    writeSummary("objLoader", serialSummary, false);
+    writeSummary("parallelObjLoader", parallelSummary, true);
+    fout << "  }\n";
+    fout << "}\n";
+
+    SPDLOG_INFO("benchmark result written: {}", config.outputPath);
+    return true;
+}
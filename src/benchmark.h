@@ -0,0 +1,66 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "common.h"
+#include <map>
+#include <vector>
+
+CLASS_PTR(Context)
+
+struct BenchmarkConfig {
+    int frameCount { 300 };
+    int warmupFrameCount { 10 };
+    int width { WINDOW_WIDTH };
+    int height { WINDOW_HEIGHT };
+    float timeStep { 0.01f };
+    std::string outputPath { "benchmark.json" };
+    // --no-lod: every model drawn at level 0, the baseline of the triangle count
+    bool meshLod { true };
+    // --hdr-benchmark: .hdr decoded repeatCount times by each decoder
+    std::string hdrPath;
+    // --obj-benchmark: .obj loaded repeatCount times by Assimp and ObjLoader
+    std::string objPath;
+    int repeatCount { 5 };
+};
+
+struct BenchmarkSummary {
+    double mean { 0.0 };
+    double p50 { 0.0 };
+    double p95 { 0.0 };
+    double p99 { 0.0 };
+    double min { 0.0 };
+    double max { 0.0 };
+};
+
+// Drives Context::Render for a fixed number of frames and
+// records the wall clock time of each frame (including glFinish).
+CLASS_PTR(Benchmark)
+class Benchmark {
+public:
+    static BenchmarkUPtr Create(const BenchmarkConfig& config);
+    static BenchmarkSummary Summarize(std::vector<double> samples);
+    // stb_image against Image::LoadHdr, needs no GL context
+    static bool RunHdrDecode(const BenchmarkConfig& config);
+    // Model::LoadByAssimp against ObjLoader, needs no GL context
+    static bool RunObjLoad(const BenchmarkConfig& config);
+
+    void Run(Context* context);
+    bool WriteJson(const std::string& filename) const;
+
+    const BenchmarkConfig& GetConfig() const { return m_config; }
+    const std::vector<double>& GetFrameTimes() const { return m_frameTimes; }
+    // Model::GetSubmittedTriangleCount of every measured frame
+    const std::vector<double>& GetModelTriangles() const { return m_modelTriangles; }
+
+private:
+    Benchmark() {}
+    void Init(const BenchmarkConfig& config);
+
+    BenchmarkConfig m_config;
+    std::vector<double> m_frameTimes;
+    std::vector<double> m_modelTriangles;
+    std::map<std::string, std::vector<double>> m_passTimes;
+    std::map<std::string, std::vector<double>> m_passFragments;
+};
+
+#endif // __BENCHMARK_H__
@@ -22,6 +22,15 @@ void Buffer::Bind() const {
     glBindBuffer(m_bufferType, m_buffer);
 }
 
+void Buffer::BindBase(uint32_t index) const {
+    glBindBufferBase(m_bufferType, index, m_buffer);
+}
+
+void Buffer::SetData(const void* data, size_t size, size_t offset) const {
+    Bind();
+    glBufferSubData(m_bufferType, offset, size, data);
+}
+
 bool Buffer::Init(uint32_t bufferType, uint32_t usage, 
     const void* data, size_t stride, size_t count) {
         
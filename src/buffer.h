@@ -14,6 +14,8 @@ public:
     size_t GetStride() const { return m_stride; }
     size_t GetCount() const { return m_count; }
     void Bind() const;
+    void BindBase(uint32_t index) const;
+    void SetData(const void* data, size_t size, size_t offset = 0) const;
 
 private:
     Buffer() {}
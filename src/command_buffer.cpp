@@ -0,0 +1,122 @@
+#include "command_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+LinearAllocatorUPtr LinearAllocator::Create(size_t blockSize) {
+    auto allocator = LinearAllocatorUPtr(new LinearAllocator());
+    allocator->m_blockSize = std::max<size_t>(blockSize, 256);
+    allocator->AddBlock(allocator->m_blockSize);
+    return std::move(allocator);
+}
+
+void LinearAllocator::AddBlock(size_t minSize) {
+    Block block;
+    block.size = std::max(m_blockSize, minSize);
+    block.memory.reset(new uint8_t[block.size]);
+    m_blocks.push_back(std::move(block));
+}
+
+void* LinearAllocator::Allocate(size_t size, size_t alignment) {
+    for (;;) {
+        auto& block = m_blocks[m_blockIndex];
+        auto base = (uintptr_t)block.memory.get();
+        auto aligned = (base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        auto end = aligned - base + size;
+        if (end <= block.size) {
+            m_usedSize += end - m_offset;
+            m_offset = end;
+            return (void*)aligned;
+        }
+        // move on to the next block, adding one when the frame outgrew the previous peak
+        m_blockIndex++;
+        m_offset = 0;
+        if (m_blockIndex == m_blocks.size())
+            AddBlock(size + alignment);
+    }
+}
+
+void LinearAllocator::Reset() {
+    m_blockIndex = 0;
+    m_offset = 0;
+    m_usedSize = 0;
+}
+
+uint64_t RenderKey::Make(uint32_t pass, bool translucent, float depth,
+    uint32_t program, uint32_t material) {
+    const uint32_t depthMax = (1u << DEPTH_BITS) - 1;
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    uint32_t depthBits = (uint32_t)(depth * (float)depthMax);
+    if (translucent)
+        depthBits = depthMax - depthBits;
+
+    uint64_t key = 0;
+    key |= (uint64_t)(pass & ((1u << PASS_BITS) - 1));
+    key = (key << TRANSLUCENT_BITS) | (translucent ? 1 : 0);
+    key = (key << DEPTH_BITS) | depthBits;
+    key = (key << PROGRAM_BITS) | (program & ((1u << PROGRAM_BITS) - 1));
+    key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+    return key;
+}
+
+CommandBufferUPtr CommandBuffer::Create(int threadCount) {
+    auto commandBuffer = CommandBufferUPtr(new CommandBuffer());
+    commandBuffer->Init(threadCount);
+    return std::move(commandBuffer);
+}
+
+void CommandBuffer::Init(int threadCount) {
+    m_threadLists.resize(std::max(threadCount, 1));
+    for (auto& list: m_threadLists)
+        list.allocator = LinearAllocator::Create();
+}
+
+void CommandBuffer::Reset() {
+    for (auto& list: m_threadLists) {
+        list.allocator->Reset();
+        list.commands.clear();
+    }
+    m_commands.clear();
+}
+
+void CommandBuffer::Sort() {
+    m_commands.clear();
+    for (auto& list: m_threadLists)
+        m_commands.insert(m_commands.end(), list.commands.begin(), list.commands.end());
+    RadixSort(m_commands, m_scratch);
+}
+
+void CommandBuffer::Submit() const {
+    for (auto& command: m_commands)
+        command.dispatch(command.data);
+}
+
+void CommandBuffer::RadixSort(std::vector<RenderCommand>& commands, std::vector<RenderCommand>& scratch) {
+    // LSD radix sort, 8 bits per pass; stable, so equal keys keep recording order
+    if (commands.size() < 2)
+        return;
+    scratch.resize(commands.size());
+    auto src = commands.data();
+    auto dst = scratch.data();
+    size_t count = commands.size();
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256];
+        memset(histogram, 0, sizeof(histogram));
+        for (size_t i = 0; i < count; i++)
+            histogram[(src[i].key >> shift) & 0xFF]++;
+        // every key shares this byte, nothing to move
+        if (histogram[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (int i = 0; i < 256; i++) {
+            size_t bucketSize = histogram[i];
+            histogram[i] = offset;
+            offset += bucketSize;
+        }
+        for (size_t i = 0; i < count; i++)
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != commands.data())
+        memcpy(commands.data(), src, count * sizeof(RenderCommand));
+}
@@ -0,0 +1,98 @@
+#ifndef __COMMAND_BUFFER_H__
+#define __COMMAND_BUFFER_H__
+
+#include "common.h"
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for per-frame data. Memory is only released by Reset,
+// which keeps the blocks for the next frame.
+CLASS_PTR(LinearAllocator)
+class LinearAllocator {
+public:
+    static LinearAllocatorUPtr Create(size_t blockSize = 64 * 1024);
+
+    void* Allocate(size_t size, size_t alignment);
+    void Reset();
+    size_t GetUsedSize() const { return m_usedSize; }
+
+private:
+    LinearAllocator() {}
+    void AddBlock(size_t minSize);
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> memory;
+        size_t size { 0 };
+    };
+    std::vector<Block> m_blocks;
+    size_t m_blockSize { 0 };
+    size_t m_blockIndex { 0 };
+    size_t m_offset { 0 };
+    size_t m_usedSize { 0 };
+};
+
+// 64-bit sort key, most significant field first:
+// | pass 4 | translucent 1 | depth 24 | program 15 | material 20 |
+// translucent commands store inverted depth so they sort back to front.
+struct RenderKey {
+    static const int PASS_BITS = 4;
+    static const int TRANSLUCENT_BITS = 1;
+    static const int DEPTH_BITS = 24;
+    static const int PROGRAM_BITS = 15;
+    static const int MATERIAL_BITS = 20;
+
+    // depth is the view distance normalized to [0, 1]
+    static uint64_t Make(uint32_t pass, bool translucent, float depth,
+        uint32_t program, uint32_t material);
+    static uint32_t GetPass(uint64_t key) { return (uint32_t)(key >> 60); }
+};
+
+using RenderDispatch = void (*)(const void* data);
+
+struct RenderCommand {
+    uint64_t key;
+    RenderDispatch dispatch;
+    const void* data;
+};
+
+// Command packets recorded in parallel, one list and allocator per thread,
+// then merged, radix sorted by key and submitted on the GL thread.
+CLASS_PTR(CommandBuffer)
+class CommandBuffer {
+public:
+    static CommandBufferUPtr Create(int threadCount);
+
+    void Reset();
+    // packet payload lives in the thread's allocator until the next Reset
+    template <typename T>
+    T* Push(int threadIndex, uint64_t key, RenderDispatch dispatch) {
+        static_assert(std::is_trivially_destructible<T>::value, "packets are never destroyed");
+        auto& list = m_threadLists[threadIndex];
+        auto data = new (list.allocator->Allocate(sizeof(T), alignof(T))) T();
+        list.commands.push_back(RenderCommand { key, dispatch, data });
+        return data;
+    }
+    void Sort();
+    void Submit() const;
+
+    size_t GetCommandCount() const { return m_commands.size(); }
+    const std::vector<RenderCommand>& GetCommands() const { return m_commands; }
+
+    static void RadixSort(std::vector<RenderCommand>& commands, std::vector<RenderCommand>& scratch);
+
+private:
+    CommandBuffer() {}
+    void Init(int threadCount);
+
+    // padded so recording threads do not share cache lines
+    struct alignas(64) ThreadList {
+        LinearAllocatorUPtr allocator;
+        std::vector<RenderCommand> commands;
+    };
+    std::vector<ThreadList> m_threadLists;
+    std::vector<RenderCommand> m_commands;
+    std::vector<RenderCommand> m_scratch;
+};
+
+#endif // __COMMAND_BUFFER_H__
@@ -1,6 +1,10 @@
 #include "common.h"
+#include "mapped_file.h"
+#include "trace.h"
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <filesystem>
 
 std::optional<std::string> LoadTextFile(const std::string& filename) {
     std::ifstream fin(filename);
@@ -32,4 +36,59 @@ glm::vec3 GetAttenuationCoeff(float distance) {
 
 float RandomRange(float minValue, float maxValue) {
     return ((float)rand() / (float)RAND_MAX) * (maxValue - minValue) + minValue;
-}
\ No newline at end of file
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull ^ seed;
+    auto bytes = (const uint8_t*)data;
+    size_t wordCount = size / 8;
+    for (size_t i = 0; i < wordCount; i++) {
+        uint64_t word;
+        memcpy(&word, bytes + i * 8, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (size_t i = wordCount * 8; i < size; i++)
+        hash = (hash ^ bytes[i]) * prime;
+    return hash ^ size;
+}
+
+std::optional<FileStamp> GetFileStamp(const std::string& filename) {
+    std::error_code error;
+    FileStamp stamp;
+    stamp.size = (uint64_t)std::filesystem::file_size(filename, error);
+    if (error)
+        return {};
+    stamp.time = (int64_t)std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+    if (error)
+        return {};
+    return stamp;
+}
+
+uint64_t HashFile(const std::string& filename) {
+    TRACE_SCOPE("HashFile");
+    auto file = MappedFile::Open(filename);
+    if (!file)
+        return 0;
+    return HashBytes(file->GetData(), file->GetSize());
+}
+
+bool IsFileUnchanged(const std::string& filename, uint64_t hash, FileStamp& stamp) {
+    auto current = GetFileStamp(filename);
+    if (!current)
+        return false;
+    if (*current == stamp)
+        return true;
+    if (HashFile(filename) != hash)
+        return false;
+    stamp = *current;
+    return true;
+}
+
+std::string GetCacheStem(const std::string& filename) {
+    auto path = std::filesystem::path(filename).lexically_normal();
+    auto normalized = path.generic_string();
+    return fmt::format("{}_{:016x}", path.stem().string(),
+        HashBytes(normalized.data(), normalized.size()));
+}
@@ -20,5 +20,27 @@ using klassName ## WPtr = std::weak_ptr<klassName>;
 std::optional<std::string> LoadTextFile(const std::string& filename);
 glm::vec3 GetAttenuationCoeff(float distance);
 float RandomRange(float minValue = 0.0f, float maxValue = 1.0f);
+// FNV-1a style multiply and xor over 8-byte words with an extra xor shift
+// per word, the tail bytewise and the size folded in last. For cache keys,
+// not cryptographic.
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// size and last write time of a file, compared before hashing its contents
+struct FileStamp {
+    uint64_t size { 0 };
+    int64_t time { 0 };
+    bool operator==(const FileStamp& other) const { return size == other.size && time == other.time; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+std::optional<FileStamp> GetFileStamp(const std::string& filename);
+// HashBytes of a whole file through a memory mapping, 0 when it cannot be read
+uint64_t HashFile(const std::string& filename);
+// whether a file still has the contents recorded with hash and stamp. It is
+// hashed only when its stamp differs; stamp then receives the current one,
+// so the record can be refreshed and the next check skips the hash.
+bool IsFileUnchanged(const std::string& filename, uint64_t hash, FileStamp& stamp);
+// "{stem}_{hash of the normalized path}" of a source file, so cache files
+// of sources with the same name in different directories do not collide
+std::string GetCacheStem(const std::string& filename);
 
 #endif // __COMMON_H__
\ No newline at end of file
@@ -1,7 +1,20 @@
 #include "context.h"
 #include "image.h"
+#include "cooked_texture.h"
+#include "equirect_converter.h"
+#include "trace.h"
 #include <imgui.h>
 
+static const float CAMERA_FAR = 150.0f;
+
+// packet payload of one gallery object
+struct DrawPacket {
+    Context* context;
+    int type;
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
 ContextUPtr Context::Create() {
     auto context = ContextUPtr(new Context());
     if (!context->Init())
@@ -38,6 +51,7 @@ void Context::ProcessInput(GLFWwindow* window) {
 }
 
 void Context::Reshape(int width, int height) {
+    TRACE_SCOPE("Context::Reshape");
     if (width == 0) width = 1;
     if (height == 0) height = 1;
     m_width = width;
@@ -47,7 +61,6 @@ void Context::Reshape(int width, int height) {
     // framebuffer create
     m_framebuffer1 = Framebuffer::Create({Texture::Create(width, height, GL_RGBA)});
     m_framebuffer2 = Framebuffer::Create({Texture::Create(width, height, GL_RGBA)});
-    m_anotherWorldFramebuffer = Framebuffer::Create({Texture::Create(width, height, GL_RGBA)});
     m_kaleidoscopeFramebuffer = Framebuffer::Create({Texture::Create(width, height, GL_RGBA)});
 }
 
@@ -83,16 +96,46 @@ void Context::MouseButton(int button, int action, double x, double y) {
 }
 
 bool Context::Init() {
+    TRACE_SCOPE("Context::Init");
+    m_threadPool = ThreadPool::Create();
+    m_commandBuffer = CommandBuffer::Create(m_threadPool->GetThreadCount());
+    m_gpuProfiler = GpuProfiler::Create();
+    m_renderTargetPool = RenderTargetPool::Create();
+    m_frameConstantsBuffer = Buffer::CreateWithData(GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW,
+        nullptr, sizeof(FrameConstants), 1);
+
     glEnable(GL_MULTISAMPLE);
-    glEnable(GL_DEPTH_TEST);
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    GLState::Invalidate();
+    GLState::SetDepthTest(true);
     glClearColor(0.1f, 0.2f, 0.3f, 0.0f);
 
     m_box = Mesh::CreateBox();
     m_plane = Mesh::CreatePlane();
     m_sphere = Mesh::CreateSphere();
-    m_dinoModel = Model::Load("./model/Dino.vox.obj");
-    m_pictureFrame = Model::Load("./model/Moldura Sketchfab.obj");
+    m_dinoModel = Model::Load("./model/Dino.vox.obj", m_threadPool.get());
+    m_pictureFrame = Model::Load("./model/Moldura Sketchfab.obj", m_threadPool.get());
+
+    // dino field of the another world, one instanced draw per level of detail
+    const int dinoRowCount = 10;
+    const int dinoColumnCount = 10;
+    auto& dinoTransforms = m_dinoTransforms;
+    dinoTransforms.reserve(dinoRowCount * dinoColumnCount);
+    for (int i = 0; i < dinoRowCount; i++) {
+        for (int j = 0; j < dinoColumnCount; j++) {
+            auto model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(-10.0f + j * 4.0f, 0.0f, 7.5f + i * 4.0f));
+            model = glm::scale(model, glm::vec3(0.5f));
+            model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            dinoTransforms.push_back(model);
+        }
+    }
+    m_dinoInstanceCount = (int)dinoTransforms.size();
+    // sorted by level of detail whenever the levels change
+    m_dinoInstanceBuffer = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW,
+        dinoTransforms.data(), sizeof(glm::mat4), dinoTransforms.size());
+    m_dinoLods.assign(dinoTransforms.size(), 0);
+    m_dinoModel->SetInstanceBuffer(m_dinoInstanceBuffer);
 
     m_simpleProgram = Program::Create("./shader/simple.vs", "./shader/simple.fs");
     m_skyboxProgram = Program::Create("./shader/skybox_hdr.vs", "./shader/skybox_hdr.fs");
@@ -106,17 +149,125 @@ bool Context::Init() {
     m_spongeProgram = Program::Create("./shader/sponge.vs", "./shader/sponge.fs");
     m_kaleidoscopeProgram = Program::Create("./shader/kaleidoscope.vs", "./shader/kaleidoscope.fs");
     m_waterProgram = Program::Create("./shader/water.vs", "./shader/water.fs");
+    m_portalProgram = Program::Create("./shader/portal.vs", "./shader/portal.fs");
 
 
-    m_groundAlbedo = Texture::CreateFromImage(Image::Load("./image/Old_Plastered_Stone_Wall_1_Diffuse.png").get());
-    m_groundNormal = Texture::CreateFromImage(Image::Load("./image/Old_Plastered_Stone_Wall_1_Normal.png").get());
-    m_dinoTexture = Texture::CreateFromImage(Image::Load("./model/Dino.vox.png").get());
+    m_groundAlbedo = LoadTexture("./image/Old_Plastered_Stone_Wall_1_Diffuse.png");
+    m_groundNormal = LoadTexture("./image/Old_Plastered_Stone_Wall_1_Normal.png");
+    m_dinoTexture = LoadTexture("./model/Dino.vox.png");
 
     // create hdr cubemap
-    m_hdrMap = Texture::CreateFromImage(Image::Load("./image/god_rays_sky_dome_8k.hdr").get());
     m_sphericalMapProgram = Program::Create("./shader/spherical_map.vs", "./shader/spherical_map.fs");
-    m_hdrCubeMap = CubeTexture::Create(2048, 2048, GL_RGB16F, GL_FLOAT);
-    auto cubeFramebuffer = CubeFramebuffer::Create(m_hdrCubeMap);
+    CreatePipelineStates();
+    m_cubemapCache = CubemapCache::Create(CUBEMAP_CACHE_DIRECTORY);
+    m_uploadStream = UploadStream::Create();
+    m_hdrCubeMap = LoadHdrCubeMap(SKY_HDR_FILENAME, HDR_CUBE_MAP_SIZE);
+    m_anotherWorldCubeMap = LoadHdrCubeMap(ANOTHER_WORLD_HDR_FILENAME, HDR_CUBE_MAP_SIZE);
+    if (!m_hdrCubeMap || !m_anotherWorldCubeMap)
+        return false;
+    glViewport(0, 0, m_width, m_height);
+
+    // cloud and water composite the screen drawn so far,
+    // so every gallery object is sorted back to front
+    // radius covers the raymarched volume or the picture frame of each object
+    m_drawcalls = {
+        DrawCall { BEAD, m_beadPos, 1.05f, m_beadProgram.get() },
+        DrawCall { MANDELBOX, m_mandelboxPos, 3.47f, m_mandelboxProgram.get() },
+        DrawCall { MANDELBULB, m_mandelbulbPos, 1.5f, m_mandelbulbProgram.get() },
+        DrawCall { SPONGE, m_spongePos, 1.74f, m_spongeProgram.get() },
+        DrawCall { WORLD, m_anotherWorldPos, 1.8f, m_textureProgram.get() },
+        DrawCall { KALEIDOSCOPE, m_kaleidoscopePos, 1.8f, m_textureProgram.get() },
+        DrawCall { CLOUD, m_cloudPos, 1.2f, m_cloudProgram.get() },
+        DrawCall { WATER, m_waterPos, 1.74f, m_waterProgram.get() },
+    };
+    m_cullingSet = CullingSet::Create();
+    for (auto& drawCall: m_drawcalls)
+        m_cullingSet->Add(drawCall.pos, drawCall.radius);
+    m_cullingResult.resize(m_drawcalls.size());
+
+    return true;
+}
+
+TextureUPtr Context::LoadTexture(const std::string& filename) {
+    TRACE_SCOPE("Context::LoadTexture");
+    auto cookedFilename = CookedTexture::GetCookedFilename(COOKED_TEXTURE_DIRECTORY, filename);
+    if (CookedTexture::IsUpToDate(cookedFilename, filename)) {
+        auto cooked = CookedTexture::Load(cookedFilename);
+        if (cooked)
+            return Texture::CreateFromCooked(cooked.get());
+    }
+    return Texture::CreateFromImage(Image::Load(filename).get());
+}
+
+CubeTexturePtr Context::LoadHdrCubeMap(const std::string& filename, int faceSize) {
+    TRACE_SCOPE("Context::LoadHdrCubeMap");
+    CubemapCacheKey key;
+    key.source = filename;
+    key.faceSize = faceSize;
+    key.internalFormat = GL_RGB16F;
+    if (m_cubemapCache) {
+        auto cubeMap = m_cubemapCache->Load(key);
+        if (cubeMap)
+            return cubeMap;
+    }
+
+    // a cooked BC6H equirect uploads as is, otherwise the .hdr is
+    // streamed in bands and the float image is never held in memory as a whole
+    TextureUPtr equirect;
+    auto cookedFilename = CookedTexture::GetCookedFilename(COOKED_TEXTURE_DIRECTORY, filename);
+    auto cooked = CookedTexture::IsUpToDate(cookedFilename, filename) ?
+        CookedTexture::Load(cookedFilename) : nullptr;
+    if (cooked)
+        equirect = Texture::CreateFromCooked(cooked.get());
+    else
+        equirect = Texture::CreateFromHdrFile(filename, m_uploadStream.get());
+    if (!equirect)
+        return nullptr;
+    auto cubeMap = BakeHdrCubeMap(equirect.get(), faceSize);
+    if (m_cubemapCache)
+        m_cubemapCache->Store(key, cubeMap.get());
+    return cubeMap;
+}
+
+bool Context::CheckHdrCubeMapBake(const std::string& filename, int faceSize) {
+    TRACE_SCOPE("Context::CheckHdrCubeMapBake");
+    auto image = Image::LoadHdr(filename, m_threadPool.get());
+    if (!image)
+        return false;
+    auto cpuFaces = EquirectConverter::Convert(image.get(), faceSize, m_threadPool.get());
+    auto equirect = Texture::CreateFromImage(image.get());
+    if (cpuFaces.empty() || !equirect)
+        return false;
+    // the converter samples the base level only
+    equirect->Bind();
+    equirect->SetFilter(GL_LINEAR, GL_LINEAR);
+    auto cubeMap = BakeHdrCubeMap(equirect.get(), faceSize);
+
+    bool match = true;
+    auto gpuFace = Image::Create(faceSize, faceSize, 3, 4);
+    cubeMap->Bind();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int face = 0; face < 6; face++) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, GL_FLOAT, gpuFace->GetData());
+        auto difference = EquirectConverter::CompareFaces(gpuFace.get(), cpuFaces[face].get());
+        bool faceMatch = difference.meanError <= EQUIRECT_GPU_MEAN_ERROR &&
+            difference.outlierFraction <= EQUIRECT_GPU_OUTLIER_FRACTION;
+        if (faceMatch)
+            SPDLOG_INFO("cubemap face {} of {}: mean error {:.2e}, max error {:.2e}, outliers {:.2e}",
+                face, filename, difference.meanError, difference.maxError, difference.outlierFraction);
+        else
+            SPDLOG_ERROR("cubemap face {} of {} differs from the GPU bake: mean error {:.2e}, max error {:.2e}, outliers {:.2e}",
+                face, filename, difference.meanError, difference.maxError, difference.outlierFraction);
+        match = match && faceMatch;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return match;
+}
+
+CubeTexturePtr Context::BakeHdrCubeMap(const Texture* equirect, int faceSize) {
+    TRACE_SCOPE("Context::BakeHdrCubeMap");
+    CubeTexturePtr cubeMap = CubeTexture::Create(faceSize, faceSize, GL_RGB16F, GL_FLOAT);
+    auto cubeFramebuffer = CubeFramebuffer::Create(cubeMap);
     auto projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
     std::vector<glm::mat4> views = {
         glm::lookAt(glm::vec3(0.0f),
@@ -132,59 +283,71 @@ bool Context::Init() {
         glm::lookAt(glm::vec3(0.0f),
         glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
     };
-    m_sphericalMapProgram->Use();
+    m_sphericalMapState->Apply();
     m_sphericalMapProgram->SetUniform("tex", 0);
-    m_hdrMap->Bind();
-    glViewport(0, 0, 2048, 2048);
+    GLState::ActiveTexture(GL_TEXTURE0);
+    equirect->Bind();
+    glViewport(0, 0, faceSize, faceSize);
     for (int i = 0; i < (int)views.size(); i++) {
         cubeFramebuffer->Bind(i);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         m_sphericalMapProgram->SetUniform("transform", projection * views[i]);
-        m_box->Draw(m_sphericalMapProgram.get());
+        m_box->DrawPositions(m_sphericalMapProgram.get());
     }
     Framebuffer::BindToDefault();
-    glViewport(0, 0, m_width, m_height);
-
-    m_anotherWorldHdrMap = Texture::CreateFromImage(Image::Load("./image/dug_up_dark_soil_in_the_field_8k.hdr").get());
-    m_anotherWorldCubeMap = CubeTexture::Create(2048, 2048, GL_RGB16F, GL_FLOAT);
-    cubeFramebuffer = CubeFramebuffer::Create(m_anotherWorldCubeMap);
-    projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    m_sphericalMapProgram->Use();
-    m_sphericalMapProgram->SetUniform("tex", 0);
-    m_anotherWorldHdrMap->Bind();
-    glViewport(0, 0, 2048, 2048);
-    for (int i = 0; i < (int)views.size(); i++) {
-        cubeFramebuffer->Bind(i);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_sphericalMapProgram->SetUniform("transform", projection * views[i]);
-        m_box->Draw(m_sphericalMapProgram.get());
-    }
-    Framebuffer::BindToDefault();
-    glViewport(0, 0, m_width, m_height);
-
+    return cubeMap;
+}
 
-    m_drawcalls[0].type = BEAD;
-    m_drawcalls[0].pos = m_beadPos;
-    m_drawcalls[1].type = MANDELBOX;
-    m_drawcalls[1].pos = m_mandelboxPos;
-    m_drawcalls[2].type = MANDELBULB;
-    m_drawcalls[2].pos = m_mandelbulbPos;
-    m_drawcalls[3].type = SPONGE;
-    m_drawcalls[3].pos = m_spongePos;
-    m_drawcalls[4].type = WORLD;
-    m_drawcalls[4].pos = m_anotherWorldPos;
-    m_drawcalls[5].type = KALEIDOSCOPE;
-    m_drawcalls[5].pos = m_kaleidoscopePos;
-    m_drawcalls[6].type = CLOUD;
-    m_drawcalls[6].pos = m_cloudPos;
-    m_drawcalls[7].type = WATER;
-    m_drawcalls[7].pos = m_waterPos;
+void Context::CreatePipelineStates() {
+    auto create = [](const Program* program) {
+        PipelineStateDesc desc;
+        desc.program = program;
+        return desc;
+    };
 
-    return true;
+    m_simpleState = PipelineState::Create(create(m_simpleProgram.get()));
+    m_textureState = PipelineState::Create(create(m_textureProgram.get()));
+    m_normalState = PipelineState::Create(create(m_normalProgram.get()));
+    m_sphericalMapState = PipelineState::Create(create(m_sphericalMapProgram.get()));
+    m_mandelboxState = PipelineState::Create(create(m_mandelboxProgram.get()));
+    m_mandelbulbState = PipelineState::Create(create(m_mandelbulbProgram.get()));
+    m_spongeState = PipelineState::Create(create(m_spongeProgram.get()));
+    m_kaleidoscopeState = PipelineState::Create(create(m_kaleidoscopeProgram.get()));
+    m_portalState = PipelineState::Create(create(m_portalProgram.get()));
+
+    auto copy = create(m_textureProgram.get());
+    copy.depthTest = false;
+    m_copyState = PipelineState::Create(copy);
+
+    auto bead = create(m_beadProgram.get());
+    bead.blend = true;
+    m_beadState = PipelineState::Create(bead);
+
+    // skybox and screen space passes draw at the far plane
+    auto skybox = create(m_skyboxProgram.get());
+    skybox.depthFunc = GL_LEQUAL;
+    m_skyboxState = PipelineState::Create(skybox);
+
+    auto cloud = create(m_cloudProgram.get());
+    cloud.depthFunc = GL_LEQUAL;
+    m_cloudState = PipelineState::Create(cloud);
+
+    auto water = create(m_waterProgram.get());
+    water.depthFunc = GL_LEQUAL;
+    m_waterState = PipelineState::Create(water);
 }
 
 void Context::Render() {
-    m_time += 0.01f;
+    TRACE_SCOPE("Context::Render");
+    m_time += m_timeStep;
+    m_gpuProfiler->BeginFrame();
+    m_renderTargetPool->BeginFrame();
+    colorAttachmentAW = nullptr;
+    auto issuedStateCount = GLState::GetIssuedCount();
+    auto skippedStateCount = GLState::GetSkippedCount();
+    GLState::ResetCounters();
+    auto modelTriangleCount = Model::GetSubmittedTriangleCount();
+    Model::ResetSubmittedTriangleCount();
     if (ImGui::Begin("ui window")) {
         ImGui::DragFloat3("camera pos", glm::value_ptr(m_cameraPos), 0.01f);
         ImGui::DragFloat("camera yaw", &m_cameraYaw, 0.5f);
@@ -222,9 +385,49 @@ void Context::Render() {
 
         ImGui::Separator();
         ImGui::Checkbox("Cloud Obstacle ON", &m_obstacleOn);
+        ImGui::Checkbox("Mesh LOD", &m_meshLod);
+        ImGui::Checkbox("Show GPU Profiler", &m_showProfiler);
     }
     ImGui::End();
 
+    if (m_showProfiler) {
+        if (ImGui::Begin("gpu profiler", &m_showProfiler)) {
+            ImGui::Text("gpu total: %.3f ms", m_gpuProfiler->GetLastFrameTimeMs());
+            ImGui::Text("dropped frames: %d", m_gpuProfiler->GetDroppedFrameCount());
+            ImGui::Text("visible objects: %d / %d", m_visibleCount, (int)m_drawcalls.size());
+            ImGui::Text("state calls: %llu issued, %llu skipped",
+                (unsigned long long)issuedStateCount, (unsigned long long)skippedStateCount);
+            ImGui::Text("model triangles: %llu", (unsigned long long)modelTriangleCount);
+            for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+                auto arena = GeometryArena::Find((VertexFormat)format);
+                if (!arena)
+                    continue;
+                auto vertexStats = arena->GetVertexStats();
+                auto indexStats = arena->GetIndexStats();
+                ImGui::Text("geometry arena %d: vertex %.1f%% used %.1f%% fragmented, index %.1f%% used %.1f%% fragmented",
+                    format, vertexStats.utilization * 100.0f, vertexStats.fragmentation * 100.0f,
+                    indexStats.utilization * 100.0f, indexStats.fragmentation * 100.0f);
+            }
+            ImGui::Separator();
+            ImGui::Columns(m_gpuProfiler->HasPipelineStatistics() ? 3 : 2);
+            ImGui::Text("pass"); ImGui::NextColumn();
+            ImGui::Text("ms"); ImGui::NextColumn();
+            if (m_gpuProfiler->HasPipelineStatistics()) {
+                ImGui::Text("fragments"); ImGui::NextColumn();
+            }
+            ImGui::Separator();
+            for (auto& pass: m_gpuProfiler->GetLastFrame()) {
+                ImGui::Text("%s", pass.name.c_str()); ImGui::NextColumn();
+                ImGui::Text("%.3f", pass.timeMs); ImGui::NextColumn();
+                if (m_gpuProfiler->HasPipelineStatistics()) {
+                    ImGui::Text("%llu", (unsigned long long)pass.fragmentInvocations); ImGui::NextColumn();
+                }
+            }
+            ImGui::Columns(1);
+        }
+        ImGui::End();
+    }
+
     m_cameraFront =
         glm::rotate(glm::mat4(1.0f),
         glm::radians(m_cameraYaw), glm::vec3(0.0f, 1.0f, 0.0f)) *
@@ -232,189 +435,197 @@ void Context::Render() {
         glm::radians(m_cameraPitch), glm::vec3(1.0f, 0.0f, 0.0f)) *
         glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
     auto projection = glm::perspective(glm::radians(45.0f),
-        (float)m_width / (float)m_height, 0.01f, 150.0f);
+        (float)m_width / (float)m_height, 0.01f, CAMERA_FAR);
     auto view = glm::lookAt(
         m_cameraPos,
         m_cameraPos + m_cameraFront,
         m_cameraUp);
-    
-
-    PreRenderKaleidoscope(projection, view);
-    PreRenderAnotherWorld(projection, view);
+    UpdateFrameConstants(projection, view);
+    CullDrawCalls(projection, view);
+
+    // offscreen passes only feed their picture frames
+    if (IsVisible(KALEIDOSCOPE)) {
+        TRACE_SCOPE("PreRenderKaleidoscope");
+        GpuProfileScope scope(m_gpuProfiler.get(), "PreRenderKaleidoscope");
+        PreRenderKaleidoscope(projection, view);
+    }
+    if (IsVisible(WORLD)) {
+        TRACE_SCOPE("PreRenderAnotherWorld");
+        GpuProfileScope scope(m_gpuProfiler.get(), "PreRenderAnotherWorld");
+        PreRenderAnotherWorld(projection, view);
+    }
 
     m_framebuffer1->Bind();
     colorAttachment1 = m_framebuffer1->GetColorAttachment(0);
     glViewport(0, 0, m_width, m_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    DrawEnvironment(projection, view);
-    CalDistance();
-    SortDrawCall();
+    {
+        TRACE_SCOPE("DrawEnvironment");
+        GpuProfileScope scope(m_gpuProfiler.get(), "DrawEnvironment");
+        DrawEnvironment(projection, view);
+    }
     DrawAll(projection, view);
+    m_gpuProfiler->EndFrame();
+}
+
+void Context::UpdateFrameConstants(const glm::mat4& projection, const glm::mat4& view) {
+    m_frameConstants.view = view;
+    m_frameConstants.projection = projection;
+    m_frameConstants.inverseView = glm::inverse(view);
+    m_frameConstants.inverseProjection = glm::inverse(projection);
+    m_frameConstants.viewPos = m_cameraPos;
+    m_frameConstants.time = m_time;
+    m_frameConstants.lightPos = m_lightPos;
+    m_frameConstants.resolution = glm::vec2(m_width, m_height);
+    m_frameConstantsBuffer->SetData(&m_frameConstants, sizeof(FrameConstants));
+    m_frameConstantsBuffer->BindBase(FRAME_CONSTANTS_BINDING);
+}
+
+void Context::CullDrawCalls(const glm::mat4& projection, const glm::mat4& view) {
+    TRACE_SCOPE("CullDrawCalls");
+    auto frustum = Frustum::FromMatrix(projection * view);
+    m_visibleCount = m_cullingSet->Cull(frustum, m_cullingResult.data());
+    for (size_t i = 0; i < m_drawcalls.size(); i++)
+        m_drawcalls[i].visible = m_cullingResult[i] != 0;
+}
+
+bool Context::IsVisible(int type) const {
+    for (auto& drawCall: m_drawcalls) {
+        if (drawCall.type == type && drawCall.visible)
+            return true;
+    }
+    return false;
 }
 
 void Context::DrawBead(const glm::mat4& projection, const glm::mat4& view) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    m_beadProgram->Use();
+    m_beadState->Apply();
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_beadPos);
     model = glm::scale(model, glm::vec3(2.1f));
-    m_beadProgram->SetUniform("uView", view);
-    m_beadProgram->SetUniform("uProjection", projection);
     m_beadProgram->SetUniform("uModel", model);
     m_beadProgram->SetUniform("uTransform", projection * view * model);
     m_beadProgram->SetUniform("uCenter", m_beadPos);
-    m_beadProgram->SetUniform("uViewPos", m_cameraPos);
-    m_beadProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_beadProgram->SetUniform("uLightPos", m_lightPos);
     m_beadProgram->SetUniform("uDiffuse", m_diffuseBead);
     m_beadProgram->SetUniform("uSpecular", m_specularBead);
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_hdrCubeMap->Bind();
     m_beadProgram->SetUniform("cubeTex", 0);
     
-    m_sphere->Draw(m_beadProgram.get());
-    glDisable(GL_BLEND);
+    m_sphere->DrawPositions(m_beadProgram.get());
 }
 
 void Context::DrawMandelbox(const glm::mat4& projection, const glm::mat4& view) {
-    m_mandelboxProgram->Use();
+    m_mandelboxState->Apply();
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_mandelboxPos);
     model = glm::scale(model, glm::vec3(4.0f));
-    m_mandelboxProgram->SetUniform("uView", view);
-    m_mandelboxProgram->SetUniform("uProjection", projection);
     m_mandelboxProgram->SetUniform("uModel", model);
     m_mandelboxProgram->SetUniform("uTransform", projection * view * model);
     m_mandelboxProgram->SetUniform("uCenter", m_mandelboxPos);
-    m_mandelboxProgram->SetUniform("uViewPos", m_cameraPos);
-    m_mandelboxProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_mandelboxProgram->SetUniform("uLightPos", m_lightPos);
-    m_box->Draw(m_mandelboxProgram.get());
+    m_box->DrawPositions(m_mandelboxProgram.get());
 }
 
 void Context::DrawMandelbulb(const glm::mat4& projection, const glm::mat4& view) {
-    m_mandelbulbProgram->Use();
+    m_mandelbulbState->Apply();
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_mandelbulbPos);
     model = glm::scale(model, glm::vec3(3.0f));
-    m_mandelbulbProgram->SetUniform("uView", view);
-    m_mandelbulbProgram->SetUniform("uProjection", projection);
     m_mandelbulbProgram->SetUniform("uModel", model);
     m_mandelbulbProgram->SetUniform("uTransform", projection * view * model);
     m_mandelbulbProgram->SetUniform("uCenter", m_mandelbulbPos);
-    m_mandelbulbProgram->SetUniform("uViewPos", m_cameraPos);
-    m_mandelbulbProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_mandelbulbProgram->SetUniform("uLightPos", m_lightPos);
-    m_mandelbulbProgram->SetUniform("uTime", m_time);
-    m_sphere->Draw(m_mandelbulbProgram.get());
+    m_sphere->DrawPositions(m_mandelbulbProgram.get());
 }
 
 
 void Context::DrawSponge(const glm::mat4& projection, const glm::mat4& view) {
-    m_spongeProgram->Use();
+    m_spongeState->Apply();
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_spongePos);
     model = glm::scale(model, glm::vec3(2.0f));
-    m_spongeProgram->SetUniform("uView", view);
-    m_spongeProgram->SetUniform("uProjection", projection);
     m_spongeProgram->SetUniform("uModel", model);
     m_spongeProgram->SetUniform("uTransform", projection * view * model);
     m_spongeProgram->SetUniform("uCenter", m_spongePos);
-    m_spongeProgram->SetUniform("uViewPos", m_cameraPos);
-    m_spongeProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_spongeProgram->SetUniform("uLightPos", m_lightPos);
-    m_box->Draw(m_spongeProgram.get());
+    m_box->DrawPositions(m_spongeProgram.get());
 }
 
 
 void Context::DrawAnotherWorld(const glm::mat4& projection, const glm::mat4& view) {
-    m_textureProgram->Use();
-    auto model = glm::mat4(1.0f);
-    model = glm::translate(model, m_anotherWorldPos);
-    model = glm::scale(model, glm::vec3(2.0f));
-    model = glm::rotate(model, glm::radians(180.f), glm::vec3(0.0f, 1.0f, 0.0f));
-    m_textureProgram->SetUniform("transform", projection * view * model);
-    glActiveTexture(GL_TEXTURE0);
-    colorAttachmentAW->Bind();
-    m_textureProgram->SetUniform("tex", 0);
-    m_plane->Draw(m_textureProgram.get());
+    if (colorAttachmentAW) {
+        // the portal texture covers m_portalRect of the screen at 1:1
+        auto texelSize = 1.0f / glm::vec2(colorAttachmentAW->GetWidth(), colorAttachmentAW->GetHeight());
+        m_portalState->Apply();
+        m_portalProgram->SetUniform("transform", projection * view * GetPortalTransform());
+        m_portalProgram->SetUniform("uScreenToUV", glm::vec4(texelSize,
+            -glm::vec2(m_portalRect.x, m_portalRect.y) * texelSize));
+        GLState::ActiveTexture(GL_TEXTURE0);
+        colorAttachmentAW->Bind();
+        m_portalProgram->SetUniform("tex", 0);
+        m_plane->Draw(m_portalProgram.get());
+    }
 
-    m_simpleProgram->Use();
-    model = glm::mat4(1.0f);
+    m_simpleState->Apply();
+    auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_anotherWorldPos);
     model = glm::scale(model, glm::vec3(1.2f, 1.0f, 1.0f));
     model = glm::rotate(model, glm::radians(180.f), glm::vec3(0.0f, 1.0f, 0.0f));
     m_simpleProgram->SetUniform("transform", projection * view * model);
     m_simpleProgram->SetUniform("color", glm::vec4(1.0f, 0.8f, 0.6f, 1.0f));
-    m_pictureFrame->Draw(m_simpleProgram.get());
+    m_pictureFrame->Draw(m_simpleProgram.get(),
+        m_meshLod ? m_pictureFrame->SelectLod(projection, view * model, (float)m_height) : 0);
 }
 
 void Context::DrawKaleidoscope(const glm::mat4& projection, const glm::mat4& view) {
-    m_textureProgram->Use();
+    m_textureState->Apply();
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, m_kaleidoscopePos);
     model = glm::scale(model, glm::vec3(2.0f));
     model = glm::rotate(model, glm::radians(180.f), glm::vec3(0.0f, 1.0f, 0.0f));
     m_textureProgram->SetUniform("transform", projection * view * model);
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     colorAttachment2D->Bind();
     m_textureProgram->SetUniform("tex", 0);
     m_plane->Draw(m_textureProgram.get());
 
-    m_simpleProgram->Use();
+    m_simpleState->Apply();
     model = glm::mat4(1.0f);
     model = glm::translate(model, m_kaleidoscopePos);
     model = glm::scale(model, glm::vec3(1.2f, 1.0f, 1.0f));
     model = glm::rotate(model, glm::radians(180.f), glm::vec3(0.0f, 1.0f, 0.0f));
     m_simpleProgram->SetUniform("transform", projection * view * model);
     m_simpleProgram->SetUniform("color", glm::vec4(1.0f, 0.8f, 0.6f, 1.0f));
-    m_pictureFrame->Draw(m_simpleProgram.get());
+    m_pictureFrame->Draw(m_simpleProgram.get(),
+        m_meshLod ? m_pictureFrame->SelectLod(projection, view * model, (float)m_height) : 0);
 }
 
 void Context::DrawCloud(const glm::mat4& projection, const glm::mat4& view) {
     BindFramebuffer();
-    m_cloudProgram->Use();
-    glDepthFunc(GL_LEQUAL);
-    glActiveTexture(GL_TEXTURE0);
+    m_cloudState->Apply();
+    GLState::ActiveTexture(GL_TEXTURE0);
     BindColorAttachment();
     m_cloudProgram->SetUniform("tex", 0);
     auto model = glm::mat4(1.0f);
-    m_cloudProgram->SetUniform("uView", view);
-    m_cloudProgram->SetUniform("uProjection", projection);
     m_cloudProgram->SetUniform("uTransform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
     m_cloudProgram->SetUniform("uCenter", m_cloudPos);
-    m_cloudProgram->SetUniform("uViewPos", m_cameraPos);
-    m_cloudProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_cloudProgram->SetUniform("uLightPos", m_lightPos);
     m_cloudProgram->SetUniform("uObstaclePos", m_obstaclePos);
     m_cloudProgram->SetUniform("uObstacleOn", m_obstacleOn);
     m_plane->Draw(m_cloudProgram.get());
-    glDepthFunc(GL_LESS);
 }
 
 void Context::DrawWater(const glm::mat4& projection, const glm::mat4& view) {
     BindFramebuffer();
-    m_waterProgram->Use();
-    glDepthFunc(GL_LEQUAL);
-    glActiveTexture(GL_TEXTURE0);
+    m_waterState->Apply();
+    GLState::ActiveTexture(GL_TEXTURE0);
     BindColorAttachment();
     auto model = glm::mat4(1.0f);
-    m_waterProgram->SetUniform("uView", view);
-    m_waterProgram->SetUniform("uProjection", projection);
     m_waterProgram->SetUniform("uTransform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
     m_waterProgram->SetUniform("uCenter", m_waterPos);
-    m_waterProgram->SetUniform("uViewPos", m_cameraPos);
-    m_waterProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_waterProgram->SetUniform("uLightPos", m_lightPos);
-    m_waterProgram->SetUniform("uTime", m_time);
     m_waterProgram->SetUniform("tex", 0);
-    glActiveTexture(GL_TEXTURE1);
+    GLState::ActiveTexture(GL_TEXTURE1);
     m_hdrCubeMap->Bind();
     m_waterProgram->SetUniform("cubeTex", 1);
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_plane->Draw(m_waterProgram.get());
-    glDepthFunc(GL_LESS);
 
 }
 
@@ -422,16 +633,13 @@ void Context::BindFramebuffer() {
     if (m_level == 0) {
         m_framebuffer2->Bind();
         colorAttachment2 = m_framebuffer2->GetColorAttachment(0);
-        glViewport(0, 0, m_width, m_height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_level = 1;
     }
     else {
         Framebuffer::BindToDefault();
-        glViewport(0, 0, m_width, m_height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_level = 0;
     }
+    glViewport(0, 0, m_width, m_height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_level++;
 }
 
 void Context::BindColorAttachment() {
@@ -443,85 +651,209 @@ void Context::BindColorAttachment() {
     }
 }
 
-void Context::CalDistance() {
-    for (int i = 0; i < 8; i++) {
-        m_drawcalls[i].distance = glm::length(m_cameraPos - m_drawcalls[i].pos);
-    }
+const Context::DrawPass Context::s_drawPasses[OBJECT_TYPE_COUNT] = {
+    { "DrawBead", &Context::DrawBead },
+    { "DrawMandelbox", &Context::DrawMandelbox },
+    { "DrawMandelbulb", &Context::DrawMandelbulb },
+    { "DrawSponge", &Context::DrawSponge },
+    { "DrawAnotherWorld", &Context::DrawAnotherWorld },
+    { "DrawKaleidoscope", &Context::DrawKaleidoscope },
+    { "DrawCloud", &Context::DrawCloud },
+    { "DrawWater", &Context::DrawWater },
+};
+
+void Context::RecordDrawCalls(const glm::mat4& projection, const glm::mat4& view) {
+    TRACE_SCOPE("RecordDrawCalls");
+    m_commandBuffer->Reset();
+    // small galleries are recorded inline, bigger ones are spread over the workers
+    const size_t grainSize = 16;
+    m_threadPool->ParallelFor(m_drawcalls.size(), grainSize,
+        [&](size_t begin, size_t end, int threadIndex) {
+        for (size_t i = begin; i < end; i++) {
+            auto& drawCall = m_drawcalls[i];
+            if (!drawCall.visible)
+                continue;
+            drawCall.distance = glm::length(m_cameraPos - drawCall.pos);
+            auto key = RenderKey::Make(RENDER_PASS_GALLERY, drawCall.translucent,
+                drawCall.distance / CAMERA_FAR,
+                drawCall.program ? drawCall.program->Get() : 0, drawCall.material);
+            auto packet = m_commandBuffer->Push<DrawPacket>(threadIndex, key, &Context::SubmitDrawCall);
+            packet->context = this;
+            packet->type = drawCall.type;
+            packet->projection = projection;
+            packet->view = view;
+        }
+    });
+    m_commandBuffer->Sort();
 }
 
-void Context::SortDrawCall() {
-    std::sort(m_drawcalls, m_drawcalls + 8, [](const DrawCall& a, const DrawCall& b) {
-        return a.distance > b.distance;
-    });
+void Context::SubmitDrawCall(const void* data) {
+    auto packet = (const DrawPacket*)data;
+    auto& pass = s_drawPasses[packet->type];
+    TRACE_SCOPE(pass.name);
+    GpuProfileScope scope(packet->context->m_gpuProfiler.get(), pass.name);
+    (packet->context->*pass.draw)(packet->projection, packet->view);
 }
 
 void Context::DrawAll(const glm::mat4& projection, const glm::mat4& view) {
-    for (int i = 0; i < 8; i++) {
-        switch (m_drawcalls[i].type) {
-        case BEAD:
-            DrawBead(projection, view);
-            break;
-        case MANDELBOX:
-            DrawMandelbox(projection, view);
-            break;
-        case MANDELBULB:
-            DrawMandelbulb(projection, view);
-            break;
-        case SPONGE:
-            DrawSponge(projection, view);
-            break;
-        case WORLD:
-            DrawAnotherWorld(projection, view);
-            break;
-        case KALEIDOSCOPE:
-            DrawKaleidoscope(projection, view);
-            break;
-        case CLOUD:
-            DrawCloud(projection, view);
-            break;
-        case WATER:
-            DrawWater(projection, view);
+    RecordDrawCalls(projection, view);
+    m_level = 0;
+    m_commandBuffer->Submit();
+
+    // the image reaches the default framebuffer on the second screen pass;
+    // when cloud or water were culled it still sits in an offscreen target
+    if (m_level < 2)
+        DrawToDefault(m_level == 0 ? colorAttachment1.get() : colorAttachment2.get());
+}
+
+void Context::DrawToDefault(const Texture* texture) {
+    // the window is multisampled, so copy with a full screen quad instead of a blit
+    Framebuffer::BindToDefault();
+    glViewport(0, 0, m_width, m_height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_copyState->Apply();
+    GLState::ActiveTexture(GL_TEXTURE0);
+    texture->Bind();
+    m_textureProgram->SetUniform("tex", 0);
+    m_textureProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
+    m_plane->Draw(m_textureProgram.get());
+}
+
+// Lengyel, "Oblique View Frustum Depth Projection and Clipping":
+// replaces the near plane with clipPlane (view space, camera on its negative side)
+static glm::mat4 MakeObliqueProjection(glm::mat4 projection, const glm::vec4& clipPlane) {
+    glm::vec4 q;
+    q.x = (glm::sign(clipPlane.x) + projection[2][0]) / projection[0][0];
+    q.y = (glm::sign(clipPlane.y) + projection[2][1]) / projection[1][1];
+    q.z = -1.0f;
+    q.w = (1.0f + projection[2][2]) / projection[3][2];
+    auto c = clipPlane * (2.0f / glm::dot(clipPlane, q));
+    projection[0][2] = c.x - projection[0][3];
+    projection[1][2] = c.y - projection[1][3];
+    projection[2][2] = c.z - projection[2][3];
+    projection[3][2] = c.w - projection[3][3];
+    return projection;
+}
+
+glm::mat4 Context::GetPortalTransform() const {
+    auto model = glm::mat4(1.0f);
+    model = glm::translate(model, m_anotherWorldPos);
+    model = glm::scale(model, glm::vec3(2.0f));
+    model = glm::rotate(model, glm::radians(180.f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return model;
+}
+
+bool Context::ComputePortalRect(const glm::mat4& viewProjection, glm::ivec4& rect) const {
+    auto transform = viewProjection * GetPortalTransform();
+    const glm::vec2 corners[4] = {
+        glm::vec2(-0.5f, -0.5f), glm::vec2(0.5f, -0.5f),
+        glm::vec2(0.5f, 0.5f), glm::vec2(-0.5f, 0.5f),
+    };
+    auto ndcMin = glm::vec2(1.0f);
+    auto ndcMax = glm::vec2(-1.0f);
+    for (auto& corner: corners) {
+        auto clipPos = transform * glm::vec4(corner, 0.0f, 1.0f);
+        if (clipPos.w < 0.01f) {
+            // the quad crosses the camera plane, keep the whole screen
+            ndcMin = glm::vec2(-1.0f);
+            ndcMax = glm::vec2(1.0f);
             break;
         }
+        auto ndc = glm::vec2(clipPos) / clipPos.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
     }
+    ndcMin = glm::clamp(ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+    ndcMax = glm::clamp(ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+
+    auto screenSize = glm::vec2(m_width, m_height);
+    auto pixelMin = glm::floor((ndcMin * 0.5f + 0.5f) * screenSize);
+    auto pixelMax = glm::ceil((ndcMax * 0.5f + 0.5f) * screenSize);
+    rect = glm::ivec4(pixelMin.x, pixelMin.y, pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+    return rect.z > 0 && rect.w > 0;
 }
 
 void Context::PreRenderAnotherWorld(const glm::mat4& projection, const glm::mat4& view) {
-    auto anotherWorldCameraFront = glm::normalize(m_anotherWorldPos - m_cameraPos);
-    auto anotherWorldProjection = glm::perspective(glm::radians(45.0f),
-        (float)m_width / (float)m_height, 0.01f, 150.0f);
-    auto anotherWorldView = glm::lookAt(
-        m_anotherWorldPos,
-        m_anotherWorldPos + anotherWorldCameraFront,
-        m_cameraUp);
-    m_anotherWorldFramebuffer->Bind();
-    colorAttachmentAW = m_anotherWorldFramebuffer->GetColorAttachment(0);
-    glViewport(0, 0, m_width, m_height);
+    // only the screen rectangle under the portal is rendered, at screen resolution
+    if (!ComputePortalRect(projection * view, m_portalRect))
+        return;
+    auto framebuffer = m_renderTargetPool->Acquire(m_portalRect.z, m_portalRect.w);
+    if (!framebuffer)
+        return;
+
+    // off-axis projection: the camera frustum cropped to the portal rectangle
+    auto screenSize = glm::vec2(m_width, m_height);
+    auto ndcMin = glm::vec2(m_portalRect.x, m_portalRect.y) / screenSize * 2.0f - 1.0f;
+    auto ndcMax = glm::vec2(m_portalRect.x + m_portalRect.z,
+        m_portalRect.y + m_portalRect.w) / screenSize * 2.0f - 1.0f;
+    auto crop = glm::mat4(1.0f);
+    crop[0][0] = 2.0f / (ndcMax.x - ndcMin.x);
+    crop[1][1] = 2.0f / (ndcMax.y - ndcMin.y);
+    crop[3][0] = -(ndcMax.x + ndcMin.x) / (ndcMax.x - ndcMin.x);
+    crop[3][1] = -(ndcMax.y + ndcMin.y) / (ndcMax.y - ndcMin.y);
+    auto anotherWorldProjection = crop * projection;
+
+    // oblique near plane on the portal, so nothing in front of it is drawn
+    auto portalTransform = GetPortalTransform();
+    auto portalCenter = glm::vec3(portalTransform[3]);
+    auto portalNormal = glm::normalize(glm::vec3(portalTransform[2]));
+    if (glm::dot(portalNormal, portalCenter - m_cameraPos) < 0.0f)
+        portalNormal = -portalNormal;
+    auto portalPlane = glm::transpose(glm::inverse(view)) *
+        glm::vec4(portalNormal, -glm::dot(portalNormal, portalCenter));
+    if (portalPlane.w < -0.01f)
+        anotherWorldProjection = MakeObliqueProjection(anotherWorldProjection, portalPlane);
+
+    framebuffer->Bind();
+    colorAttachmentAW = framebuffer->GetColorAttachment(0);
+    glViewport(0, 0, m_portalRect.z, m_portalRect.w);
+    glScissor(0, 0, m_portalRect.z, m_portalRect.w);
+    GLState::SetScissorTest(true);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glDepthFunc(GL_LEQUAL);
-    m_skyboxProgram->Use();
+    m_skyboxState->Apply();
     m_skyboxProgram->SetUniform("projection", anotherWorldProjection);
-    m_skyboxProgram->SetUniform("view", anotherWorldView);
+    m_skyboxProgram->SetUniform("view", view);
     m_skyboxProgram->SetUniform("cubeMap", 0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_anotherWorldCubeMap->Bind();
-    m_box->Draw(m_skyboxProgram.get());
-    glDepthFunc(GL_LESS);
+    m_box->DrawPositions(m_skyboxProgram.get());
 
-    glActiveTexture(GL_TEXTURE0);
+    m_textureState->Apply();
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_dinoTexture->Bind();
-    auto model = glm::mat4(1.0f);
-    for (int i = 0; i < 10; i++) {
-        for (int j = 0; j < 10; j++) {
-            m_textureProgram->Use();
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-10.0f + j * 4.0f, 0.0f, 7.5f + i * 4.0f));
-            model = glm::scale(model, glm::vec3(0.5f));
-            model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_textureProgram->SetUniform("transform", anotherWorldProjection * anotherWorldView * model);
-            m_textureProgram->SetUniform("tex", 0);
-            m_dinoModel->Draw(m_textureProgram.get());
-        }
+    m_textureProgram->SetUniform("transform", anotherWorldProjection * view);
+    m_textureProgram->SetUniform("tex", 0);
+    DrawDinos(anotherWorldProjection, view);
+    GLState::SetScissorTest(false);
+}
+
+void Context::DrawDinos(const glm::mat4& projection, const glm::mat4& view) {
+    // a level per dino from its size in the portal, then the instances
+    // grouped by level with a counting sort
+    int lodCount = m_dinoModel->GetLodCount();
+    std::vector<int> lods(m_dinoTransforms.size(), 0);
+    std::vector<int> firstInstances(lodCount + 1, 0);
+    for (size_t i = 0; i < m_dinoTransforms.size(); i++) {
+        if (m_meshLod)
+            lods[i] = m_dinoModel->SelectLod(projection, view * m_dinoTransforms[i], (float)m_portalRect.w);
+        firstInstances[lods[i] + 1]++;
+    }
+    for (int lod = 0; lod < lodCount; lod++)
+        firstInstances[lod + 1] += firstInstances[lod];
+
+    // the buffer is rewritten only when a dino changes its level
+    if (lods != m_dinoLods) {
+        std::vector<glm::mat4> transforms(m_dinoTransforms.size());
+        auto fill = firstInstances;
+        for (size_t i = 0; i < m_dinoTransforms.size(); i++)
+            transforms[fill[lods[i]]++] = m_dinoTransforms[i];
+        m_dinoInstanceBuffer->SetData(transforms.data(), sizeof(glm::mat4) * transforms.size());
+        m_dinoLods = std::move(lods);
+    }
+    for (int lod = 0; lod < lodCount; lod++) {
+        m_dinoModel->DrawInstanced(m_textureProgram.get(),
+            firstInstances[lod + 1] - firstInstances[lod], lod, firstInstances[lod]);
     }
 }
 
@@ -530,26 +862,22 @@ void Context::PreRenderKaleidoscope(const glm::mat4& projection, const glm::mat4
     colorAttachment2D = m_kaleidoscopeFramebuffer->GetColorAttachment(0);
     glViewport(0, 0, m_width, m_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    m_kaleidoscopeProgram->Use();
+    m_kaleidoscopeState->Apply();
     auto model = glm::mat4(1.0f);
     m_kaleidoscopeProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
-    m_kaleidoscopeProgram->SetUniform("uResolution", glm::vec2(m_width, m_height));
-    m_kaleidoscopeProgram->SetUniform("uTime", m_time);
     m_plane->Draw(m_kaleidoscopeProgram.get());
 }
 
 void Context::DrawEnvironment(const glm::mat4& projection, const glm::mat4& view) {
     // start ground
-    m_normalProgram->Use();
-    m_normalProgram->SetUniform("viewPos", m_cameraPos);
-    m_normalProgram->SetUniform("lightPos", m_lightPos);
-    glActiveTexture(GL_TEXTURE0);
+    m_normalState->Apply();
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_groundAlbedo->Bind();
     m_normalProgram->SetUniform("diffuse", 0);
-    glActiveTexture(GL_TEXTURE1);
+    GLState::ActiveTexture(GL_TEXTURE1);
     m_groundNormal->Bind();
     m_normalProgram->SetUniform("normalMap", 1);
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     auto model = glm::mat4(1.0f);
     model = glm::scale(model, glm::vec3(30.0f));
     model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -559,7 +887,7 @@ void Context::DrawEnvironment(const glm::mat4& projection, const glm::mat4& view
     // end ground
 
     // start light
-    m_simpleProgram->Use();
+    m_simpleState->Apply();
     model = glm::mat4(1.0f);
     model = glm::translate(model, m_lightPos);
     model = glm::scale(model, glm::vec3(0.2f));
@@ -569,13 +897,12 @@ void Context::DrawEnvironment(const glm::mat4& projection, const glm::mat4& view
     // end light
 
     // start skybox
-    glDepthFunc(GL_LEQUAL);
-    m_skyboxProgram->Use();
+    m_skyboxState->Apply();
     m_skyboxProgram->SetUniform("projection", projection);
     m_skyboxProgram->SetUniform("view", view);
     m_skyboxProgram->SetUniform("cubeMap", 0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     m_hdrCubeMap->Bind();
-    m_box->Draw(m_skyboxProgram.get());
-    glDepthFunc(GL_LESS);
+    m_box->DrawPositions(m_skyboxProgram.get());
     // end skybox
 }
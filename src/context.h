@@ -10,9 +10,23 @@
 #include "mesh.h"
 #include "model.h"
 #include "framebuffer.h"
+#include "render_target_pool.h"
+#include "cubemap_cache.h"
 #include "shadow_map.h"
+#include "gpu_profiler.h"
+#include "gl_state.h"
+#include "thread_pool.h"
+#include "command_buffer.h"
+#include "frustum.h"
+#include "frame_constants.h"
 #include <algorithm>
 
+// environment maps baked into cubemaps at startup, also used by --bake-cubemaps
+const char* const CUBEMAP_CACHE_DIRECTORY = "./cache";
+const char* const SKY_HDR_FILENAME = "./image/god_rays_sky_dome_8k.hdr";
+const char* const ANOTHER_WORLD_HDR_FILENAME = "./image/dug_up_dark_soil_in_the_field_8k.hdr";
+const int HDR_CUBE_MAP_SIZE = 2048;
+
 enum ObjectType {
     BEAD,
     MANDELBOX,
@@ -21,12 +35,23 @@ enum ObjectType {
     WORLD,
     KALEIDOSCOPE,
     CLOUD,
-    WATER
+    WATER,
+    OBJECT_TYPE_COUNT
+};
+
+enum RenderPass {
+    RENDER_PASS_GALLERY
 };
 
 struct DrawCall {
     int type;
     glm::vec3 pos;
+    // bounding sphere around pos
+    float radius;
+    const Program* program { nullptr };
+    uint32_t material { 0 };
+    bool translucent { true };
+    bool visible { true };
     float distance = 0;
 };
 
@@ -40,12 +65,32 @@ public:
     void Reshape(int width, int height);
     void MouseMove(double x, double y);
     void MouseButton(int button, int action, double x, double y);
+    void SetTimeStep(float timeStep) { m_timeStep = timeStep; }
+    // level 0 of every model when off
+    void SetMeshLod(bool meshLod) { m_meshLod = meshLod; }
+    GpuProfiler* GetGpuProfiler() const { return m_gpuProfiler.get(); }
+    // bakes the equirect image on the GPU and compares the faces with
+    // EquirectConverter, true when they are within its tolerance
+    bool CheckHdrCubeMapBake(const std::string& filename, int faceSize);
 
 private:
     Context() {}
     bool Init();
+    void CreatePipelineStates();
     
     float m_time { 0.0f };
+    float m_timeStep { 0.01f };
+
+    // draw call recording
+    ThreadPoolUPtr m_threadPool;
+    CommandBufferUPtr m_commandBuffer;
+    CullingSetUPtr m_cullingSet;
+    std::vector<uint8_t> m_cullingResult;
+    int m_visibleCount { 0 };
+
+    // profiler
+    GpuProfilerUPtr m_gpuProfiler;
+    bool m_showProfiler { true };
 
     // shader
     ProgramUPtr m_simpleProgram;                    // simple shader
@@ -61,15 +106,38 @@ private:
     ProgramUPtr m_spongeProgram;                    // menger sponge shader
     ProgramUPtr m_kaleidoscopeProgram;              // kaleidoscope shader
     ProgramUPtr m_waterProgram;                     // water shader
+    ProgramUPtr m_portalProgram;                    // portal shader
+
+    // pipeline state
+    PipelineStateUPtr m_simpleState;
+    PipelineStateUPtr m_textureState;
+    PipelineStateUPtr m_copyState;
+    PipelineStateUPtr m_normalState;
+    PipelineStateUPtr m_sphericalMapState;
+    PipelineStateUPtr m_skyboxState;
+    PipelineStateUPtr m_beadState;
+    PipelineStateUPtr m_cloudState;
+    PipelineStateUPtr m_mandelboxState;
+    PipelineStateUPtr m_mandelbulbState;
+    PipelineStateUPtr m_spongeState;
+    PipelineStateUPtr m_kaleidoscopeState;
+    PipelineStateUPtr m_waterState;
+    PipelineStateUPtr m_portalState;
+
+    // per-frame constants shared by every program
+    FrameConstants m_frameConstants;
+    BufferUPtr m_frameConstantsBuffer;
 
     // texture
     TextureUPtr m_groundAlbedo;
     TextureUPtr m_groundNormal;
-    TextureUPtr m_hdrMap;
-    TextureUPtr m_anotherWorldHdrMap;
     TextureUPtr m_dinoTexture;
     CubeTexturePtr m_hdrCubeMap;
     CubeTexturePtr m_anotherWorldCubeMap;
+    // baked environment cubemaps, keyed by the source .hdr contents
+    CubemapCacheUPtr m_cubemapCache;
+    // pixel unpack ring for streamed texture uploads
+    UploadStreamUPtr m_uploadStream;
     
     TexturePtr colorAttachment1;
     TexturePtr colorAttachment2;
@@ -82,7 +150,14 @@ private:
     MeshUPtr m_plane;
     MeshUPtr m_sphere;
     ModelUPtr m_dinoModel;
+    BufferPtr m_dinoInstanceBuffer;
+    int m_dinoInstanceCount { 0 };
+    std::vector<glm::mat4> m_dinoTransforms;
+    // level of detail of each dino when the instance buffer was sorted
+    std::vector<int> m_dinoLods;
     ModelUPtr m_pictureFrame;
+    // levels of detail picked by projected size
+    bool m_meshLod { true };
 
 
     //framebuffer
@@ -90,7 +165,7 @@ private:
     FramebufferUPtr m_framebuffer2;
 
     FramebufferUPtr m_testFramebuffer;
-    FramebufferUPtr m_anotherWorldFramebuffer;
+    RenderTargetPoolUPtr m_renderTargetPool;
     FramebufferUPtr m_kaleidoscopeFramebuffer;
 
     // screen size
@@ -131,6 +206,8 @@ private:
 
         // another world
     glm::vec3 m_anotherWorldPos { 0.0f, 1.7f, 7.5f };
+    // screen rectangle (x, y, width, height) the portal was rendered for
+    glm::ivec4 m_portalRect { 0 };
 
         // 2d shader - kaleidoscope
     glm::vec3 m_kaleidoscopePos { -7.5f, 1.7f, 7.5f };
@@ -138,7 +215,18 @@ private:
         // water block
     glm::vec3 m_waterPos { 7.5f, 1.7f, 7.5f };
 
+    // cooked texture from COOKED_TEXTURE_DIRECTORY when it is up to date, else the source image
+    TextureUPtr LoadTexture(const std::string& filename);
+    // cubemap baked from an equirectangular .hdr, read from the cache when possible
+    CubeTexturePtr LoadHdrCubeMap(const std::string& filename, int faceSize);
+    CubeTexturePtr BakeHdrCubeMap(const Texture* equirect, int faceSize);
+
+    void UpdateFrameConstants(const glm::mat4& projection, const glm::mat4& view);
     void PreRenderAnotherWorld(const glm::mat4& projection, const glm::mat4& view);
+    glm::mat4 GetPortalTransform() const;
+    bool ComputePortalRect(const glm::mat4& viewProjection, glm::ivec4& rect) const;
+    // the dino field with the programs of PreRenderAnotherWorld
+    void DrawDinos(const glm::mat4& projection, const glm::mat4& view);
     void PreRenderKaleidoscope(const glm::mat4& projection, const glm::mat4& view);
 
     // 배경 그리기
@@ -154,11 +242,21 @@ private:
     void DrawWater(const glm::mat4& projection, const glm::mat4& view);
 
     void BindFramebuffer();
+    void DrawToDefault(const Texture* texture);
     void BindColorAttachment();
 
-    DrawCall m_drawcalls[8];
-    void CalDistance();
-    void SortDrawCall();
+    using DrawFunc = void (Context::*)(const glm::mat4& projection, const glm::mat4& view);
+    struct DrawPass {
+        const char* name;
+        DrawFunc draw;
+    };
+    static const DrawPass s_drawPasses[OBJECT_TYPE_COUNT];
+
+    std::vector<DrawCall> m_drawcalls;
+    void CullDrawCalls(const glm::mat4& projection, const glm::mat4& view);
+    bool IsVisible(int type) const;
+    void RecordDrawCalls(const glm::mat4& projection, const glm::mat4& view);
+    static void SubmitDrawCall(const void* data);
     void DrawAll(const glm::mat4& projection, const glm::mat4& view);
     int m_level {0};
 
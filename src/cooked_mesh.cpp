@@ -0,0 +1,252 @@
+#include "cooked_mesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char COOKED_MAGIC[4] = { 'S', 'P', 'M', 'S' };
+// 2: indices and vertices reordered by MeshOptimizer
+// 3: levels of detail, indices of every level back to back
+// 4: angle weighted tangents with the bitangent sign in tangent.w
+// 5: source size and last write time
+const uint32_t COOKED_VERSION = 5;
+const size_t COOKED_ALIGNMENT = 64;
+const size_t MATERIAL_PATH_SIZE = 256;
+
+struct CookedHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t vertexStride;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct MaterialEntry {
+    char diffuse[MATERIAL_PATH_SIZE];
+    char specular[MATERIAL_PATH_SIZE];
+};
+
+size_t AlignUp(size_t value) {
+    return (value + COOKED_ALIGNMENT - 1) & ~(COOKED_ALIGNMENT - 1);
+}
+
+bool ReadHeader(const uint8_t* data, size_t size, CookedHeader& header) {
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, COOKED_MAGIC, 4) == 0 &&
+        header.version == COOKED_VERSION &&
+        header.vertexStride == sizeof(Vertex);
+}
+
+} // namespace
+
+CookedMeshUPtr CookedMesh::Load(const std::string& filename) {
+    auto mesh = CookedMeshUPtr(new CookedMesh());
+    if (!mesh->Parse(filename))
+        return nullptr;
+    return std::move(mesh);
+}
+
+bool CookedMesh::IsUpToDate(const std::string& filename, const std::string& sourceFilename) {
+    CookedHeader header;
+    {
+        std::ifstream fin(filename, std::ios::binary);
+        uint8_t data[sizeof(CookedHeader)];
+        if (!fin.read((char*)data, sizeof(data)) || !ReadHeader(data, sizeof(data), header))
+            return false;
+    }
+    FileStamp stamp { header.sourceSize, header.sourceTime };
+    if (!IsFileUnchanged(sourceFilename, header.sourceHash, stamp))
+        return false;
+    if (stamp.size != header.sourceSize || stamp.time != header.sourceTime) {
+        // touched but unchanged, the new stamp spares the hash next time
+        header.sourceSize = stamp.size;
+        header.sourceTime = stamp.time;
+        std::fstream fout(filename, std::ios::binary | std::ios::in | std::ios::out);
+        fout.write((const char*)&header, sizeof(header));
+    }
+    return true;
+}
+
+std::string CookedMesh::GetCookedFilename(const std::string& directory, const std::string& sourceFilename) {
+    return fmt::format("{}/{}.mesh", directory, GetCacheStem(sourceFilename));
+}
+
+bool CookedMesh::Parse(const std::string& filename) {
+    m_file = MappedFile::Open(filename);
+    if (!m_file)
+        return false;
+    auto data = m_file->GetData();
+    auto size = m_file->GetSize();
+
+    CookedHeader header;
+    if (!ReadHeader(data, size, header)) {
+        SPDLOG_WARN("stale mesh cache: {}", filename);
+        return false;
+    }
+    m_boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    m_boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+    size_t meshTableSize = sizeof(MeshEntry) * header.meshCount;
+    size_t materialTableSize = sizeof(MaterialEntry) * header.materialCount;
+    if (size < sizeof(header) + meshTableSize + materialTableSize) {
+        SPDLOG_WARN("corrupted mesh cache: {}", filename);
+        return false;
+    }
+    m_meshes.resize(header.meshCount);
+    memcpy(m_meshes.data(), data + sizeof(header), meshTableSize);
+
+    auto materials = (const MaterialEntry*)(data + sizeof(header) + meshTableSize);
+    m_materials.resize(header.materialCount);
+    for (uint32_t i = 0; i < header.materialCount; i++) {
+        MaterialEntry entry;
+        memcpy(&entry, materials + i, sizeof(entry));
+        entry.diffuse[MATERIAL_PATH_SIZE - 1] = 0;
+        entry.specular[MATERIAL_PATH_SIZE - 1] = 0;
+        m_materials[i].diffuse = entry.diffuse;
+        m_materials[i].specular = entry.specular;
+    }
+
+    for (auto& mesh: m_meshes) {
+        if (mesh.vertexOffset + (uint64_t)mesh.vertexCount * sizeof(Vertex) > size ||
+            mesh.indexOffset + (uint64_t)mesh.indexCount * sizeof(uint32_t) > size ||
+            mesh.materialIndex >= (int32_t)header.materialCount ||
+            mesh.lodCount == 0 || mesh.lodCount > MAX_MESH_LOD_COUNT ||
+            std::any_of(mesh.lods, mesh.lods + mesh.lodCount, [&](const MeshLod& lod) {
+                return (uint64_t)lod.firstIndex + lod.indexCount > mesh.indexCount;
+            })) {
+            SPDLOG_WARN("corrupted mesh cache: {}", filename);
+            return false;
+        }
+        auto indices = (const uint32_t*)(data + mesh.indexOffset);
+        if (std::any_of(indices, indices + mesh.indexCount,
+            [&](uint32_t index) { return index >= mesh.vertexCount; })) {
+            SPDLOG_WARN("corrupted mesh cache: {}", filename);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CookedMesh::Write(const std::string& filename, const std::string& sourceFilename,
+    const std::vector<CookedMeshData>& meshes, const std::vector<CookedMaterial>& materials) {
+    auto sourceStamp = GetFileStamp(sourceFilename);
+    auto sourceHash = HashFile(sourceFilename);
+    if (!sourceStamp || !sourceHash) {
+        SPDLOG_ERROR("failed to read: {}", sourceFilename);
+        return false;
+    }
+
+    CookedHeader header;
+    memcpy(header.magic, COOKED_MAGIC, 4);
+    header.version = COOKED_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceStamp->size;
+    header.sourceTime = sourceStamp->time;
+    header.vertexStride = sizeof(Vertex);
+    header.meshCount = (uint32_t)meshes.size();
+    header.materialCount = (uint32_t)materials.size();
+
+    glm::vec3 modelMin(FLT_MAX);
+    glm::vec3 modelMax(-FLT_MAX);
+    std::vector<MeshEntry> meshTable(meshes.size());
+    size_t offset = AlignUp(sizeof(header) + sizeof(MeshEntry) * meshTable.size() +
+        sizeof(MaterialEntry) * materials.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        auto& mesh = meshes[i];
+        auto& entry = meshTable[i];
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        for (auto& vertex: mesh.vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+        if (mesh.vertices.empty())
+            boundsMin = boundsMax = glm::vec3(0.0f);
+        modelMin = glm::min(modelMin, boundsMin);
+        modelMax = glm::max(modelMax, boundsMax);
+        memcpy(entry.boundsMin, glm::value_ptr(boundsMin), sizeof(entry.boundsMin));
+        memcpy(entry.boundsMax, glm::value_ptr(boundsMax), sizeof(entry.boundsMax));
+
+        entry.vertexCount = (uint32_t)mesh.vertices.size();
+        entry.indexCount = (uint32_t)mesh.indices.size();
+        entry.materialIndex = mesh.materialIndex;
+        memset(entry.lods, 0, sizeof(entry.lods));
+        if (mesh.lods.empty()) {
+            entry.lodCount = 1;
+            entry.lods[0] = MeshLod { 0, entry.indexCount, 0.0f };
+        }
+        else {
+            entry.lodCount = (uint32_t)std::min<size_t>(mesh.lods.size(), MAX_MESH_LOD_COUNT);
+            memcpy(entry.lods, mesh.lods.data(), sizeof(MeshLod) * entry.lodCount);
+        }
+        entry.vertexOffset = offset;
+        offset = AlignUp(offset + sizeof(Vertex) * mesh.vertices.size());
+        entry.indexOffset = offset;
+        offset = AlignUp(offset + sizeof(uint32_t) * mesh.indices.size());
+    }
+    if (meshes.empty())
+        modelMin = modelMax = glm::vec3(0.0f);
+    memcpy(header.boundsMin, glm::value_ptr(modelMin), sizeof(header.boundsMin));
+    memcpy(header.boundsMax, glm::value_ptr(modelMax), sizeof(header.boundsMax));
+
+    std::vector<MaterialEntry> materialTable(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        if (materials[i].diffuse.size() >= MATERIAL_PATH_SIZE ||
+            materials[i].specular.size() >= MATERIAL_PATH_SIZE) {
+            SPDLOG_ERROR("material texture path too long for the mesh cache");
+            return false;
+        }
+        memset(&materialTable[i], 0, sizeof(MaterialEntry));
+        memcpy(materialTable[i].diffuse, materials[i].diffuse.c_str(), materials[i].diffuse.size());
+        memcpy(materialTable[i].specular, materials[i].specular.c_str(), materials[i].specular.size());
+    }
+
+    std::error_code error;
+    auto directory = std::filesystem::path(filename).parent_path();
+    if (!directory.empty())
+        std::filesystem::create_directories(directory, error);
+
+    // written next to the target and renamed, so readers never see a partial file
+    auto tempFilename = filename + ".tmp";
+    std::ofstream fout(tempFilename, std::ios::binary);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", tempFilename);
+        return false;
+    }
+    fout.write((const char*)&header, sizeof(header));
+    fout.write((const char*)meshTable.data(), sizeof(MeshEntry) * meshTable.size());
+    fout.write((const char*)materialTable.data(), sizeof(MaterialEntry) * materialTable.size());
+    const char padding[COOKED_ALIGNMENT] = {};
+    auto writeAligned = [&](uint64_t offset, const void* data, size_t size) {
+        size_t position = (size_t)fout.tellp();
+        fout.write(padding, offset - position);
+        fout.write((const char*)data, size);
+    };
+    for (size_t i = 0; i < meshes.size(); i++) {
+        writeAligned(meshTable[i].vertexOffset, meshes[i].vertices.data(), sizeof(Vertex) * meshes[i].vertices.size());
+        writeAligned(meshTable[i].indexOffset, meshes[i].indices.data(), sizeof(uint32_t) * meshes[i].indices.size());
+    }
+    fout.close();
+
+    if (!fout) {
+        SPDLOG_ERROR("failed to write mesh cache: {}", tempFilename);
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+    std::filesystem::rename(tempFilename, filename, error);
+    if (error) {
+        SPDLOG_ERROR("failed to write mesh cache: {} ({})", filename, error.message());
+        return false;
+    }
+    SPDLOG_INFO("mesh cache stored: {}", filename);
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef __COOKED_MESH_H__
+#define __COOKED_MESH_H__
+
+#include "common.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include <vector>
+
+// cooked meshes are written next to the baked cubemaps on the first load
+const char* const MESH_CACHE_DIRECTORY = "./cache";
+
+struct CookedMeshData {
+    std::vector<Vertex> vertices;   // tangents included
+    std::vector<uint32_t> indices;  // every level of detail back to back
+    int materialIndex { -1 };
+    // empty for a single level over every index
+    std::vector<MeshLod> lods;
+};
+
+// texture paths relative to the source model, empty when unused
+struct CookedMaterial {
+    std::string diffuse;
+    std::string specular;
+};
+
+// Triangle meshes of a model imported once and stored in a binary file:
+// a fixed header, a table of meshes with their bounds, the materials,
+// then the vertex and index data of every mesh (64-byte aligned),
+// read through a memory mapping and uploaded to the GL buffers as is.
+// The size, last write time and hash of the source file are stored to
+// detect a stale cache.
+CLASS_PTR(CookedMesh)
+class CookedMesh {
+public:
+    static CookedMeshUPtr Load(const std::string& filename);
+    // records the size, last write time and hash of the source
+    static bool Write(const std::string& filename, const std::string& sourceFilename,
+        const std::vector<CookedMeshData>& meshes, const std::vector<CookedMaterial>& materials);
+    // the cooked file is valid and its source unchanged, reading only the
+    // header unless the source was touched
+    static bool IsUpToDate(const std::string& filename, const std::string& sourceFilename);
+    // {directory}/{source file stem}_{source path hash}.mesh
+    static std::string GetCookedFilename(const std::string& directory, const std::string& sourceFilename);
+
+    const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+
+    int GetMeshCount() const { return (int)m_meshes.size(); }
+    const Vertex* GetVertices(int mesh) const { return (const Vertex*)(m_file->GetData() + m_meshes[mesh].vertexOffset); }
+    uint32_t GetVertexCount(int mesh) const { return m_meshes[mesh].vertexCount; }
+    const uint32_t* GetIndices(int mesh) const { return (const uint32_t*)(m_file->GetData() + m_meshes[mesh].indexOffset); }
+    uint32_t GetIndexCount(int mesh) const { return m_meshes[mesh].indexCount; }
+    int GetMaterialIndex(int mesh) const { return m_meshes[mesh].materialIndex; }
+    int GetLodCount(int mesh) const { return (int)m_meshes[mesh].lodCount; }
+    const MeshLod* GetLods(int mesh) const { return m_meshes[mesh].lods; }
+    glm::vec3 GetBoundsMin(int mesh) const { return glm::vec3(m_meshes[mesh].boundsMin[0], m_meshes[mesh].boundsMin[1], m_meshes[mesh].boundsMin[2]); }
+    glm::vec3 GetBoundsMax(int mesh) const { return glm::vec3(m_meshes[mesh].boundsMax[0], m_meshes[mesh].boundsMax[1], m_meshes[mesh].boundsMax[2]); }
+
+    int GetMaterialCount() const { return (int)m_materials.size(); }
+    const CookedMaterial& GetMaterial(int index) const { return m_materials[index]; }
+
+private:
+    struct MeshEntry {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        int32_t materialIndex;
+        float boundsMin[3];
+        float boundsMax[3];
+        uint32_t lodCount;
+        MeshLod lods[MAX_MESH_LOD_COUNT];
+    };
+
+    CookedMesh() {}
+    bool Parse(const std::string& filename);
+
+    MappedFileUPtr m_file;
+    glm::vec3 m_boundsMin { 0.0f };
+    glm::vec3 m_boundsMax { 0.0f };
+    std::vector<MeshEntry> m_meshes;
+    std::vector<CookedMaterial> m_materials;
+};
+
+#endif // __COOKED_MESH_H__
@@ -0,0 +1,183 @@
+#include "cooked_texture.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char COOKED_MAGIC[4] = { 'S', 'P', 'T', 'X' };
+// 2: mips filtered by MipGenerator instead of a 2x2 box
+// 3: source size and last write time
+const uint32_t COOKED_VERSION = 3;
+const size_t COOKED_ALIGNMENT = 64;
+const uint32_t COOKED_FLAG_SRGB = 1 << 0;
+
+struct CookedHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t format;        // TextureCodecFormat
+    uint32_t internalFormat;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+};
+
+size_t AlignUp(size_t value) {
+    return (value + COOKED_ALIGNMENT - 1) & ~(COOKED_ALIGNMENT - 1);
+}
+
+bool ReadHeader(const uint8_t* data, size_t size, CookedHeader& header) {
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, COOKED_MAGIC, 4) == 0 &&
+        header.version == COOKED_VERSION &&
+        header.format <= TEXTURE_CODEC_BC7 &&
+        header.width > 0 && header.height > 0 &&
+        header.levelCount > 0 && header.levelCount <= 16;
+}
+
+} // namespace
+
+CookedTextureUPtr CookedTexture::Load(const std::string& filename) {
+    auto texture = CookedTextureUPtr(new CookedTexture());
+    if (!texture->Parse(filename))
+        return nullptr;
+    return std::move(texture);
+}
+
+bool CookedTexture::IsUpToDate(const std::string& filename, const std::string& sourceFilename) {
+    CookedHeader header;
+    {
+        std::ifstream fin(filename, std::ios::binary);
+        uint8_t data[sizeof(CookedHeader)];
+        if (!fin.read((char*)data, sizeof(data)) || !ReadHeader(data, sizeof(data), header))
+            return false;
+    }
+    FileStamp stamp { header.sourceSize, header.sourceTime };
+    if (!IsFileUnchanged(sourceFilename, header.sourceHash, stamp))
+        return false;
+    if (stamp.size != header.sourceSize || stamp.time != header.sourceTime) {
+        // touched but unchanged, the new stamp spares the hash next time
+        header.sourceSize = stamp.size;
+        header.sourceTime = stamp.time;
+        std::fstream fout(filename, std::ios::binary | std::ios::in | std::ios::out);
+        fout.write((const char*)&header, sizeof(header));
+    }
+    return true;
+}
+
+std::string CookedTexture::GetCookedFilename(const std::string& directory,
+    const std::string& sourceFilename) {
+    return fmt::format("{}/{}.tex", directory, GetCacheStem(sourceFilename));
+}
+
+bool CookedTexture::Parse(const std::string& filename) {
+    m_file = MappedFile::Open(filename);
+    if (!m_file)
+        return false;
+    auto data = m_file->GetData();
+    auto size = m_file->GetSize();
+
+    CookedHeader header;
+    if (!ReadHeader(data, size, header)) {
+        SPDLOG_WARN("invalid cooked texture: {}", filename);
+        return false;
+    }
+    m_format = (TextureCodecFormat)header.format;
+    m_srgb = (header.flags & COOKED_FLAG_SRGB) != 0;
+    m_width = (int)header.width;
+    m_height = (int)header.height;
+    if (header.internalFormat != GetInternalFormat()) {
+        SPDLOG_WARN("invalid cooked texture: {}", filename);
+        return false;
+    }
+
+    m_levels.resize(header.levelCount);
+    size_t tableSize = sizeof(Level) * m_levels.size();
+    if (size < sizeof(header) + tableSize)
+        return false;
+    memcpy(m_levels.data(), data + sizeof(header), tableSize);
+    for (int level = 0; level < GetLevelCount(); level++) {
+        auto levelSize = TextureCodec::GetLevelSize(m_format, GetLevelWidth(level), GetLevelHeight(level));
+        if (m_levels[level].size != levelSize || m_levels[level].offset + levelSize > size) {
+            SPDLOG_WARN("corrupted cooked texture: {}", filename);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CookedTexture::Write(const std::string& filename, TextureCodecFormat format, bool srgb,
+    const std::string& sourceFilename, const std::vector<CookedTextureLevel>& levels) {
+    if (levels.empty() || levels.size() > 16)
+        return false;
+    auto sourceStamp = GetFileStamp(sourceFilename);
+    auto sourceHash = HashFile(sourceFilename);
+    if (!sourceStamp || !sourceHash) {
+        SPDLOG_ERROR("failed to read: {}", sourceFilename);
+        return false;
+    }
+
+    CookedHeader header;
+    memcpy(header.magic, COOKED_MAGIC, 4);
+    header.version = COOKED_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceStamp->size;
+    header.sourceTime = sourceStamp->time;
+    header.format = (uint32_t)format;
+    header.internalFormat = TextureCodec::GetInternalFormat(format, srgb);
+    header.flags = srgb ? COOKED_FLAG_SRGB : 0;
+    header.width = (uint32_t)levels[0].width;
+    header.height = (uint32_t)levels[0].height;
+    header.levelCount = (uint32_t)levels.size();
+
+    std::vector<Level> table(levels.size());
+    size_t offset = AlignUp(sizeof(header) + sizeof(Level) * table.size());
+    for (size_t level = 0; level < levels.size(); level++) {
+        int width = std::max(levels[0].width >> level, 1);
+        int height = std::max(levels[0].height >> level, 1);
+        if (levels[level].width != width || levels[level].height != height ||
+            levels[level].data.size() != TextureCodec::GetLevelSize(format, width, height)) {
+            SPDLOG_ERROR("mip level {} does not match the texture size", level);
+            return false;
+        }
+        table[level].offset = offset;
+        table[level].size = levels[level].data.size();
+        offset = AlignUp(offset + table[level].size);
+    }
+
+    // written next to the target and renamed, so readers never see a partial file
+    auto tempFilename = filename + ".tmp";
+    std::ofstream fout(tempFilename, std::ios::binary);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", tempFilename);
+        return false;
+    }
+    fout.write((const char*)&header, sizeof(header));
+    fout.write((const char*)table.data(), sizeof(Level) * table.size());
+    const char padding[COOKED_ALIGNMENT] = {};
+    for (size_t level = 0; level < levels.size(); level++) {
+        size_t position = (size_t)fout.tellp();
+        fout.write(padding, table[level].offset - position);
+        fout.write((const char*)levels[level].data.data(), levels[level].data.size());
+    }
+    fout.close();
+
+    std::error_code error;
+    if (!fout) {
+        SPDLOG_ERROR("failed to write cooked texture: {}", tempFilename);
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+    std::filesystem::rename(tempFilename, filename, error);
+    if (error) {
+        SPDLOG_ERROR("failed to write cooked texture: {} ({})", filename, error.message());
+        return false;
+    }
+    return true;
+}
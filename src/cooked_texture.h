@@ -0,0 +1,63 @@
+#ifndef __COOKED_TEXTURE_H__
+#define __COOKED_TEXTURE_H__
+
+#include "common.h"
+#include "mapped_file.h"
+#include "texture_codec.h"
+#include <vector>
+
+// where texture_cook writes the cooked assets and the renderer looks for them
+const char* const COOKED_TEXTURE_DIRECTORY = "./cooked";
+
+struct CookedTextureLevel {
+    int width { 0 };
+    int height { 0 };
+    std::vector<uint8_t> data;
+};
+
+// Texture written by the cook tool with its whole mip chain already encoded.
+// The file is a fixed header, a table of mip levels and the level data
+// (64-byte aligned), read through a memory mapping and uploaded as is.
+// Needs no GL context, so the cook tool links it without the renderer.
+CLASS_PTR(CookedTexture)
+class CookedTexture {
+public:
+    static CookedTextureUPtr Load(const std::string& filename);
+    // records the size, last write time and hash of the source
+    static bool Write(const std::string& filename, TextureCodecFormat format, bool srgb,
+        const std::string& sourceFilename, const std::vector<CookedTextureLevel>& levels);
+    // the cooked file is valid and its source unchanged, reading only the
+    // header unless the source was touched
+    static bool IsUpToDate(const std::string& filename, const std::string& sourceFilename);
+    // {directory}/{source file stem}_{source path hash}.tex
+    static std::string GetCookedFilename(const std::string& directory, const std::string& sourceFilename);
+
+    TextureCodecFormat GetFormat() const { return m_format; }
+    bool IsSrgb() const { return m_srgb; }
+    uint32_t GetInternalFormat() const { return TextureCodec::GetInternalFormat(m_format, m_srgb); }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    int GetLevelCount() const { return (int)m_levels.size(); }
+    int GetLevelWidth(int level) const { return std::max(m_width >> level, 1); }
+    int GetLevelHeight(int level) const { return std::max(m_height >> level, 1); }
+    const uint8_t* GetLevelData(int level) const { return m_file->GetData() + m_levels[level].offset; }
+    size_t GetLevelSize(int level) const { return (size_t)m_levels[level].size; }
+
+private:
+    struct Level {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    CookedTexture() {}
+    bool Parse(const std::string& filename);
+
+    MappedFileUPtr m_file;
+    TextureCodecFormat m_format { TEXTURE_CODEC_RGBA8 };
+    bool m_srgb { false };
+    int m_width { 0 };
+    int m_height { 0 };
+    std::vector<Level> m_levels;
+};
+
+#endif // __COOKED_TEXTURE_H__
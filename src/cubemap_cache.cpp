@@ -0,0 +1,265 @@
+#include "cubemap_cache.h"
+#include "pixel_convert.h"
+#include "trace.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+const char CACHE_MAGIC[4] = { 'S', 'P', 'C', 'B' };
+// 2: source size and last write time, file named by the source path
+const uint32_t CACHE_VERSION = 2;
+const size_t CACHE_ALIGNMENT = 64;
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t faceSize;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    uint32_t bytePerPixel;
+    uint32_t mipLevelCount;
+};
+
+struct CacheLevel {
+    uint64_t offset;        // first face, the others follow
+    uint64_t faceByteSize;
+};
+
+// client side format the faces are stored in, matching the internal format
+bool GetTransferFormat(uint32_t internalFormat, uint32_t& format, uint32_t& type, uint32_t& bytePerPixel) {
+    switch (internalFormat) {
+        case GL_RGB16F: format = GL_RGB; type = GL_HALF_FLOAT; bytePerPixel = 6; return true;
+        case GL_RGBA16F: format = GL_RGBA; type = GL_HALF_FLOAT; bytePerPixel = 8; return true;
+        case GL_RGB32F: format = GL_RGB; type = GL_FLOAT; bytePerPixel = 12; return true;
+        case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; bytePerPixel = 16; return true;
+        case GL_R11F_G11F_B10F: format = GL_RGB; type = GL_UNSIGNED_INT_10F_11F_11F_REV; bytePerPixel = 4; return true;
+        case GL_RGB9_E5: format = GL_RGB; type = GL_UNSIGNED_INT_5_9_9_9_REV; bytePerPixel = 4; return true;
+        case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; bytePerPixel = 4; return true;
+        default: return false;
+    }
+}
+
+size_t AlignUp(size_t value) {
+    return (value + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+}
+
+} // namespace
+
+CubemapCacheUPtr CubemapCache::Create(const std::string& directory) {
+    auto cache = CubemapCacheUPtr(new CubemapCache());
+    cache->m_directory = directory;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        SPDLOG_ERROR("failed to create cache directory: {} ({})", directory, error.message());
+        return nullptr;
+    }
+    return std::move(cache);
+}
+
+std::string CubemapCache::GetFilename(const CubemapCacheKey& key) const {
+    return fmt::format("{}/{}_{}_{:04x}.cubemap", m_directory,
+        GetCacheStem(key.source), key.faceSize, key.internalFormat);
+}
+
+MappedFileUPtr CubemapCache::Open(const CubemapCacheKey& key) const {
+    uint32_t format, type, bytePerPixel;
+    if (!GetTransferFormat(key.internalFormat, format, type, bytePerPixel))
+        return nullptr;
+    auto filename = GetFilename(key);
+    CacheHeader header;
+    {
+        std::ifstream fin(filename, std::ios::binary);
+        if (!fin.read((char*)&header, sizeof(header)))
+            return nullptr;
+    }
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.faceSize != (uint32_t)key.faceSize ||
+        header.internalFormat != key.internalFormat ||
+        header.format != format || header.type != type ||
+        header.mipLevelCount == 0 || header.mipLevelCount > 16) {
+        SPDLOG_WARN("stale cubemap cache: {}", filename);
+        return nullptr;
+    }
+
+    FileStamp stamp { header.sourceSize, header.sourceTime };
+    if (!IsFileUnchanged(key.source, header.sourceHash, stamp)) {
+        SPDLOG_WARN("stale cubemap cache: {}", filename);
+        return nullptr;
+    }
+    if (stamp.size != header.sourceSize || stamp.time != header.sourceTime) {
+        // touched but unchanged, the new stamp spares the hash next time
+        header.sourceSize = stamp.size;
+        header.sourceTime = stamp.time;
+        std::fstream fout(filename, std::ios::binary | std::ios::in | std::ios::out);
+        fout.write((const char*)&header, sizeof(header));
+    }
+    return MappedFile::Open(filename);
+}
+
+CubeTextureUPtr CubemapCache::Load(const CubemapCacheKey& key) const {
+    TRACE_SCOPE("CubemapCache::Load");
+    uint32_t format, type, bytePerPixel;
+    if (!GetTransferFormat(key.internalFormat, format, type, bytePerPixel))
+        return nullptr;
+    auto file = Open(key);
+    if (!file)
+        return nullptr;
+
+    auto filename = GetFilename(key);
+    auto data = file->GetData();
+    auto size = file->GetSize();
+    CacheHeader header;
+    if (size < sizeof(header))
+        return nullptr;
+    memcpy(&header, data, sizeof(header));
+
+    std::vector<CacheLevel> levels(header.mipLevelCount);
+    size_t tableSize = sizeof(CacheLevel) * levels.size();
+    if (size < sizeof(header) + tableSize)
+        return nullptr;
+    memcpy(levels.data(), data + sizeof(header), tableSize);
+    for (uint32_t level = 0; level < header.mipLevelCount; level++) {
+        size_t levelSize = (size_t)std::max(key.faceSize >> level, 1);
+        if (levels[level].faceByteSize != levelSize * levelSize * bytePerPixel ||
+            levels[level].offset + levels[level].faceByteSize * 6 > size) {
+            SPDLOG_WARN("corrupted cubemap cache: {}", filename);
+            return nullptr;
+        }
+    }
+
+    auto texture = CubeTexture::Create(key.faceSize, key.faceSize, key.internalFormat, type);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (uint32_t level = 0; level < header.mipLevelCount; level++) {
+        for (int face = 0; face < 6; face++) {
+            auto faceData = data + levels[level].offset + levels[level].faceByteSize * face;
+            texture->SetFaceData(face, level, format, type, faceData);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    SPDLOG_INFO("cubemap cache hit: {}", filename);
+    return std::move(texture);
+}
+
+bool CubemapCache::Store(const CubemapCacheKey& key, const CubeTexture* texture) const {
+    TRACE_SCOPE("CubemapCache::Store");
+    uint32_t format, type, bytePerPixel;
+    if (!GetTransferFormat(key.internalFormat, format, type, bytePerPixel))
+        return false;
+    texture->Bind();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    bool result = Write(key, texture->GetMipLevelCount(), [&](int level, int face, uint8_t* dst) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, format, type, dst);
+    });
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return result;
+}
+
+bool CubemapCache::Store(const CubemapCacheKey& key, const std::vector<ImageUPtr>& faces) const {
+    TRACE_SCOPE("CubemapCache::Store");
+    uint32_t format, type, bytePerPixel;
+    if (faces.size() != 6 || !GetTransferFormat(key.internalFormat, format, type, bytePerPixel))
+        return false;
+    for (auto& face: faces) {
+        if (face->GetWidth() != key.faceSize || face->GetHeight() != key.faceSize ||
+            face->GetChannelCount() != 3 || face->GetBytePerChannel() != 4) {
+            SPDLOG_ERROR("cubemap faces must be {0}x{0} RGB float images", key.faceSize);
+            return false;
+        }
+    }
+    if (format != GL_RGB || (type != GL_HALF_FLOAT && type != GL_FLOAT)) {
+        SPDLOG_ERROR("unsupported cubemap cache format for CPU faces: {:04x}", key.internalFormat);
+        return false;
+    }
+    return Write(key, 1, [&](int, int face, uint8_t* dst) {
+        auto src = (const float*)faces[face]->GetData();
+        size_t count = (size_t)key.faceSize * key.faceSize * 3;
+        if (type == GL_HALF_FLOAT)
+            ConvertFloatToHalf(src, (uint16_t*)dst, count);
+        else
+            memcpy(dst, src, count * sizeof(float));
+    });
+}
+
+bool CubemapCache::Write(const CubemapCacheKey& key, int mipLevelCount,
+    const std::function<void(int level, int face, uint8_t* dst)>& fillFace) const {
+    uint32_t format, type, bytePerPixel;
+    if (!GetTransferFormat(key.internalFormat, format, type, bytePerPixel))
+        return false;
+    auto stamp = GetFileStamp(key.source);
+    auto sourceHash = HashFile(key.source);
+    if (!stamp || !sourceHash) {
+        SPDLOG_ERROR("failed to read cubemap source: {}", key.source);
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = stamp->size;
+    header.sourceTime = stamp->time;
+    header.faceSize = (uint32_t)key.faceSize;
+    header.internalFormat = key.internalFormat;
+    header.format = format;
+    header.type = type;
+    header.bytePerPixel = bytePerPixel;
+    header.mipLevelCount = (uint32_t)mipLevelCount;
+
+    std::vector<CacheLevel> levels(header.mipLevelCount);
+    size_t offset = AlignUp(sizeof(header) + sizeof(CacheLevel) * levels.size());
+    for (uint32_t level = 0; level < header.mipLevelCount; level++) {
+        size_t levelSize = (size_t)std::max(key.faceSize >> level, 1);
+        levels[level].offset = offset;
+        levels[level].faceByteSize = levelSize * levelSize * bytePerPixel;
+        offset = AlignUp(offset + levels[level].faceByteSize * 6);
+    }
+
+    // written next to the target and renamed, so readers never see a partial file
+    auto filename = GetFilename(key);
+    auto tempFilename = filename + ".tmp";
+    std::ofstream fout(tempFilename, std::ios::binary);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", tempFilename);
+        return false;
+    }
+    fout.write((const char*)&header, sizeof(header));
+    fout.write((const char*)levels.data(), sizeof(CacheLevel) * levels.size());
+
+    std::vector<uint8_t> faceData;
+    const char padding[CACHE_ALIGNMENT] = {};
+    for (uint32_t level = 0; level < header.mipLevelCount; level++) {
+        fout.seekp(0, std::ios::end);
+        size_t position = (size_t)fout.tellp();
+        fout.write(padding, levels[level].offset - position);
+        faceData.resize(levels[level].faceByteSize);
+        for (int face = 0; face < 6; face++) {
+            fillFace(level, face, faceData.data());
+            fout.write((const char*)faceData.data(), faceData.size());
+        }
+    }
+    fout.close();
+    if (!fout) {
+        SPDLOG_ERROR("failed to write cubemap cache: {}", tempFilename);
+        std::error_code error;
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFilename, filename, error);
+    if (error) {
+        SPDLOG_ERROR("failed to write cubemap cache: {} ({})", filename, error.message());
+        return false;
+    }
+    SPDLOG_INFO("cubemap cache stored: {}", filename);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef __CUBEMAP_CACHE_H__
+#define __CUBEMAP_CACHE_H__
+
+#include "texture.h"
+#include "image.h"
+#include "mapped_file.h"
+#include <functional>
+
+struct CubemapCacheKey {
+    std::string source;     // the equirect image the cubemap is baked from
+    int faceSize { 0 };
+    uint32_t internalFormat { GL_RGB16F };
+};
+
+// Baked cubemaps stored on disk, one file per key.
+// The file is a fixed header, a table of mip levels and the face data
+// of every level (64-byte aligned), laid out to be uploaded straight
+// from a memory mapping.
+// The header records the size, last write time and hash of the source.
+// The source is hashed only when its size or time changed, so a hit never
+// reads the source image.
+CLASS_PTR(CubemapCache)
+class CubemapCache {
+public:
+    static CubemapCacheUPtr Create(const std::string& directory);
+
+    // nullptr when the key is not cached or the file is stale
+    CubeTextureUPtr Load(const CubemapCacheKey& key) const;
+    // a valid cache file exists, needs no GL context
+    bool Contains(const CubemapCacheKey& key) const { return Open(key) != nullptr; }
+    // reads every face and mip level of the texture back from the GPU
+    bool Store(const CubemapCacheKey& key, const CubeTexture* texture) const;
+    // stores RGB float faces baked on the CPU as the base level, needs no GL context
+    bool Store(const CubemapCacheKey& key, const std::vector<ImageUPtr>& faces) const;
+
+    std::string GetFilename(const CubemapCacheKey& key) const;
+
+private:
+    CubemapCache() {}
+    // the cache file when it is valid for the current source
+    MappedFileUPtr Open(const CubemapCacheKey& key) const;
+    bool Write(const CubemapCacheKey& key, int mipLevelCount,
+        const std::function<void(int level, int face, uint8_t* dst)>& fillFace) const;
+
+    std::string m_directory;
+};
+
+#endif // __CUBEMAP_CACHE_H__
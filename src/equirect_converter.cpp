@@ -0,0 +1,333 @@
+#include "equirect_converter.h"
+#include "simd.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int TILE_SIZE = 64;
+const float PI = 3.14159265358979f;
+
+// direction = major + a * s + b * t, a and b in [-1, 1] across the face
+struct FaceAxes {
+    float major[3];
+    float s[3];
+    float t[3];
+};
+
+const FaceAxes FACE_AXES[6] = {
+    { {  1,  0,  0 }, {  0,  0, -1 }, { 0, -1,  0 } },
+    { { -1,  0,  0 }, {  0,  0,  1 }, { 0, -1,  0 } },
+    { {  0,  1,  0 }, {  1,  0,  0 }, { 0,  0,  1 } },
+    { {  0, -1,  0 }, {  1,  0,  0 }, { 0,  0, -1 } },
+    { {  0,  0,  1 }, {  1,  0,  0 }, { 0, -1,  0 } },
+    { {  0,  0, -1 }, { -1,  0,  0 }, { 0, -1,  0 } },
+};
+
+// atan(t) for t in [0, 1], Abramowitz and Stegun 4.4.49 (|error| < 2e-8)
+const float ATAN_COEFFS[8] = {
+    0.9999993329f, -0.3332985605f, 0.1994653599f, -0.1390853351f,
+    0.0964200441f, -0.0559098861f, 0.0218612288f, -0.0040540580f,
+};
+
+struct Source {
+    const float* data;
+    int width;
+    int height;
+    int stride;     // floats per pixel
+};
+
+struct Row {
+    const FaceAxes* axes;
+    float b;
+    float invSize;
+    float* dst;
+};
+
+void SamplePixel(const Source& src, float dx, float dy, float dz, float* dst) {
+    float u = atan2f(dz, dx) * (0.5f / PI) + 0.5f;
+    float v = atan2f(dy, sqrtf(dx * dx + dz * dz)) * (1.0f / PI) + 0.5f;
+    float x = u * src.width - 0.5f;
+    float y = v * src.height - 0.5f;
+    float x0f = floorf(x);
+    float y0f = floorf(y);
+    float fx = x - x0f;
+    float fy = y - y0f;
+    int x0 = std::clamp((int)x0f, 0, src.width - 1);
+    int x1 = std::clamp((int)x0f + 1, 0, src.width - 1);
+    int y0 = std::clamp((int)y0f, 0, src.height - 1);
+    int y1 = std::clamp((int)y0f + 1, 0, src.height - 1);
+    auto p00 = src.data + ((size_t)y0 * src.width + x0) * src.stride;
+    auto p10 = src.data + ((size_t)y0 * src.width + x1) * src.stride;
+    auto p01 = src.data + ((size_t)y1 * src.width + x0) * src.stride;
+    auto p11 = src.data + ((size_t)y1 * src.width + x1) * src.stride;
+    for (int c = 0; c < 3; c++) {
+        float top = p00[c] + (p10[c] - p00[c]) * fx;
+        float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+        dst[c] = top + (bottom - top) * fy;
+    }
+}
+
+void ConvertSpanScalar(const Source& src, const Row& row, int begin, int end) {
+    auto& axes = *row.axes;
+    for (int i = begin; i < end; i++) {
+        float a = (2 * i + 1) * row.invSize - 1.0f;
+        float d[3];
+        for (int k = 0; k < 3; k++)
+            d[k] = axes.major[k] + a * axes.s[k] + row.b * axes.t[k];
+        SamplePixel(src, d[0], d[1], d[2], row.dst + i * 3);
+    }
+}
+
+#if defined(SIMD_AVX2)
+
+__m256 Atan2(__m256 y, __m256 x) {
+    auto signMask = _mm256_set1_ps(-0.0f);
+    auto ax = _mm256_andnot_ps(signMask, x);
+    auto ay = _mm256_andnot_ps(signMask, y);
+    auto maxValue = _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1e-30f));
+    auto t = _mm256_div_ps(_mm256_min_ps(ax, ay), maxValue);
+    auto t2 = _mm256_mul_ps(t, t);
+    auto p = _mm256_set1_ps(ATAN_COEFFS[7]);
+    for (int i = 6; i >= 0; i--)
+        p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(ATAN_COEFFS[i]));
+    p = _mm256_mul_ps(p, t);
+    p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(0.5f * PI), p),
+        _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(PI), p),
+        _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return _mm256_or_ps(p, _mm256_and_ps(y, signMask));
+}
+
+// 8 pixels per iteration, texels fetched with gathers
+int ConvertSpanSimd(const Source& src, const Row& row, int begin, int end) {
+    auto& axes = *row.axes;
+    auto lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    auto width = _mm256_set1_ps((float)src.width);
+    auto height = _mm256_set1_ps((float)src.height);
+    auto half = _mm256_set1_ps(0.5f);
+    auto zero = _mm256_setzero_si256();
+    auto maxX = _mm256_set1_epi32(src.width - 1);
+    auto maxY = _mm256_set1_epi32(src.height - 1);
+    auto one = _mm256_set1_epi32(1);
+    auto rowStride = _mm256_set1_epi32(src.width * src.stride);
+    auto pixelStride = _mm256_set1_epi32(src.stride);
+    alignas(32) float color[3][8];
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        auto index = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        auto a = _mm256_fmsub_ps(_mm256_fmadd_ps(index, _mm256_set1_ps(2.0f), _mm256_set1_ps(1.0f)),
+            _mm256_set1_ps(row.invSize), _mm256_set1_ps(1.0f));
+        __m256 d[3];
+        for (int k = 0; k < 3; k++) {
+            d[k] = _mm256_fmadd_ps(a, _mm256_set1_ps(axes.s[k]),
+                _mm256_set1_ps(axes.major[k] + row.b * axes.t[k]));
+        }
+        auto horizontal = _mm256_sqrt_ps(_mm256_fmadd_ps(d[0], d[0], _mm256_mul_ps(d[2], d[2])));
+        auto u = _mm256_fmadd_ps(Atan2(d[2], d[0]), _mm256_set1_ps(0.5f / PI), half);
+        auto v = _mm256_fmadd_ps(Atan2(d[1], horizontal), _mm256_set1_ps(1.0f / PI), half);
+        auto x = _mm256_fmsub_ps(u, width, half);
+        auto y = _mm256_fmsub_ps(v, height, half);
+        auto x0f = _mm256_floor_ps(x);
+        auto y0f = _mm256_floor_ps(y);
+        auto fx = _mm256_sub_ps(x, x0f);
+        auto fy = _mm256_sub_ps(y, y0f);
+        auto x0i = _mm256_cvttps_epi32(x0f);
+        auto y0i = _mm256_cvttps_epi32(y0f);
+        auto x0 = _mm256_min_epi32(_mm256_max_epi32(x0i, zero), maxX);
+        auto x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(x0i, one), zero), maxX);
+        auto y0 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(y0i, zero), maxY), rowStride);
+        auto y1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(y0i, one), zero), maxY), rowStride);
+        x0 = _mm256_mullo_epi32(x0, pixelStride);
+        x1 = _mm256_mullo_epi32(x1, pixelStride);
+        auto i00 = _mm256_add_epi32(y0, x0);
+        auto i10 = _mm256_add_epi32(y0, x1);
+        auto i01 = _mm256_add_epi32(y1, x0);
+        auto i11 = _mm256_add_epi32(y1, x1);
+        for (int c = 0; c < 3; c++) {
+            auto base = src.data + c;
+            auto p00 = _mm256_i32gather_ps(base, i00, 4);
+            auto p10 = _mm256_i32gather_ps(base, i10, 4);
+            auto p01 = _mm256_i32gather_ps(base, i01, 4);
+            auto p11 = _mm256_i32gather_ps(base, i11, 4);
+            auto top = _mm256_fmadd_ps(_mm256_sub_ps(p10, p00), fx, p00);
+            auto bottom = _mm256_fmadd_ps(_mm256_sub_ps(p11, p01), fx, p01);
+            _mm256_store_ps(color[c], _mm256_fmadd_ps(_mm256_sub_ps(bottom, top), fy, top));
+        }
+        auto dst = row.dst + i * 3;
+        for (int k = 0; k < 8; k++) {
+            dst[k * 3 + 0] = color[0][k];
+            dst[k * 3 + 1] = color[1][k];
+            dst[k * 3 + 2] = color[2][k];
+        }
+    }
+    return i;
+}
+
+#elif defined(SIMD_NEON_A64)
+
+float32x4_t Atan2(float32x4_t y, float32x4_t x) {
+    auto ax = vabsq_f32(x);
+    auto ay = vabsq_f32(y);
+    auto maxValue = vmaxq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(1e-30f));
+    auto t = vdivq_f32(vminq_f32(ax, ay), maxValue);
+    auto t2 = vmulq_f32(t, t);
+    auto p = vdupq_n_f32(ATAN_COEFFS[7]);
+    for (int i = 6; i >= 0; i--)
+        p = vfmaq_f32(vdupq_n_f32(ATAN_COEFFS[i]), p, t2);
+    p = vmulq_f32(p, t);
+    p = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(0.5f * PI), p), p);
+    p = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0.0f)), vsubq_f32(vdupq_n_f32(PI), p), p);
+    auto sign = vandq_u32(vreinterpretq_u32_f32(y), vdupq_n_u32(0x80000000));
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(p), sign));
+}
+
+// 4 pixels per iteration, no gather on NEON so texels are loaded per lane
+int ConvertSpanSimd(const Source& src, const Row& row, int begin, int end) {
+    auto& axes = *row.axes;
+    const float laneValues[4] = { 0, 1, 2, 3 };
+    auto lane = vld1q_f32(laneValues);
+    auto half = vdupq_n_f32(0.5f);
+    auto maxX = vdupq_n_s32(src.width - 1);
+    auto maxY = vdupq_n_s32(src.height - 1);
+    auto zero = vdupq_n_s32(0);
+    auto one = vdupq_n_s32(1);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        auto index = vaddq_f32(vdupq_n_f32((float)i), lane);
+        auto a = vsubq_f32(vmulq_n_f32(vfmaq_n_f32(vdupq_n_f32(1.0f), index, 2.0f), row.invSize),
+            vdupq_n_f32(1.0f));
+        float32x4_t d[3];
+        for (int k = 0; k < 3; k++)
+            d[k] = vfmaq_n_f32(vdupq_n_f32(axes.major[k] + row.b * axes.t[k]), a, axes.s[k]);
+        auto horizontal = vsqrtq_f32(vfmaq_f32(vmulq_f32(d[2], d[2]), d[0], d[0]));
+        auto u = vfmaq_n_f32(half, Atan2(d[2], d[0]), 0.5f / PI);
+        auto v = vfmaq_n_f32(half, Atan2(d[1], horizontal), 1.0f / PI);
+        auto x = vsubq_f32(vmulq_n_f32(u, (float)src.width), half);
+        auto y = vsubq_f32(vmulq_n_f32(v, (float)src.height), half);
+        auto x0f = vrndmq_f32(x);
+        auto y0f = vrndmq_f32(y);
+        auto fx = vsubq_f32(x, x0f);
+        auto fy = vsubq_f32(y, y0f);
+        auto x0i = vcvtq_s32_f32(x0f);
+        auto y0i = vcvtq_s32_f32(y0f);
+        int32_t x0[4], x1[4], y0[4], y1[4];
+        vst1q_s32(x0, vminq_s32(vmaxq_s32(x0i, zero), maxX));
+        vst1q_s32(x1, vminq_s32(vmaxq_s32(vaddq_s32(x0i, one), zero), maxX));
+        vst1q_s32(y0, vminq_s32(vmaxq_s32(y0i, zero), maxY));
+        vst1q_s32(y1, vminq_s32(vmaxq_s32(vaddq_s32(y0i, one), zero), maxY));
+
+        float texel[4][3][4];
+        for (int k = 0; k < 4; k++) {
+            auto p00 = src.data + ((size_t)y0[k] * src.width + x0[k]) * src.stride;
+            auto p10 = src.data + ((size_t)y0[k] * src.width + x1[k]) * src.stride;
+            auto p01 = src.data + ((size_t)y1[k] * src.width + x0[k]) * src.stride;
+            auto p11 = src.data + ((size_t)y1[k] * src.width + x1[k]) * src.stride;
+            for (int c = 0; c < 3; c++) {
+                texel[0][c][k] = p00[c];
+                texel[1][c][k] = p10[c];
+                texel[2][c][k] = p01[c];
+                texel[3][c][k] = p11[c];
+            }
+        }
+        float32x4x3_t color;
+        for (int c = 0; c < 3; c++) {
+            auto p00 = vld1q_f32(texel[0][c]);
+            auto p10 = vld1q_f32(texel[1][c]);
+            auto p01 = vld1q_f32(texel[2][c]);
+            auto p11 = vld1q_f32(texel[3][c]);
+            auto top = vfmaq_f32(p00, vsubq_f32(p10, p00), fx);
+            auto bottom = vfmaq_f32(p01, vsubq_f32(p11, p01), fx);
+            color.val[c] = vfmaq_f32(top, vsubq_f32(bottom, top), fy);
+        }
+        vst3q_f32(row.dst + i * 3, color);
+    }
+    return i;
+}
+
+#else
+
+int ConvertSpanSimd(const Source&, const Row&, int begin, int) {
+    return begin;
+}
+
+#endif
+
+} // namespace
+
+std::vector<ImageUPtr> EquirectConverter::Convert(const Image* equirect, int faceSize,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("EquirectConverter::Convert");
+    std::vector<ImageUPtr> faces;
+    if (!equirect || equirect->GetBytePerChannel() != 4 || equirect->GetChannelCount() < 3) {
+        SPDLOG_ERROR("equirect image must have 3 or 4 float channels");
+        return faces;
+    }
+    for (int i = 0; i < 6; i++) {
+        auto face = Image::Create(faceSize, faceSize, 3, 4);
+        if (!face)
+            return std::vector<ImageUPtr>();
+        faces.push_back(std::move(face));
+    }
+
+    Source src;
+    src.data = (const float*)equirect->GetData();
+    src.width = equirect->GetWidth();
+    src.height = equirect->GetHeight();
+    src.stride = equirect->GetChannelCount();
+
+    int tileCount = (faceSize + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesPerFace = tileCount * tileCount;
+    auto convertTile = [&](size_t begin, size_t end, int) {
+        TRACE_SCOPE("EquirectConverter::ConvertTile");
+        for (size_t tile = begin; tile < end; tile++) {
+            int face = (int)tile / tilesPerFace;
+            int tileX = ((int)tile % tilesPerFace) % tileCount * TILE_SIZE;
+            int tileY = ((int)tile % tilesPerFace) / tileCount * TILE_SIZE;
+            int tileEndX = std::min(tileX + TILE_SIZE, faceSize);
+            int tileEndY = std::min(tileY + TILE_SIZE, faceSize);
+            for (int j = tileY; j < tileEndY; j++) {
+                Row row;
+                row.axes = &FACE_AXES[face];
+                row.invSize = 1.0f / faceSize;
+                row.b = (2 * j + 1) * row.invSize - 1.0f;
+                row.dst = (float*)faces[face]->GetData() + (size_t)j * faceSize * 3;
+                int i = ConvertSpanSimd(src, row, tileX, tileEndX);
+                ConvertSpanScalar(src, row, i, tileEndX);
+            }
+        }
+    };
+    if (threadPool)
+        threadPool->ParallelFor(6 * tilesPerFace, 1, convertTile);
+    else
+        convertTile(0, 6 * tilesPerFace, 0);
+    return faces;
+}
+
+FaceDifference EquirectConverter::CompareFaces(const Image* a, const Image* b) {
+    FaceDifference difference;
+    if (a->GetWidth() != b->GetWidth() || a->GetHeight() != b->GetHeight() ||
+        a->GetChannelCount() != b->GetChannelCount() ||
+        a->GetBytePerChannel() != 4 || b->GetBytePerChannel() != 4) {
+        difference.maxError = difference.meanError = difference.outlierFraction = INFINITY;
+        return difference;
+    }
+    auto dataA = (const float*)a->GetData();
+    auto dataB = (const float*)b->GetData();
+    size_t count = (size_t)a->GetWidth() * a->GetHeight() * a->GetChannelCount();
+    double errorSum = 0.0;
+    size_t outlierCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        float error = fabsf(dataA[i] - dataB[i]) / std::max(fabsf(dataA[i]), 1.0f);
+        difference.maxError = std::max(difference.maxError, error);
+        errorSum += error;
+        if (error > EQUIRECT_OUTLIER_ERROR)
+            outlierCount++;
+    }
+    difference.meanError = count ? (float)(errorSum / count) : 0.0f;
+    difference.outlierFraction = count ? (float)outlierCount / count : 0.0f;
+    return difference;
+}
@@ -0,0 +1,39 @@
+#ifndef __EQUIRECT_CONVERTER_H__
+#define __EQUIRECT_CONVERTER_H__
+
+#include "common.h"
+#include "image.h"
+#include "thread_pool.h"
+
+// difference between two sets of faces, per channel and relative to max(|a|, 1)
+struct FaceDifference {
+    float maxError { 0.0f };
+    float meanError { 0.0f };
+    // share of channels off by more than EQUIRECT_OUTLIER_ERROR
+    float outlierFraction { 0.0f };
+};
+
+// tolerance against the GPU bake, checked by --check-cubemaps. The GPU
+// stores RGB16F (2^-11 relative) and filters with a few bits of subtexel
+// precision, which only shows next to very bright texels such as the sun.
+const float EQUIRECT_OUTLIER_ERROR = 1e-2f;
+const float EQUIRECT_GPU_MEAN_ERROR = 1e-3f;
+const float EQUIRECT_GPU_OUTLIER_FRACTION = 1e-3f;
+
+// CPU version of the spherical_map.fs bake, needs no GL context.
+// Samples a float equirectangular image (3 or 4 channels, bottom row
+// first as loaded by Image::Load) into six RGB float faces in
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order, bilinear with clamp to edge.
+// Faces are split into square tiles and each worker converts one tile
+// at a time, with AVX2 or NEON kernels when the build enables them.
+// Only the base level is sampled; the GPU bake minifies from the equirect
+// mip chain close to the poles instead.
+class EquirectConverter {
+public:
+    static std::vector<ImageUPtr> Convert(const Image* equirect, int faceSize,
+        ThreadPool* threadPool = nullptr);
+
+    static FaceDifference CompareFaces(const Image* a, const Image* b);
+};
+
+#endif // __EQUIRECT_CONVERTER_H__
@@ -0,0 +1,29 @@
+#ifndef __FRAME_CONSTANTS_H__
+#define __FRAME_CONSTANTS_H__
+
+#include "common.h"
+#include <cstddef>
+
+// uniform buffer binding point of the FrameConstants block in every program
+const uint32_t FRAME_CONSTANTS_BINDING = 0;
+
+// std140 layout of the FrameConstants uniform block, filled once per frame,
+// declared for the shaders in shader/frame_constants.glsl
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 inverseView;
+    glm::mat4 inverseProjection;
+    glm::vec3 viewPos;
+    float time;
+    glm::vec3 lightPos;
+    float padding0;
+    glm::vec2 resolution;
+    glm::vec2 padding1;
+};
+
+static_assert(offsetof(FrameConstants, viewPos) == 256, "FrameConstants must match std140");
+static_assert(offsetof(FrameConstants, lightPos) == 272, "FrameConstants must match std140");
+static_assert(offsetof(FrameConstants, resolution) == 288, "FrameConstants must match std140");
+
+#endif // __FRAME_CONSTANTS_H__
@@ -1,4 +1,8 @@
 #include "framebuffer.h"
+#include "gl_state.h"
+
+// framebuffer used by BindToDefault, 0 unless an offscreen target replaces the window
+static uint32_t s_defaultFramebuffer = 0;
 
 FramebufferUPtr Framebuffer::Create(const std::vector<TexturePtr>& colorAttachments) {
     auto framebuffer = FramebufferUPtr(new Framebuffer());
@@ -12,22 +16,27 @@ Framebuffer::~Framebuffer() {
         glDeleteRenderbuffers(1, &m_depthStencilBuffer);
     }
     if (m_framebuffer) {
+        GLState::OnFramebufferDeleted(m_framebuffer);
         glDeleteFramebuffers(1, &m_framebuffer);
     }
 }
 
 void Framebuffer::BindToDefault() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(s_defaultFramebuffer);
+}
+
+void Framebuffer::SetDefault(const Framebuffer* framebuffer) {
+    s_defaultFramebuffer = framebuffer ? framebuffer->Get() : 0;
 }
 
 void Framebuffer::Bind() const {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    GLState::BindFramebuffer(m_framebuffer);
 }
 
 bool Framebuffer::InitWithColorAttachments(const std::vector<TexturePtr>& colorAttachments) {
     m_colorAttachments = colorAttachments;
     glGenFramebuffers(1, &m_framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    GLState::BindFramebuffer(m_framebuffer);
 
     for (size_t i = 0; i < m_colorAttachments.size(); i++) {
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, 
@@ -76,12 +85,13 @@ CubeFramebuffer::~CubeFramebuffer() {
         glDeleteRenderbuffers(1, &m_depthStencilBuffer);
     }
     if (m_framebuffer) {
+        GLState::OnFramebufferDeleted(m_framebuffer);
         glDeleteFramebuffers(1, &m_framebuffer);
     }
 }
 
 void CubeFramebuffer::Bind(int cubeIndex) const {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    GLState::BindFramebuffer(m_framebuffer);
     glFramebufferTexture2D(GL_FRAMEBUFFER,
         GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + cubeIndex,
         m_colorAttachment->Get(), m_mipLevel);
@@ -93,7 +103,7 @@ bool CubeFramebuffer::InitWithColorAttachment(const CubeTexturePtr& colorAttachm
     m_colorAttachment = colorAttachment;
     m_mipLevel = mipLevel;
     glGenFramebuffers(1, &m_framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    GLState::BindFramebuffer(m_framebuffer);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER,
         GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X,
@@ -8,6 +8,7 @@ class Framebuffer {
 public:
     static FramebufferUPtr Create(const std::vector<TexturePtr>& colorAttachments);
     static void BindToDefault();
+    static void SetDefault(const Framebuffer* framebuffer);
     ~Framebuffer();
 
     const uint32_t Get() const { return m_framebuffer; }
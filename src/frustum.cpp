@@ -0,0 +1,106 @@
+#include "frustum.h"
+#include "simd.h"
+#include <algorithm>
+
+Frustum Frustum::FromMatrix(const glm::mat4& m) {
+    // Gribb/Hartmann: planes are sums of the clip matrix rows
+    auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(3) + row(2);
+    frustum.planes[5] = row(3) - row(2);
+    for (auto& plane: frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+bool Frustum::Intersects(const glm::vec3& center, float radius) const {
+    for (auto& plane: planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+CullingSetUPtr CullingSet::Create() {
+    return CullingSetUPtr(new CullingSet());
+}
+
+int CullingSet::Add(const glm::vec3& center, float radius) {
+    int index = m_count++;
+    size_t paddedCount = (m_count + 3) & ~3;
+    if (m_centerX.size() < paddedCount) {
+        m_centerX.resize(paddedCount, 0.0f);
+        m_centerY.resize(paddedCount, 0.0f);
+        m_centerZ.resize(paddedCount, 0.0f);
+        m_radius.resize(paddedCount, 0.0f);
+    }
+    Set(index, center, radius);
+    return index;
+}
+
+void CullingSet::Set(int index, const glm::vec3& center, float radius) {
+    m_centerX[index] = center.x;
+    m_centerY[index] = center.y;
+    m_centerZ[index] = center.z;
+    m_radius[index] = radius;
+}
+
+void CullingSet::Clear() {
+    m_centerX.clear();
+    m_centerY.clear();
+    m_centerZ.clear();
+    m_radius.clear();
+    m_count = 0;
+}
+
+int CullingSet::Cull(const Frustum& frustum, uint8_t* visible) const {
+    int visibleCount = 0;
+    for (int i = 0; i < m_count; i += 4) {
+        int mask = 0;
+#if defined(SIMD_SSE2)
+        auto x = _mm_loadu_ps(&m_centerX[i]);
+        auto y = _mm_loadu_ps(&m_centerY[i]);
+        auto z = _mm_loadu_ps(&m_centerZ[i]);
+        auto negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_radius[i]));
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto& plane: frustum.planes) {
+            auto distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        mask = _mm_movemask_ps(inside);
+#elif defined(SIMD_NEON)
+        auto x = vld1q_f32(&m_centerX[i]);
+        auto y = vld1q_f32(&m_centerY[i]);
+        auto z = vld1q_f32(&m_centerZ[i]);
+        auto negRadius = vnegq_f32(vld1q_f32(&m_radius[i]));
+        auto inside = vdupq_n_u32(0xFFFFFFFF);
+        for (auto& plane: frustum.planes) {
+            auto distance = vdupq_n_f32(plane.w);
+            distance = vmlaq_n_f32(distance, x, plane.x);
+            distance = vmlaq_n_f32(distance, y, plane.y);
+            distance = vmlaq_n_f32(distance, z, plane.z);
+            inside = vandq_u32(inside, vcgeq_f32(distance, negRadius));
+        }
+        mask = (vgetq_lane_u32(inside, 0) & 1) | (vgetq_lane_u32(inside, 1) & 2) |
+            (vgetq_lane_u32(inside, 2) & 4) | (vgetq_lane_u32(inside, 3) & 8);
+#else
+        for (int lane = 0; lane < 4; lane++) {
+            auto center = glm::vec3(m_centerX[i + lane], m_centerY[i + lane], m_centerZ[i + lane]);
+            if (frustum.Intersects(center, m_radius[i + lane]))
+                mask |= 1 << lane;
+        }
+#endif
+        int laneCount = std::min(m_count - i, 4);
+        for (int lane = 0; lane < laneCount; lane++) {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+    return visibleCount;
+}
@@ -0,0 +1,42 @@
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include "common.h"
+#include <vector>
+
+// six planes (xyz normal pointing inside, w distance) of a view projection
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+    bool Intersects(const glm::vec3& center, float radius) const;
+};
+
+// Bounding spheres stored as structure of arrays so the frustum test
+// runs on four spheres per instruction (SSE2 / NEON, scalar otherwise).
+CLASS_PTR(CullingSet)
+class CullingSet {
+public:
+    static CullingSetUPtr Create();
+
+    int Add(const glm::vec3& center, float radius);
+    void Set(int index, const glm::vec3& center, float radius);
+    void Clear();
+    int GetCount() const { return m_count; }
+
+    // visible[i] is set to 1 for spheres touching the frustum, 0 otherwise.
+    // returns the number of visible spheres
+    int Cull(const Frustum& frustum, uint8_t* visible) const;
+
+private:
+    CullingSet() {}
+
+    // padded to a multiple of four with empty spheres
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+    int m_count { 0 };
+};
+
+#endif // __FRUSTUM_H__
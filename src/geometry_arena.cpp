@@ -0,0 +1,213 @@
+#include "geometry_arena.h"
+#include "gl_state.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t INITIAL_VERTEX_CAPACITY = 1 << 16;
+const uint32_t INITIAL_POSITION_CAPACITY = 1 << 12;
+const uint32_t INITIAL_INDEX_BLOCK_CAPACITY = 1 << 17;
+
+GeometryArenaWPtr s_arenas[VERTEX_FORMAT_COUNT];
+
+} // namespace
+
+uint32_t RangeAllocator::Allocate(uint32_t count) {
+    if (count == 0)
+        return 0;
+    for (auto block = m_freeBlocks.begin(); block != m_freeBlocks.end(); ++block) {
+        if (block->second < count)
+            continue;
+        uint32_t offset = block->first;
+        uint32_t remaining = block->second - count;
+        m_freeBlocks.erase(block);
+        if (remaining > 0)
+            m_freeBlocks.emplace(offset + count, remaining);
+        m_used += count;
+        m_allocationCount++;
+        return offset;
+    }
+    return INVALID_RANGE;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count) {
+    if (count == 0 || offset == INVALID_RANGE)
+        return;
+    m_used -= count;
+    m_allocationCount--;
+    AddFreeBlock(offset, count);
+}
+
+void RangeAllocator::Grow(uint32_t capacity) {
+    if (capacity <= m_capacity)
+        return;
+    uint32_t offset = m_capacity;
+    m_capacity = capacity;
+    AddFreeBlock(offset, capacity - offset);
+}
+
+void RangeAllocator::AddFreeBlock(uint32_t offset, uint32_t count) {
+    auto next = m_freeBlocks.lower_bound(offset);
+    if (next != m_freeBlocks.end() && offset + count == next->first) {
+        count += next->second;
+        next = m_freeBlocks.erase(next);
+    }
+    if (next != m_freeBlocks.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+    m_freeBlocks.emplace(offset, count);
+}
+
+RangeAllocatorStats RangeAllocator::GetStats() const {
+    RangeAllocatorStats stats;
+    stats.capacity = m_capacity;
+    stats.used = m_used;
+    stats.allocationCount = m_allocationCount;
+    stats.freeBlockCount = m_freeBlocks.size();
+    size_t freeSize = 0;
+    for (auto& block: m_freeBlocks) {
+        freeSize += block.second;
+        stats.largestFreeBlock = std::max<size_t>(stats.largestFreeBlock, block.second);
+    }
+    if (m_capacity > 0)
+        stats.utilization = (float)m_used / m_capacity;
+    if (freeSize > 0)
+        stats.fragmentation = 1.0f - (float)stats.largestFreeBlock / freeSize;
+    return stats;
+}
+
+GeometryArenaPtr GeometryArena::Get(VertexFormat format) {
+    auto arena = s_arenas[format].lock();
+    if (!arena) {
+        arena = GeometryArenaPtr(new GeometryArena());
+        arena->Init(format);
+        s_arenas[format] = arena;
+    }
+    return arena;
+}
+
+GeometryArenaPtr GeometryArena::Find(VertexFormat format) {
+    return s_arenas[format].lock();
+}
+
+void GeometryArena::Init(VertexFormat format) {
+    m_vertexFormat = format;
+    m_vertexAllocator.Grow(INITIAL_VERTEX_CAPACITY);
+    m_positionAllocator.Grow(INITIAL_POSITION_CAPACITY);
+    m_indexAllocator.Grow(INITIAL_INDEX_BLOCK_CAPACITY);
+
+    m_vertexBuffer = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW,
+        nullptr, VertexPacker::GetStride(format), INITIAL_VERTEX_CAPACITY);
+    m_positionBuffer = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW,
+        nullptr, VertexPacker::GetPositionStride(format), INITIAL_POSITION_CAPACITY);
+    auto identity = glm::mat4(1.0f);
+    m_identityInstanceBuffer = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW,
+        &identity, sizeof(glm::mat4), 1);
+
+    // an element array buffer attaches to the bound vertex array object on creation
+    m_vertexLayout = VertexLayout::Create();
+    m_indexBuffer = Buffer::CreateWithData(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW,
+        nullptr, INDEX_BLOCK_SIZE, INITIAL_INDEX_BLOCK_CAPACITY);
+    m_positionVertexLayout = VertexLayout::Create();
+    SetupVertexLayout(m_vertexLayout.get(), false);
+    SetupVertexLayout(m_positionVertexLayout.get(), true);
+}
+
+void GeometryArena::SetupVertexLayout(const VertexLayout* vertexLayout, bool positionsOnly) {
+    vertexLayout->Bind();
+    m_indexBuffer->Bind();
+    if (positionsOnly) {
+        VertexPacker::SetupPositionLayout(m_vertexFormat, vertexLayout, VERTEX_BINDING);
+        vertexLayout->SetVertexBuffer(VERTEX_BINDING, m_positionBuffer->Get(),
+            0, m_positionBuffer->GetStride());
+    }
+    else {
+        VertexPacker::SetupLayout(m_vertexFormat, vertexLayout, VERTEX_BINDING);
+        vertexLayout->SetVertexBuffer(VERTEX_BINDING, m_vertexBuffer->Get(),
+            0, m_vertexBuffer->GetStride());
+    }
+
+    for (uint32_t i = 0; i < 4; i++) {
+        vertexLayout->SetAttribFormat(INSTANCE_TRANSFORM_ATTRIB + i, 4, GL_FLOAT, false,
+            sizeof(glm::vec4) * i, INSTANCE_BINDING);
+    }
+    vertexLayout->SetBindingDivisor(INSTANCE_BINDING, 1);
+    vertexLayout->SetVertexBuffer(INSTANCE_BINDING, m_identityInstanceBuffer->Get(),
+        0, sizeof(glm::mat4));
+    m_instanceBinding[positionsOnly ? 1 : 0] = m_identityInstanceBuffer->Get();
+}
+
+uint32_t GeometryArena::AllocateRange(RangeAllocator& allocator, BufferPtr& buffer,
+    uint32_t bufferType, uint32_t count) {
+    auto offset = allocator.Allocate(count);
+    if (offset != INVALID_RANGE)
+        return offset;
+
+    // at least double, so a scene of many meshes copies O(size) in total
+    uint32_t capacity = std::max(allocator.GetCapacity() * 2, allocator.GetCapacity() + count);
+    SPDLOG_INFO("geometry arena {}: grow {} -> {} x {} bytes",
+        (int)m_vertexFormat, allocator.GetCapacity(), capacity, buffer->GetStride());
+    m_vertexLayout->Bind();
+    BufferPtr grown = Buffer::CreateWithData(bufferType, GL_STATIC_DRAW,
+        nullptr, buffer->GetStride(), capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer->Get());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown->Get());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+        0, 0, buffer->GetStride() * buffer->GetCount());
+    buffer = std::move(grown);
+    allocator.Grow(capacity);
+    SetupVertexLayout(m_vertexLayout.get(), false);
+    SetupVertexLayout(m_positionVertexLayout.get(), true);
+    return allocator.Allocate(count);
+}
+
+GeometryAllocation GeometryArena::Allocate(const void* vertices, const void* positions, uint32_t vertexCount,
+    const void* indices, uint32_t indexType, uint32_t indexCount) {
+    GeometryAllocation allocation;
+    allocation.vertexCount = vertexCount;
+    allocation.indexType = indexType;
+    allocation.indexCount = indexCount;
+
+    size_t stride = m_vertexBuffer->GetStride();
+    allocation.baseVertex = AllocateRange(m_vertexAllocator, m_vertexBuffer,
+        GL_ARRAY_BUFFER, vertexCount);
+    m_vertexBuffer->SetData(vertices, stride * vertexCount, stride * allocation.baseVertex);
+    if (positions) {
+        size_t positionStride = m_positionBuffer->GetStride();
+        allocation.positionBaseVertex = AllocateRange(m_positionAllocator, m_positionBuffer,
+            GL_ARRAY_BUFFER, vertexCount);
+        m_positionBuffer->SetData(positions, positionStride * vertexCount,
+            positionStride * allocation.positionBaseVertex);
+    }
+
+    size_t indexSize = allocation.GetIndexSize() * indexCount;
+    allocation.indexBlockCount = (uint32_t)((indexSize + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE);
+    allocation.indexBlock = AllocateRange(m_indexAllocator, m_indexBuffer,
+        GL_ELEMENT_ARRAY_BUFFER, allocation.indexBlockCount);
+    // the index buffer is bound through the arena's own vertex array object
+    m_vertexLayout->Bind();
+    m_indexBuffer->SetData(indices, indexSize, (size_t)allocation.indexBlock * INDEX_BLOCK_SIZE);
+    return allocation;
+}
+
+void GeometryArena::Free(const GeometryAllocation& allocation) {
+    m_vertexAllocator.Free(allocation.baseVertex, allocation.vertexCount);
+    if (allocation.positionBaseVertex != INVALID_RANGE)
+        m_positionAllocator.Free(allocation.positionBaseVertex, allocation.vertexCount);
+    m_indexAllocator.Free(allocation.indexBlock, allocation.indexBlockCount);
+}
+
+void GeometryArena::Bind(const Buffer* instanceBuffer, bool positionsOnly) {
+    auto vertexLayout = positionsOnly ? m_positionVertexLayout.get() : m_vertexLayout.get();
+    vertexLayout->Bind();
+    uint32_t buffer = instanceBuffer ? instanceBuffer->Get() : m_identityInstanceBuffer->Get();
+    auto& bound = m_instanceBinding[positionsOnly ? 1 : 0];
+    if (bound != buffer) {
+        vertexLayout->SetVertexBuffer(INSTANCE_BINDING, buffer, 0, sizeof(glm::mat4));
+        bound = buffer;
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef __GEOMETRY_ARENA_H__
+#define __GEOMETRY_ARENA_H__
+
+#include "common.h"
+#include "buffer.h"
+#include "vertex_layout.h"
+#include "vertex_format.h"
+#include <map>
+
+const uint32_t INVALID_RANGE = 0xffffffff;
+
+// index ranges are handed out in blocks of 4 bytes, so a range starts
+// aligned for both 16 and 32-bit indices
+const uint32_t INDEX_BLOCK_SIZE = 4;
+
+// vertex buffer binding points of the shared vertex array objects
+const uint32_t VERTEX_BINDING = 0;
+const uint32_t INSTANCE_BINDING = 1;
+
+// attribute locations 4..7: per-instance model matrix, one vec4 column each
+const uint32_t INSTANCE_TRANSFORM_ATTRIB = 4;
+
+struct RangeAllocatorStats {
+    size_t capacity { 0 };
+    size_t used { 0 };
+    size_t allocationCount { 0 };
+    size_t freeBlockCount { 0 };
+    size_t largestFreeBlock { 0 };
+    // used / capacity
+    float utilization { 0.0f };
+    // 1 - largest free block / free space, 0 while the free space is one block
+    float fragmentation { 0.0f };
+};
+
+// First fit free list over [0, capacity) in units of the caller's choice.
+// Free merges a range with its free neighbours. Meant for the few hundred
+// long lived meshes of a scene, not for per-frame allocations.
+class RangeAllocator {
+public:
+    RangeAllocator(uint32_t capacity = 0) { Grow(capacity); }
+
+    // offset of count units, INVALID_RANGE when no free block is large enough
+    uint32_t Allocate(uint32_t count);
+    void Free(uint32_t offset, uint32_t count);
+    // appends [GetCapacity(), capacity) as free space
+    void Grow(uint32_t capacity);
+
+    uint32_t GetCapacity() const { return m_capacity; }
+    RangeAllocatorStats GetStats() const;
+
+private:
+    void AddFreeBlock(uint32_t offset, uint32_t count);
+
+    // offset -> size
+    std::map<uint32_t, uint32_t> m_freeBlocks;
+    uint32_t m_capacity { 0 };
+    uint32_t m_used { 0 };
+    uint32_t m_allocationCount { 0 };
+};
+
+// one command of glMultiDrawElementsIndirect, layout fixed by GL
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// where a mesh lives inside its arena
+struct GeometryAllocation {
+    uint32_t baseVertex { INVALID_RANGE };
+    uint32_t vertexCount { 0 };
+    // INVALID_RANGE without a position stream
+    uint32_t positionBaseVertex { INVALID_RANGE };
+    uint32_t indexBlock { INVALID_RANGE };
+    uint32_t indexBlockCount { 0 };
+    uint32_t indexType { GL_UNSIGNED_INT };
+    uint32_t indexCount { 0 };
+
+    uint32_t GetIndexSize() const {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+    // in indices of indexType, as glMultiDrawElementsIndirect wants it
+    uint32_t GetFirstIndex() const { return indexBlock * INDEX_BLOCK_SIZE / GetIndexSize(); }
+    // byte offset, as the glDrawElements family wants it
+    const void* GetIndexOffset() const {
+        return (const void*)((size_t)indexBlock * INDEX_BLOCK_SIZE);
+    }
+};
+
+// One vertex buffer, position stream buffer and index buffer per vertex
+// format, shared by every mesh of that format. Each buffer is sub-allocated
+// by a RangeAllocator and grows by copying into a buffer twice the size.
+// The vertex array objects use separate attribute formats, so the format
+// is set up once and an instance buffer is swapped in on its own binding;
+// a mesh is drawn by its base vertex and index offset without a VAO of its own.
+CLASS_PTR(GeometryArena)
+class GeometryArena {
+public:
+    // created by the first mesh of the format, released with the last one
+    static GeometryArenaPtr Get(VertexFormat format);
+    // null while no mesh of the format exists
+    static GeometryArenaPtr Find(VertexFormat format);
+
+    VertexFormat GetVertexFormat() const { return m_vertexFormat; }
+
+    // vertices (and positions, may be null) packed in the arena format,
+    // indices of indexType
+    GeometryAllocation Allocate(const void* vertices, const void* positions, uint32_t vertexCount,
+        const void* indices, uint32_t indexType, uint32_t indexCount);
+    void Free(const GeometryAllocation& allocation);
+
+    // binds the shared vertex array object reading attributes 0..3 from the
+    // vertex or position buffer and 4..7 from instanceBuffer, one glm::mat4
+    // per instance, or the identity when null
+    void Bind(const Buffer* instanceBuffer, bool positionsOnly = false);
+
+    RangeAllocatorStats GetVertexStats() const { return m_vertexAllocator.GetStats(); }
+    RangeAllocatorStats GetPositionStats() const { return m_positionAllocator.GetStats(); }
+    // in INDEX_BLOCK_SIZE blocks
+    RangeAllocatorStats GetIndexStats() const { return m_indexAllocator.GetStats(); }
+
+private:
+    GeometryArena() {}
+    void Init(VertexFormat format);
+    // grows the buffer when the allocator is full
+    uint32_t AllocateRange(RangeAllocator& allocator, BufferPtr& buffer,
+        uint32_t bufferType, uint32_t count);
+    void SetupVertexLayout(const VertexLayout* vertexLayout, bool positionsOnly);
+
+    VertexFormat m_vertexFormat { VERTEX_FORMAT_FLOAT };
+    RangeAllocator m_vertexAllocator;
+    RangeAllocator m_positionAllocator;
+    RangeAllocator m_indexAllocator;
+    BufferPtr m_vertexBuffer;
+    BufferPtr m_positionBuffer;
+    BufferPtr m_indexBuffer;
+    BufferUPtr m_identityInstanceBuffer;
+    VertexLayoutUPtr m_vertexLayout;
+    VertexLayoutUPtr m_positionVertexLayout;
+    // buffer names on INSTANCE_BINDING of the two layouts
+    uint32_t m_instanceBinding[2] { 0, 0 };
+};
+
+#endif // __GEOMETRY_ARENA_H__
@@ -0,0 +1,197 @@
+#include "gl_state.h"
+#include "program.h"
+
+namespace {
+
+const uint32_t UNKNOWN = 0xFFFFFFFF;
+const int MAX_TEXTURE_UNITS = 32;
+
+struct ShadowState {
+    uint32_t program { UNKNOWN };
+    uint32_t activeUnit { UNKNOWN };
+    uint32_t texture2D[MAX_TEXTURE_UNITS];
+    uint32_t textureCube[MAX_TEXTURE_UNITS];
+    uint32_t framebuffer { UNKNOWN };
+    uint32_t vertexArray { UNKNOWN };
+    uint32_t blend { UNKNOWN };
+    uint32_t blendSrc { UNKNOWN };
+    uint32_t blendDst { UNKNOWN };
+    uint32_t depthTest { UNKNOWN };
+    uint32_t depthFunc { UNKNOWN };
+    uint32_t depthWrite { UNKNOWN };
+    uint32_t cullFace { UNKNOWN };
+    uint32_t cullMode { UNKNOWN };
+    uint32_t scissorTest { UNKNOWN };
+
+    ShadowState() {
+        for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+            texture2D[i] = UNKNOWN;
+            textureCube[i] = UNKNOWN;
+        }
+    }
+};
+
+ShadowState s_state;
+uint64_t s_issuedCount { 0 };
+uint64_t s_skippedCount { 0 };
+
+// updates the cached value and returns true when the GL call is needed
+bool Update(uint32_t& cached, uint32_t value) {
+    if (cached == value) {
+        s_skippedCount++;
+        return false;
+    }
+    cached = value;
+    s_issuedCount++;
+    return true;
+}
+
+void SetCapability(uint32_t& cached, uint32_t capability, bool enable) {
+    if (!Update(cached, enable ? 1 : 0))
+        return;
+    if (enable)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+} // namespace
+
+void GLState::Invalidate() {
+    s_state = ShadowState();
+}
+
+void GLState::UseProgram(uint32_t program) {
+    if (Update(s_state.program, program))
+        glUseProgram(program);
+}
+
+void GLState::ActiveTexture(uint32_t unit) {
+    if (Update(s_state.activeUnit, unit - GL_TEXTURE0))
+        glActiveTexture(unit);
+}
+
+void GLState::BindTexture(uint32_t target, uint32_t texture) {
+    uint32_t unit = s_state.activeUnit;
+    uint32_t* cached = nullptr;
+    if (unit < MAX_TEXTURE_UNITS) {
+        if (target == GL_TEXTURE_2D)
+            cached = &s_state.texture2D[unit];
+        else if (target == GL_TEXTURE_CUBE_MAP)
+            cached = &s_state.textureCube[unit];
+    }
+    if (!cached) {
+        s_issuedCount++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (Update(*cached, texture))
+        glBindTexture(target, texture);
+}
+
+void GLState::BindFramebuffer(uint32_t framebuffer) {
+    if (Update(s_state.framebuffer, framebuffer))
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GLState::BindVertexArray(uint32_t vertexArray) {
+    if (Update(s_state.vertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+void GLState::SetBlend(bool enable) {
+    SetCapability(s_state.blend, GL_BLEND, enable);
+}
+
+void GLState::SetBlendFunc(uint32_t src, uint32_t dst) {
+    bool srcChanged = Update(s_state.blendSrc, src);
+    bool dstChanged = Update(s_state.blendDst, dst);
+    if (srcChanged || dstChanged)
+        glBlendFunc(src, dst);
+}
+
+void GLState::SetDepthTest(bool enable) {
+    SetCapability(s_state.depthTest, GL_DEPTH_TEST, enable);
+}
+
+void GLState::SetDepthFunc(uint32_t func) {
+    if (Update(s_state.depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLState::SetDepthWrite(bool enable) {
+    if (Update(s_state.depthWrite, enable ? 1 : 0))
+        glDepthMask(enable ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::SetCullFace(bool enable) {
+    SetCapability(s_state.cullFace, GL_CULL_FACE, enable);
+}
+
+void GLState::SetCullMode(uint32_t mode) {
+    if (Update(s_state.cullMode, mode))
+        glCullFace(mode);
+}
+
+void GLState::SetScissorTest(bool enable) {
+    SetCapability(s_state.scissorTest, GL_SCISSOR_TEST, enable);
+}
+
+void GLState::OnProgramDeleted(uint32_t program) {
+    if (s_state.program == program)
+        s_state.program = UNKNOWN;
+}
+
+void GLState::OnTextureDeleted(uint32_t texture) {
+    // GL unbinds a deleted texture from every unit
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        if (s_state.texture2D[i] == texture)
+            s_state.texture2D[i] = 0;
+        if (s_state.textureCube[i] == texture)
+            s_state.textureCube[i] = 0;
+    }
+}
+
+void GLState::OnFramebufferDeleted(uint32_t framebuffer) {
+    if (s_state.framebuffer == framebuffer)
+        s_state.framebuffer = 0;
+}
+
+void GLState::OnVertexArrayDeleted(uint32_t vertexArray) {
+    if (s_state.vertexArray == vertexArray)
+        s_state.vertexArray = 0;
+}
+
+uint64_t GLState::GetIssuedCount() {
+    return s_issuedCount;
+}
+
+uint64_t GLState::GetSkippedCount() {
+    return s_skippedCount;
+}
+
+void GLState::ResetCounters() {
+    s_issuedCount = 0;
+    s_skippedCount = 0;
+}
+
+PipelineStateUPtr PipelineState::Create(const PipelineStateDesc& desc) {
+    auto state = PipelineStateUPtr(new PipelineState());
+    state->m_desc = desc;
+    return std::move(state);
+}
+
+void PipelineState::Apply() const {
+    if (m_desc.program)
+        m_desc.program->Use();
+    GLState::SetBlend(m_desc.blend);
+    if (m_desc.blend)
+        GLState::SetBlendFunc(m_desc.blendSrc, m_desc.blendDst);
+    GLState::SetDepthTest(m_desc.depthTest);
+    if (m_desc.depthTest)
+        GLState::SetDepthFunc(m_desc.depthFunc);
+    GLState::SetDepthWrite(m_desc.depthWrite);
+    GLState::SetCullFace(m_desc.cullFace);
+    if (m_desc.cullFace)
+        GLState::SetCullMode(m_desc.cullMode);
+}
@@ -0,0 +1,68 @@
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+#include "common.h"
+
+class Program;
+
+// Shadow copy of the GL state this renderer touches.
+// Every setter compares against the cached value and only issues the
+// GL call when the value changes, counting the calls it skipped.
+// Code that changes GL state behind its back must call Invalidate().
+class GLState {
+public:
+    static void Invalidate();
+
+    static void UseProgram(uint32_t program);
+    static void ActiveTexture(uint32_t unit);
+    static void BindTexture(uint32_t target, uint32_t texture);
+    static void BindFramebuffer(uint32_t framebuffer);
+    static void BindVertexArray(uint32_t vertexArray);
+
+    static void SetBlend(bool enable);
+    static void SetBlendFunc(uint32_t src, uint32_t dst);
+    static void SetDepthTest(bool enable);
+    static void SetDepthFunc(uint32_t func);
+    static void SetDepthWrite(bool enable);
+    static void SetCullFace(bool enable);
+    static void SetCullMode(uint32_t mode);
+    static void SetScissorTest(bool enable);
+
+    // deleted GL names can be reused, so their cached bindings must be dropped
+    static void OnProgramDeleted(uint32_t program);
+    static void OnTextureDeleted(uint32_t texture);
+    static void OnFramebufferDeleted(uint32_t framebuffer);
+    static void OnVertexArrayDeleted(uint32_t vertexArray);
+
+    static uint64_t GetIssuedCount();
+    static uint64_t GetSkippedCount();
+    static void ResetCounters();
+};
+
+struct PipelineStateDesc {
+    const Program* program { nullptr };
+    bool blend { false };
+    uint32_t blendSrc { GL_SRC_ALPHA };
+    uint32_t blendDst { GL_ONE_MINUS_SRC_ALPHA };
+    bool depthTest { true };
+    uint32_t depthFunc { GL_LESS };
+    bool depthWrite { true };
+    bool cullFace { false };
+    uint32_t cullMode { GL_BACK };
+};
+
+// immutable program + fixed function state of a pass, applied through GLState
+CLASS_PTR(PipelineState)
+class PipelineState {
+public:
+    static PipelineStateUPtr Create(const PipelineStateDesc& desc);
+
+    const PipelineStateDesc& GetDesc() const { return m_desc; }
+    void Apply() const;
+
+private:
+    PipelineState() {}
+    PipelineStateDesc m_desc;
+};
+
+#endif // __GL_STATE_H__
@@ -0,0 +1,143 @@
+#include "gpu_profiler.h"
+#include "trace.h"
+#include <algorithm>
+
+GpuProfilerUPtr GpuProfiler::Create(int frameLatency) {
+    auto profiler = GpuProfilerUPtr(new GpuProfiler());
+    profiler->Init(frameLatency);
+    return std::move(profiler);
+}
+
+GpuProfiler::~GpuProfiler() {
+    for (auto& frame: m_frames) {
+        for (auto& pass: frame.passes) {
+            glDeleteQueries(1, &pass.timeQuery);
+            glDeleteQueries(1, &pass.startQuery);
+            if (pass.statQuery)
+                glDeleteQueries(1, &pass.statQuery);
+        }
+    }
+}
+
+void GpuProfiler::Init(int frameLatency) {
+    m_frames.resize(std::max(frameLatency, 2));
+    m_pipelineStatistics = GLAD_GL_ARB_pipeline_statistics_query != 0;
+    SPDLOG_INFO("gpu profiler: {} frames latency, pipeline statistics: {}",
+        m_frames.size(), m_pipelineStatistics ? "on" : "off");
+}
+
+void GpuProfiler::BeginFrame() {
+    auto& frame = m_frames[m_frameIndex];
+    // the slot was issued frameLatency frames ago, its results should be ready
+    if (frame.pending && !Resolve(frame, false))
+        m_droppedFrameCount++;
+    frame.passCount = 0;
+    frame.pending = false;
+    frame.record = m_recordHistory;
+    if (Trace::IsEnabled()) {
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        frame.gpuReference = gpuTime;
+        frame.cpuReference = Trace::Now();
+    }
+    m_inFrame = true;
+}
+
+void GpuProfiler::EndFrame() {
+    if (m_inPass)
+        EndPass();
+    m_frames[m_frameIndex].pending = m_frames[m_frameIndex].passCount > 0;
+    m_frameIndex = (m_frameIndex + 1) % (int)m_frames.size();
+    m_inFrame = false;
+}
+
+void GpuProfiler::BeginPass(const char* name) {
+    if (!m_inFrame)
+        return;
+    if (m_inPass) {
+        SPDLOG_WARN("gpu profiler: pass \"{}\" begins inside another pass", name);
+        EndPass();
+    }
+
+    auto& frame = m_frames[m_frameIndex];
+    if (frame.passCount == (int)frame.passes.size()) {
+        PassQuery pass;
+        glGenQueries(1, &pass.timeQuery);
+        glGenQueries(1, &pass.startQuery);
+        if (m_pipelineStatistics)
+            glGenQueries(1, &pass.statQuery);
+        frame.passes.push_back(pass);
+    }
+    auto& pass = frame.passes[frame.passCount++];
+    pass.name = name;
+    if (Trace::IsEnabled())
+        glQueryCounter(pass.startQuery, GL_TIMESTAMP);
+    glBeginQuery(GL_TIME_ELAPSED, pass.timeQuery);
+    if (m_pipelineStatistics)
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, pass.statQuery);
+    m_inPass = true;
+}
+
+void GpuProfiler::EndPass() {
+    if (!m_inPass)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    if (m_pipelineStatistics)
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    m_inPass = false;
+}
+
+void GpuProfiler::Flush() {
+    for (size_t i = 0; i < m_frames.size(); i++) {
+        // oldest frame first so the history stays in submission order
+        auto& frame = m_frames[(m_frameIndex + i) % m_frames.size()];
+        if (frame.pending)
+            Resolve(frame, true);
+        frame.pending = false;
+    }
+}
+
+bool GpuProfiler::Resolve(FrameQueries& frame, bool wait) {
+    if (!wait) {
+        // queries complete in order, so checking the last one is enough
+        auto& last = frame.passes[frame.passCount - 1];
+        int available = 0;
+        glGetQueryObjectiv(last.timeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (m_pipelineStatistics && available)
+            glGetQueryObjectiv(last.statQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+
+    m_lastFrame.resize(frame.passCount);
+    m_lastFrameTimeMs = 0.0;
+    for (int i = 0; i < frame.passCount; i++) {
+        auto& pass = frame.passes[i];
+        auto& stat = m_lastFrame[i];
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(pass.timeQuery, GL_QUERY_RESULT, &elapsed);
+        stat.name = pass.name;
+        stat.timeMs = (double)elapsed * 1.0e-6;
+        stat.fragmentInvocations = 0;
+        if (m_pipelineStatistics) {
+            GLuint64 invocations = 0;
+            glGetQueryObjectui64v(pass.statQuery, GL_QUERY_RESULT, &invocations);
+            stat.fragmentInvocations = invocations;
+        }
+        m_lastFrameTimeMs += stat.timeMs;
+
+        if (Trace::IsEnabled() && frame.gpuReference != 0) {
+            GLuint64 start = 0;
+            glGetQueryObjectui64v(pass.startQuery, GL_QUERY_RESULT, &start);
+            auto traceStart = (uint64_t)std::max<int64_t>(
+                (int64_t)frame.cpuReference + ((int64_t)start - frame.gpuReference), 0);
+            Trace::RecordGpu(pass.name, traceStart, traceStart + elapsed);
+        }
+
+        if (frame.record) {
+            m_timeHistory[stat.name].push_back(stat.timeMs);
+            m_fragmentHistory[stat.name].push_back((double)stat.fragmentInvocations);
+        }
+    }
+    return true;
+}
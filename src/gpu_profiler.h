@@ -0,0 +1,97 @@
+#ifndef __GPU_PROFILER_H__
+#define __GPU_PROFILER_H__
+
+#include "common.h"
+#include <map>
+#include <vector>
+
+struct GpuPassStat {
+    std::string name;
+    double timeMs { 0.0 };
+    uint64_t fragmentInvocations { 0 };
+};
+
+// Measures each render pass with GL_TIME_ELAPSED queries (and fragment
+// shader invocation counts when ARB_pipeline_statistics_query exists).
+// Queries live in a ring of frames and are read back frameLatency frames
+// later, so reading results never waits for the GPU.
+// Passes must not nest. When tracing is enabled, pass start timestamps are
+// also queried and the passes are forwarded to the trace's GPU track.
+CLASS_PTR(GpuProfiler)
+class GpuProfiler {
+public:
+    static GpuProfilerUPtr Create(int frameLatency = 4);
+    ~GpuProfiler();
+
+    void BeginFrame();
+    void EndFrame();
+    void BeginPass(const char* name);
+    void EndPass();
+    // read back every frame still in flight, waiting for the GPU if needed
+    void Flush();
+
+    bool HasPipelineStatistics() const { return m_pipelineStatistics; }
+    const std::vector<GpuPassStat>& GetLastFrame() const { return m_lastFrame; }
+    double GetLastFrameTimeMs() const { return m_lastFrameTimeMs; }
+    int GetDroppedFrameCount() const { return m_droppedFrameCount; }
+
+    // applies to the frames begun from now on, their passes are added to
+    // the history when they are read back, frameLatency frames later
+    void SetRecordHistory(bool record) { m_recordHistory = record; }
+    const std::map<std::string, std::vector<double>>& GetTimeHistory() const { return m_timeHistory; }
+    const std::map<std::string, std::vector<double>>& GetFragmentHistory() const { return m_fragmentHistory; }
+
+private:
+    struct PassQuery {
+        const char* name { nullptr };
+        uint32_t timeQuery { 0 };
+        uint32_t statQuery { 0 };
+        uint32_t startQuery { 0 };
+    };
+    struct FrameQueries {
+        std::vector<PassQuery> passes;
+        int passCount { 0 };
+        bool pending { false };
+        // recording was on when the frame was issued
+        bool record { false };
+        // GL and trace clocks sampled at the frame start, to place GPU passes on the trace
+        int64_t gpuReference { 0 };
+        uint64_t cpuReference { 0 };
+    };
+
+    GpuProfiler() {}
+    void Init(int frameLatency);
+    bool Resolve(FrameQueries& frame, bool wait);
+
+    std::vector<FrameQueries> m_frames;
+    int m_frameIndex { 0 };
+    bool m_inFrame { false };
+    bool m_inPass { false };
+    bool m_pipelineStatistics { false };
+
+    std::vector<GpuPassStat> m_lastFrame;
+    double m_lastFrameTimeMs { 0.0 };
+    int m_droppedFrameCount { 0 };
+
+    bool m_recordHistory { false };
+    std::map<std::string, std::vector<double>> m_timeHistory;
+    std::map<std::string, std::vector<double>> m_fragmentHistory;
+};
+
+// begins a pass in the constructor and ends it in the destructor
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuProfiler* profiler, const char* name) : m_profiler(profiler) {
+        if (m_profiler)
+            m_profiler->BeginPass(name);
+    }
+    ~GpuProfileScope() {
+        if (m_profiler)
+            m_profiler->EndPass();
+    }
+
+private:
+    GpuProfiler* m_profiler;
+};
+
+#endif // __GPU_PROFILER_H__
@@ -0,0 +1,135 @@
+#include "headless_context.h"
+
+HeadlessContextUPtr HeadlessContext::Create(int width, int height) {
+    auto context = HeadlessContextUPtr(new HeadlessContext());
+    if (!context->Init(width, height))
+        return nullptr;
+    return std::move(context);
+}
+
+HeadlessContext::~HeadlessContext() {
+    Framebuffer::SetDefault(nullptr);
+    m_framebuffer.reset();
+#ifdef SHADERPIXEL_USE_EGL
+    if (m_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+    }
+#else
+    if (m_window) {
+        glfwDestroyWindow(m_window);
+        glfwTerminate();
+    }
+#endif
+}
+
+bool HeadlessContext::Init(int width, int height) {
+    m_width = width;
+    m_height = height;
+    if (!CreateGLContext())
+        return false;
+
+    auto glVersion = glGetString(GL_VERSION);
+    auto glRenderer = glGetString(GL_RENDERER);
+    SPDLOG_INFO("headless OpenGL context version: {}, renderer: {}",
+        reinterpret_cast<const char*>(glVersion),
+        reinterpret_cast<const char*>(glRenderer));
+
+    m_framebuffer = Framebuffer::Create({Texture::Create(m_width, m_height, GL_RGBA)});
+    if (!m_framebuffer)
+        return false;
+    Framebuffer::SetDefault(m_framebuffer.get());
+    Framebuffer::BindToDefault();
+    return true;
+}
+
+#ifdef SHADERPIXEL_USE_EGL
+bool HeadlessContext::CreateGLContext() {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (m_display == EGL_NO_DISPLAY)
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+        SPDLOG_ERROR("failed to initialize egl display");
+        return false;
+    }
+    SPDLOG_INFO("EGL version: {}.{}", major, minor);
+
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(m_display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        SPDLOG_ERROR("failed to choose egl config");
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        SPDLOG_ERROR("failed to bind OpenGL api to egl");
+        return false;
+    }
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (m_context == EGL_NO_CONTEXT) {
+        SPDLOG_ERROR("failed to create egl context: 0x{:04x}", eglGetError());
+        return false;
+    }
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        SPDLOG_ERROR("failed to make surfaceless egl context current: 0x{:04x}", eglGetError());
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        SPDLOG_ERROR("failed to initialize glad");
+        return false;
+    }
+    return true;
+}
+#else
+bool HeadlessContext::CreateGLContext() {
+    if (!glfwInit()) {
+        const char* description = nullptr;
+        glfwGetError(&description);
+        SPDLOG_ERROR("failed to initialize glfw: {}", description);
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    m_window = glfwCreateWindow(m_width, m_height, WINDOW_NAME, nullptr, nullptr);
+    if (!m_window) {
+        SPDLOG_ERROR("failed to create hidden glfw window");
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(m_window);
+    glfwSwapInterval(0);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        SPDLOG_ERROR("failed to initialize glad");
+        return false;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,42 @@
+#ifndef __HEADLESS_CONTEXT_H__
+#define __HEADLESS_CONTEXT_H__
+
+#include "common.h"
+#include "framebuffer.h"
+
+#ifdef SHADERPIXEL_USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// OpenGL context without a visible window, used by the benchmark mode.
+// Uses a surfaceless EGL context when available (Mesa llvmpipe works),
+// otherwise falls back to an invisible glfw window.
+// Rendering goes to an offscreen framebuffer that replaces the default one.
+CLASS_PTR(HeadlessContext)
+class HeadlessContext {
+public:
+    static HeadlessContextUPtr Create(int width, int height);
+    ~HeadlessContext();
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    const Framebuffer* GetFramebuffer() const { return m_framebuffer.get(); }
+
+private:
+    HeadlessContext() {}
+    bool Init(int width, int height);
+    bool CreateGLContext();
+
+    int m_width { 0 };
+    int m_height { 0 };
+    FramebufferUPtr m_framebuffer;
+#ifdef SHADERPIXEL_USE_EGL
+    EGLDisplay m_display { EGL_NO_DISPLAY };
+    EGLContext m_context { EGL_NO_CONTEXT };
+#else
+    GLFWwindow* m_window { nullptr };
+#endif
+};
+
+#endif // __HEADLESS_CONTEXT_H__
@@ -1,6 +1,11 @@
 #include "image.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "pixel_convert.h"
+#include "mapped_file.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#include <cmath>
 
 ImageUPtr Image::Load(const std::string& filepath, bool flipVertical) {
     auto image = ImageUPtr(new Image());
@@ -37,7 +42,9 @@ bool Image::Allocate(int width, int height, int channelCount, int bytePerChannel
     m_height = height;
     m_channelCount = channelCount;
     m_bytePerChannel = bytePerChannel;
-    m_data = (uint8_t*)malloc(m_width * m_height * m_channelCount * m_bytePerChannel);
+    m_storage = bytePerChannel == 4 ? IMAGE_STORAGE_FLOAT :
+        bytePerChannel == 2 ? IMAGE_STORAGE_HALF : IMAGE_STORAGE_UINT8;
+    m_data = (uint8_t*)malloc((size_t)m_width * m_height * m_channelCount * m_bytePerChannel);
     return m_data ? true : false;
 }
 
@@ -48,17 +55,20 @@ Image::~Image() {
 }
 
 bool Image::LoadWithStb(const std::string& filepath, bool flipVertical) {
+    TRACE_SCOPE("Image::LoadWithStb");
     stbi_set_flip_vertically_on_load(flipVertical);
     auto ext = filepath.substr(filepath.find_last_of('.'));
     if (ext == ".hdr" || ext == ".HDR") {
         m_data = (uint8_t*)stbi_loadf(filepath.c_str(),
         &m_width, &m_height, &m_channelCount, 0);
         m_bytePerChannel = 4;
+        m_storage = IMAGE_STORAGE_FLOAT;
     }
     else {
         m_data = stbi_load(filepath.c_str(),
         &m_width, &m_height, &m_channelCount, 0);
         m_bytePerChannel = 1;
+        m_storage = IMAGE_STORAGE_UINT8;
     }
     if (!m_data) {
         SPDLOG_ERROR("failed to load image: {}", filepath);
@@ -67,6 +77,58 @@ bool Image::LoadWithStb(const std::string& filepath, bool flipVertical) {
     return true;
 }
 
+int Image::GetBytePerPixel() const {
+    return m_storage == IMAGE_STORAGE_RGB9E5 ? 4 : m_channelCount * m_bytePerChannel;
+}
+
+bool Image::ConvertStorage(ImageStorage storage, ThreadPool* threadPool) {
+    TRACE_SCOPE("Image::ConvertStorage");
+    if (storage == m_storage)
+        return true;
+    if (m_storage != IMAGE_STORAGE_FLOAT ||
+        (storage != IMAGE_STORAGE_HALF && storage != IMAGE_STORAGE_RGB9E5) ||
+        (storage == IMAGE_STORAGE_RGB9E5 && m_channelCount < 3)) {
+        SPDLOG_ERROR("unsupported image storage conversion: {} -> {}", (int)m_storage, (int)storage);
+        return false;
+    }
+
+    size_t pixelCount = (size_t)m_width * m_height;
+    size_t dstPixelSize = storage == IMAGE_STORAGE_HALF ? m_channelCount * 2 : 4;
+    auto dst = (uint8_t*)malloc(pixelCount * dstPixelSize);
+    if (!dst)
+        return false;
+
+    auto src = (const float*)m_data;
+    int channelCount = m_channelCount;
+    auto convert = [&](size_t begin, size_t end, int) {
+        if (storage == IMAGE_STORAGE_HALF) {
+            ConvertFloatToHalf(src + begin * channelCount,
+                (uint16_t*)dst + begin * channelCount, (end - begin) * channelCount);
+        }
+        else {
+            ConvertFloatToRGB9E5(src + begin * channelCount, channelCount,
+                (uint32_t*)dst + begin, end - begin);
+        }
+    };
+    const size_t grainSize = 1 << 16;
+    if (threadPool)
+        threadPool->ParallelFor(pixelCount, grainSize, convert);
+    else
+        convert(0, pixelCount, 0);
+
+    stbi_image_free(m_data);
+    m_data = dst;
+    m_storage = storage;
+    if (storage == IMAGE_STORAGE_HALF) {
+        m_bytePerChannel = 2;
+    }
+    else {
+        m_channelCount = 3;
+        m_bytePerChannel = 0;
+    }
+    return true;
+}
+
 void Image::SetCheckImage(int gridX, int gridY) {
     for (int j = 0; j < m_height; j++) {
         for (int i = 0; i < m_width; i++) {
@@ -79,4 +141,219 @@ void Image::SetCheckImage(int gridX, int gridY) {
                 m_data[3] = 255;
         }
     }
-}
\ No newline at end of file
+}
+namespace {
+
+// header lines up to and including the resolution line
+template <typename ReadLineFunc>
+bool ParseHdrHeader(ReadLineFunc&& readLine, int& width, int& height) {
+    std::string line;
+    if (!readLine(line) || (line != "#?RADIANCE" && line != "#?RGBE"))
+        return false;
+    bool rgbe = false;
+    while (readLine(line) && !line.empty()) {
+        if (line == "FORMAT=32-bit_rle_rgbe")
+            rgbe = true;
+    }
+    // only the common -Y height +X width orientation, like stb_image
+    char yAxis[3], xAxis[3];
+    return rgbe && readLine(line) &&
+        sscanf(line.c_str(), "%2s %d %2s %d", yAxis, &height, xAxis, &width) == 4 &&
+        strcmp(yAxis, "-Y") == 0 && strcmp(xAxis, "+X") == 0 &&
+        width > 0 && height > 0;
+}
+
+// largest encoded scanline: RLE packets of one byte take two bytes
+size_t GetMaxScanlineSize(int width) {
+    return (size_t)width * 8 + 4;
+}
+
+// decodes one scanline into rgbe (or only skips it when rgbe is nullptr),
+// returns the start of the next scanline or nullptr when the data is corrupted
+const uint8_t* DecodeRgbeScanline(const uint8_t* src, const uint8_t* end, int width, uint8_t* rgbe) {
+    bool flat = width < 8 || width >= 0x8000 || end - src < 4 ||
+        src[0] != 2 || src[1] != 2 || (src[2] & 0x80);
+    if (flat) {
+        size_t size = (size_t)width * 4;
+        if ((size_t)(end - src) < size)
+            return nullptr;
+        if (rgbe)
+            memcpy(rgbe, src, size);
+        return src + size;
+    }
+    if (((src[2] << 8) | src[3]) != width)
+        return nullptr;
+    src += 4;
+    // new style RLE: the four components of the scanline stored one after another
+    for (int component = 0; component < 4; component++) {
+        int x = 0;
+        while (x < width) {
+            if (src == end)
+                return nullptr;
+            int count = *src++;
+            if (count > 128) {
+                count -= 128;
+                if (x + count > width || src == end)
+                    return nullptr;
+                uint8_t value = *src++;
+                if (rgbe) {
+                    for (int i = 0; i < count; i++)
+                        rgbe[(x + i) * 4 + component] = value;
+                }
+            }
+            else {
+                if (count == 0 || x + count > width || end - src < count)
+                    return nullptr;
+                if (rgbe) {
+                    for (int i = 0; i < count; i++)
+                        rgbe[(x + i) * 4 + component] = src[i];
+                }
+                src += count;
+            }
+            x += count;
+        }
+    }
+    return src;
+}
+
+} // namespace
+
+ImageUPtr Image::LoadHdr(const std::string& filepath, ThreadPool* threadPool,
+    bool flipVertical, ImageStorage storage) {
+    TRACE_SCOPE("Image::LoadHdr");
+    if (storage != IMAGE_STORAGE_FLOAT && storage != IMAGE_STORAGE_HALF)
+        return nullptr;
+    auto file = MappedFile::Open(filepath);
+    if (!file) {
+        SPDLOG_ERROR("failed to open file: {}", filepath);
+        return nullptr;
+    }
+    auto fileEnd = file->GetData() + file->GetSize();
+    auto cursor = file->GetData();
+    auto readLine = [&](std::string& line) {
+        auto lineEnd = (const uint8_t*)memchr(cursor, '\n', fileEnd - cursor);
+        if (!lineEnd)
+            return false;
+        line.assign((const char*)cursor, lineEnd - cursor);
+        cursor = lineEnd + 1;
+        return true;
+    };
+    int width, height;
+    if (!ParseHdrHeader(readLine, width, height)) {
+        SPDLOG_ERROR("unsupported hdr format: {}", filepath);
+        return nullptr;
+    }
+
+    // RLE scanlines have no index, so their offsets are found by a quick
+    // sequential pass before the rows are decoded in parallel
+    std::vector<const uint8_t*> offsets(height);
+    {
+        TRACE_SCOPE("Image::LoadHdr::ScanOffsets");
+        for (int y = 0; y < height && cursor; y++) {
+            offsets[y] = cursor;
+            cursor = DecodeRgbeScanline(cursor, fileEnd, width, nullptr);
+        }
+    }
+    if (!cursor) {
+        SPDLOG_ERROR("corrupted hdr file: {}", filepath);
+        return nullptr;
+    }
+
+    auto image = ImageUPtr(new Image());
+    if (!image->Allocate(width, height, 3, storage == IMAGE_STORAGE_HALF ? 2 : 4))
+        return nullptr;
+    size_t rowSize = (size_t)width * image->GetBytePerPixel();
+    int threadCount = threadPool ? threadPool->GetThreadCount() : 1;
+    std::vector<std::vector<uint8_t>> rgbeScratch(threadCount);
+    std::vector<std::vector<float>> floatScratch(threadCount);
+    auto decodeRows = [&](size_t begin, size_t end, int threadIndex) {
+        TRACE_SCOPE("Image::LoadHdr::DecodeRows");
+        auto& rgbe = rgbeScratch[threadIndex];
+        auto& rgb = floatScratch[threadIndex];
+        rgbe.resize((size_t)width * 4);
+        if (storage == IMAGE_STORAGE_HALF)
+            rgb.resize((size_t)width * 3);
+        for (size_t y = begin; y < end; y++) {
+            DecodeRgbeScanline(offsets[y], fileEnd, width, rgbe.data());
+            size_t row = flipVertical ? height - 1 - y : y;
+            auto dst = image->m_data + row * rowSize;
+            if (storage == IMAGE_STORAGE_HALF) {
+                ConvertRgbeToFloat(rgbe.data(), rgb.data(), width);
+                ConvertFloatToHalf(rgb.data(), (uint16_t*)dst, rgb.size());
+            }
+            else {
+                ConvertRgbeToFloat(rgbe.data(), (float*)dst, width);
+            }
+        }
+    };
+    if (threadPool)
+        threadPool->ParallelFor(height, 16, decodeRows);
+    else
+        decodeRows(0, height, 0);
+    return std::move(image);
+}
+
+HdrReaderUPtr HdrReader::Open(const std::string& filepath) {
+    auto reader = HdrReaderUPtr(new HdrReader());
+    if (!reader->Init(filepath))
+        return nullptr;
+    return std::move(reader);
+}
+
+bool HdrReader::Init(const std::string& filepath) {
+    m_file.open(filepath, std::ios::binary);
+    if (!m_file.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", filepath);
+        return false;
+    }
+    m_buffer.resize(1 << 20);
+
+    auto readLine = [this](std::string& line) { return ReadLine(line); };
+    if (!ParseHdrHeader(readLine, m_width, m_height)) {
+        SPDLOG_ERROR("unsupported hdr format: {}", filepath);
+        return false;
+    }
+    m_buffer.resize(std::max(m_buffer.size(), GetMaxScanlineSize(m_width)));
+    m_scanline.resize((size_t)m_width * 4);
+    return true;
+}
+
+bool HdrReader::Fill(size_t size) {
+    if (m_bufferSize - m_bufferPos >= size || m_file.eof())
+        return m_bufferSize - m_bufferPos >= size;
+    // keep the unread tail and refill behind it
+    m_bufferSize -= m_bufferPos;
+    memmove(m_buffer.data(), m_buffer.data() + m_bufferPos, m_bufferSize);
+    m_bufferPos = 0;
+    m_file.read((char*)m_buffer.data() + m_bufferSize, m_buffer.size() - m_bufferSize);
+    m_bufferSize += (size_t)m_file.gcount();
+    return m_bufferSize >= size;
+}
+
+bool HdrReader::ReadLine(std::string& line) {
+    line.clear();
+    while (Fill(1)) {
+        char c = (char)m_buffer[m_bufferPos++];
+        if (c == '\n')
+            return true;
+        line.push_back(c);
+    }
+    return !line.empty();
+}
+
+bool HdrReader::ReadScanline(float* rgb) {
+    if (m_nextRow >= m_height)
+        return false;
+    // a short file only shows up as a decode error below
+    Fill(GetMaxScanlineSize(m_width));
+    auto src = m_buffer.data() + m_bufferPos;
+    auto next = DecodeRgbeScanline(src, m_buffer.data() + m_bufferSize, m_width, m_scanline.data());
+    if (!next) {
+        SPDLOG_ERROR("corrupted hdr scanline: {}", m_nextRow);
+        return false;
+    }
+    m_bufferPos += next - src;
+    ConvertRgbeToFloat(m_scanline.data(), rgb, m_width);
+    m_nextRow++;
+    return true;
+}
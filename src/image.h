@@ -2,21 +2,42 @@
 #define __IMAGE_H__
 
 #include "common.h"
+#include <fstream>
+#include <vector>
+
+class ThreadPool;
+
+enum ImageStorage {
+    IMAGE_STORAGE_UINT8,
+    IMAGE_STORAGE_FLOAT,
+    IMAGE_STORAGE_HALF,
+    IMAGE_STORAGE_RGB9E5,   // rgb packed in 32 bits with a shared exponent
+};
 
 CLASS_PTR(Image)
 class Image {
 public:
     static ImageUPtr Load(const std::string& filepath, bool flipVertical = true);
+    // parallel Radiance .hdr decoder, float or half RGB
+    static ImageUPtr LoadHdr(const std::string& filepath, ThreadPool* threadPool,
+        bool flipVertical = true, ImageStorage storage = IMAGE_STORAGE_FLOAT);
     static ImageUPtr Create(int width, int height, int channelCount = 4, int bytePerChannel = 1);
     static ImageUPtr CreateSingleColorImage(int width, int height, const glm::vec4& color);
 
     ~Image();
 
     const uint8_t* GetData() const { return m_data; }
+    uint8_t* GetData() { return m_data; }
     int GetWidth() const { return m_width; }
     int GetHeight() const { return m_height; }
     int GetChannelCount() const { return m_channelCount; }
+    // 0 for packed storage (RGB9E5)
     int GetBytePerChannel() const { return m_bytePerChannel; }
+    int GetBytePerPixel() const;
+    ImageStorage GetStorage() const { return m_storage; }
+
+    // converts float pixels to half or RGB9E5 (rgb only), split across the thread pool
+    bool ConvertStorage(ImageStorage storage, ThreadPool* threadPool = nullptr);
 
     void SetCheckImage(int gridX, int gridY);
 
@@ -29,7 +50,40 @@ private:
     int m_height { 0 };
     int m_channelCount { 0 };
     int m_bytePerChannel { 1 };
+    ImageStorage m_storage { IMAGE_STORAGE_UINT8 };
     uint8_t* m_data { nullptr };
 };
 
+// Radiance .hdr (RGBE) file decoded one scanline at a time through a small
+// read buffer, so the float image never has to be in memory as a whole.
+// Scanlines come in file order, top row first.
+CLASS_PTR(HdrReader)
+class HdrReader {
+public:
+    static HdrReaderUPtr Open(const std::string& filepath);
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    int GetNextRow() const { return m_nextRow; }
+
+    // decodes the next scanline as width * 3 floats
+    bool ReadScanline(float* rgb);
+
+private:
+    HdrReader() {}
+    bool Init(const std::string& filepath);
+    // makes at least size unread bytes available unless the file ends first
+    bool Fill(size_t size);
+    bool ReadLine(std::string& line);
+
+    std::ifstream m_file;
+    std::vector<uint8_t> m_buffer;
+    size_t m_bufferPos { 0 };
+    size_t m_bufferSize { 0 };
+    std::vector<uint8_t> m_scanline;
+    int m_width { 0 };
+    int m_height { 0 };
+    int m_nextRow { 0 };
+};
+
 #endif // __IMAGE_H__
\ No newline at end of file
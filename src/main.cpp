@@ -2,6 +2,11 @@
 #include "shader.h"
 #include "program.h"
 #include "context.h"
+#include "headless_context.h"
+#include "benchmark.h"
+#include "trace.h"
+#include "cubemap_cache.h"
+#include "equirect_converter.h"
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
@@ -48,9 +53,172 @@ void OnScroll(GLFWwindow* window, double xoffset, double yoffset) {
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
 }
 
-int main() {
+bool ParseArgs(int argc, char** argv, BenchmarkConfig& config, std::string& tracePath,
+    bool& bakeCubemaps, bool& checkCubemaps) {
+    bool benchmark = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark") {
+            benchmark = true;
+            if (hasValue && argv[i + 1][0] != '-')
+                config.frameCount = std::stoi(argv[++i]);
+        }
+        else if (arg == "--warmup" && hasValue)
+            config.warmupFrameCount = std::stoi(argv[++i]);
+        else if (arg == "--width" && hasValue)
+            config.width = std::stoi(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            config.height = std::stoi(argv[++i]);
+        else if (arg == "--time-step" && hasValue)
+            config.timeStep = std::stof(argv[++i]);
+        else if (arg == "--output" && hasValue)
+            config.outputPath = argv[++i];
+        else if (arg == "--no-lod")
+            config.meshLod = false;
+        else if (arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if (arg == "--bake-cubemaps")
+            bakeCubemaps = true;
+        else if (arg == "--check-cubemaps")
+            checkCubemaps = true;
+        else if (arg == "--hdr-benchmark" && hasValue)
+            config.hdrPath = argv[++i];
+        else if (arg == "--obj-benchmark" && hasValue)
+            config.objPath = argv[++i];
+        else if (arg == "--repeat" && hasValue)
+            config.repeatCount = std::stoi(argv[++i]);
+        else
+            SPDLOG_WARN("unknown argument: {}", arg);
+    }
+    return benchmark;
+}
+
+int RunBenchmark(const BenchmarkConfig& config) {
+    // 윈도우 없이 offscreen context 생성
+    auto headlessContext = HeadlessContext::Create(config.width, config.height);
+    if (!headlessContext) {
+        SPDLOG_ERROR("failed to create headless context");
+        return -1;
+    }
+
+    // backend 없이 ImGui 사용, draw data는 그리지 않음
+    auto imguiContext = ImGui::CreateContext();
+    ImGui::SetCurrentContext(imguiContext);
+    ImGui::GetIO().Fonts->Build();
+
+    int result = 0;
+    {
+        auto context = Context::Create();
+        if (!context) {
+            SPDLOG_ERROR("failed to create context");
+            result = -1;
+        }
+        else {
+            auto benchmark = Benchmark::Create(config);
+            benchmark->Run(context.get());
+            if (!benchmark->WriteJson(config.outputPath))
+                result = -1;
+        }
+    }
+
+    ImGui::DestroyContext(imguiContext);
+    return result;
+}
+
+int RunCubemapBake() {
+    // GL context 없이 CPU로 큐브맵을 구워 캐시에 저장
+    auto cache = CubemapCache::Create(CUBEMAP_CACHE_DIRECTORY);
+    if (!cache)
+        return -1;
+    auto threadPool = ThreadPool::Create();
+    for (auto filename: { SKY_HDR_FILENAME, ANOTHER_WORLD_HDR_FILENAME }) {
+        CubemapCacheKey key;
+        key.source = filename;
+        key.faceSize = HDR_CUBE_MAP_SIZE;
+        key.internalFormat = GL_RGB16F;
+        if (cache->Contains(key)) {
+            SPDLOG_INFO("cubemap already cached: {}", filename);
+            continue;
+        }
+        auto image = Image::LoadHdr(filename, threadPool.get());
+        if (!image)
+            return -1;
+        auto faces = EquirectConverter::Convert(image.get(), key.faceSize, threadPool.get());
+        if (faces.empty() || !cache->Store(key, faces))
+            return -1;
+    }
+    return 0;
+}
+
+int RunCubemapCheck() {
+    // CPU 변환기 결과를 GPU bake와 비교, 윈도우 없이 offscreen context 사용
+    auto headlessContext = HeadlessContext::Create(WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!headlessContext) {
+        SPDLOG_ERROR("failed to create headless context");
+        return -1;
+    }
+    auto imguiContext = ImGui::CreateContext();
+    ImGui::SetCurrentContext(imguiContext);
+    ImGui::GetIO().Fonts->Build();
+
+    int result = 0;
+    {
+        auto context = Context::Create();
+        if (!context) {
+            SPDLOG_ERROR("failed to create context");
+            result = -1;
+        }
+        else {
+            for (auto filename: { SKY_HDR_FILENAME, ANOTHER_WORLD_HDR_FILENAME }) {
+                if (!context->CheckHdrCubeMapBake(filename, HDR_CUBE_MAP_SIZE))
+                    result = -1;
+            }
+        }
+    }
+
+    ImGui::DestroyContext(imguiContext);
+    return result;
+}
+
+int main(int argc, char** argv) {
     SPDLOG_INFO("Start program");
 
+    BenchmarkConfig benchmarkConfig;
+    std::string tracePath;
+    bool bakeCubemaps = false;
+    bool checkCubemaps = false;
+    bool benchmark = ParseArgs(argc, argv, benchmarkConfig, tracePath, bakeCubemaps, checkCubemaps);
+    if (!tracePath.empty()) {
+        Trace::Enable();
+        Trace::SetThreadName("main");
+    }
+    if (bakeCubemaps) {
+        int result = RunCubemapBake();
+        Trace::Dump(tracePath);
+        return result;
+    }
+    if (checkCubemaps) {
+        int result = RunCubemapCheck();
+        Trace::Dump(tracePath);
+        return result;
+    }
+    if (!benchmarkConfig.hdrPath.empty()) {
+        int result = Benchmark::RunHdrDecode(benchmarkConfig) ? 0 : -1;
+        Trace::Dump(tracePath);
+        return result;
+    }
+    if (!benchmarkConfig.objPath.empty()) {
+        int result = Benchmark::RunObjLoad(benchmarkConfig) ? 0 : -1;
+        Trace::Dump(tracePath);
+        return result;
+    }
+    if (benchmark) {
+        int result = RunBenchmark(benchmarkConfig);
+        Trace::Dump(tracePath);
+        return result;
+    }
+
     // glfw 라이브러리 초기화, 실패하면 에러 출력후 종료
     SPDLOG_INFO("Initialize glfw");
     if (!glfwInit()) {
@@ -112,6 +280,7 @@ int main() {
     // glfw 루프 실행, 윈도우 close 버튼을 누르면 정상 종료
     SPDLOG_INFO("Start main loop");
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("Frame");
         glfwPollEvents();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -121,6 +290,7 @@ int main() {
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        TRACE_SCOPE("SwapBuffers");
         glfwSwapBuffers(window);
     }
     context.reset();
@@ -132,5 +302,6 @@ int main() {
     ImGui::DestroyContext(imguiContext);
 
     glfwTerminate();
+    Trace::Dump(tracePath);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFileUPtr MappedFile::Open(const std::string& filename) {
+    auto file = MappedFileUPtr(new MappedFile());
+    if (!file->Map(filename))
+        return nullptr;
+    return std::move(file);
+}
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle((HANDLE)m_mapping);
+    if (m_file && m_file != INVALID_HANDLE_VALUE)
+        CloseHandle((HANDLE)m_file);
+}
+
+bool MappedFile::Map(const std::string& filename) {
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx((HANDLE)m_file, &size) || size.QuadPart == 0)
+        return false;
+    m_size = (size_t)size.QuadPart;
+    m_mapping = CreateFileMappingA((HANDLE)m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return false;
+    m_data = (const uint8_t*)MapViewOfFile((HANDLE)m_mapping, FILE_MAP_READ, 0, 0, 0);
+    return m_data != nullptr;
+}
+
+#else
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        munmap((void*)m_data, m_size);
+    if (m_file >= 0)
+        close(m_file);
+}
+
+bool MappedFile::Map(const std::string& filename) {
+    m_file = open(filename.c_str(), O_RDONLY);
+    if (m_file < 0)
+        return false;
+    struct stat info;
+    if (fstat(m_file, &info) != 0 || info.st_size == 0)
+        return false;
+    m_size = (size_t)info.st_size;
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = (const uint8_t*)data;
+    return true;
+}
+
+#endif
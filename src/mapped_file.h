@@ -0,0 +1,30 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include "common.h"
+
+// read-only memory mapping of a whole file
+CLASS_PTR(MappedFile)
+class MappedFile {
+public:
+    static MappedFileUPtr Open(const std::string& filename);
+    ~MappedFile();
+
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    MappedFile() {}
+    bool Map(const std::string& filename);
+
+    const uint8_t* m_data { nullptr };
+    size_t m_size { 0 };
+#ifdef _WIN32
+    void* m_file { nullptr };
+    void* m_mapping { nullptr };
+#else
+    int m_file { -1 };
+#endif
+};
+
+#endif // __MAPPED_FILE_H__
@@ -1,41 +1,144 @@
 #include "mesh.h"
+#include "gl_state.h"
+#include "mesh_optimizer.h"
+#include "tangent_generator.h"
 
 MeshUPtr Mesh::Create(
     const std::vector<Vertex>& vertices,
     const std::vector<uint32_t>& indices,
-    uint32_t primitiveType) {
+    uint32_t primitiveType,
+    VertexFormat vertexFormat,
+    bool positionStream,
+    ThreadPool* threadPool) {
     if (primitiveType == GL_TRIANGLES) {
-        ComputeTangents(const_cast<std::vector<Vertex>&>(vertices), indices);
+        TangentGenerator::Generate(const_cast<Vertex*>(vertices.data()), vertices.size(),
+            indices.data(), indices.size(), threadPool);
     }
+    return Create(vertices.data(), vertices.size(), indices.data(), indices.size(),
+        primitiveType, vertexFormat, positionStream);
+}
+
+MeshUPtr Mesh::Create(
+    const Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount,
+    uint32_t primitiveType,
+    VertexFormat vertexFormat,
+    bool positionStream,
+    const VertexBounds* bounds) {
     auto mesh = MeshUPtr(new Mesh());
-    mesh->Init(vertices, indices, primitiveType);
+    mesh->Init(vertices, vertexCount, indices, indexCount, primitiveType, vertexFormat,
+        positionStream, bounds);
     return std::move(mesh);
 }
 
-void Mesh::Init(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t primitiveType) {
-    m_vertexLayout = VertexLayout::Create();
-    m_vertexBuffer = Buffer::CreateWithData(
-        GL_ARRAY_BUFFER, GL_STATIC_DRAW,
-        vertices.data(), sizeof(Vertex), vertices.size());
-    m_indexBuffer = Buffer::CreateWithData(
-        GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW,
-        indices.data(), sizeof(uint32_t), indices.size());
-    m_vertexLayout->SetAttrib(0, 3, GL_FLOAT, false,
-        sizeof(Vertex), 0);
-    m_vertexLayout->SetAttrib(1, 3, GL_FLOAT, false,
-        sizeof(Vertex), offsetof(Vertex, normal));
-    m_vertexLayout->SetAttrib(2, 2, GL_FLOAT, false,
-        sizeof(Vertex), offsetof(Vertex, texCoord));
-    m_vertexLayout->SetAttrib(3, 3, GL_FLOAT, false,
-        sizeof(Vertex), offsetof(Vertex, tangent));
+Mesh::~Mesh() {
+    if (m_arena)
+        m_arena->Free(m_allocation);
+}
+
+void Mesh::Init(
+    const Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount,
+    uint32_t primitiveType, VertexFormat vertexFormat, bool positionStream,
+    const VertexBounds* bounds) {
+    m_primitiveType = primitiveType;
+    m_vertexFormat = vertexFormat;
+    PackedVertices packed;
+    const void* vertexData = vertices;
+    if (vertexFormat != VERTEX_FORMAT_FLOAT) {
+        packed = VertexPacker::Pack(vertexFormat, vertices, vertexCount, bounds);
+        m_positionScale = packed.positionScale;
+        m_positionOffset = packed.positionOffset;
+        vertexData = packed.data.data();
+    }
+    PackedVertices positions;
+    if (positionStream)
+        positions = VertexPacker::PackPositions(vertexFormat, vertices, vertexCount, bounds);
+
+    std::vector<uint16_t> shortIndices;
+    const void* indexData = indices;
+    uint32_t indexType = GL_UNSIGNED_INT;
+    if (vertexCount <= 0x10000) {
+        shortIndices.assign(indices, indices + indexCount);
+        indexData = shortIndices.data();
+        indexType = GL_UNSIGNED_SHORT;
+    }
+
+    m_arena = GeometryArena::Get(vertexFormat);
+    m_allocation = m_arena->Allocate(vertexData, positionStream ? positions.data.data() : nullptr,
+        (uint32_t)vertexCount, indexData, indexType, (uint32_t)indexCount);
+    m_lods.assign(1, MeshLod { 0, (uint32_t)indexCount, 0.0f });
+}
+
+void Mesh::SetLods(const MeshLod* lods, int lodCount) {
+    for (int i = 0; i < lodCount; i++) {
+        if ((uint64_t)lods[i].firstIndex + lods[i].indexCount > m_allocation.indexCount) {
+            SPDLOG_ERROR("mesh lod {} out of the index range", i);
+            return;
+        }
+    }
+    if (lodCount > 0)
+        m_lods.assign(lods, lods + lodCount);
 }
 
 void Mesh::Draw(const Program* program) const {
-  m_vertexLayout->Bind();
+  m_arena->Bind(nullptr);
   if (m_material) {
     m_material->SetToProgram(program);
   }
-  glDrawElements(m_primitiveType, m_indexBuffer->GetCount(), GL_UNSIGNED_INT, 0);
+  SetPositionTransform(program);
+  glDrawElementsBaseVertex(m_primitiveType, m_lods[0].indexCount, m_allocation.indexType,
+    m_allocation.GetIndexOffset(), m_allocation.baseVertex);
+}
+
+void Mesh::SetPositionTransform(const Program* program) const {
+    // declared by the programs that draw quantized meshes, every other
+    // mesh they draw sets the identity
+    if (program->HasUniform("uPositionScale")) {
+        program->SetUniform("uPositionScale", m_positionScale);
+        program->SetUniform("uPositionOffset", m_positionOffset);
+    }
+}
+
+void Mesh::SetInstanceBuffer(BufferPtr instanceBuffer) {
+    m_instanceBuffer = instanceBuffer;
+}
+
+void Mesh::DrawInstanced(const Program* program, int instanceCount) const {
+    if (!m_instanceBuffer) {
+        SPDLOG_ERROR("instanced draw without an instance buffer");
+        return;
+    }
+    m_arena->Bind(m_instanceBuffer.get());
+    if (m_material) {
+        m_material->SetToProgram(program);
+    }
+    SetPositionTransform(program);
+    glDrawElementsInstancedBaseVertex(m_primitiveType, m_lods[0].indexCount,
+        m_allocation.indexType, m_allocation.GetIndexOffset(), instanceCount, m_allocation.baseVertex);
+}
+
+void Mesh::DrawPositions(const Program* program) const {
+    // attribute 0 of the full layout is the same position
+    bool positionsOnly = HasPositionStream();
+    m_arena->Bind(nullptr, positionsOnly);
+    SetPositionTransform(program);
+    glDrawElementsBaseVertex(m_primitiveType, m_lods[0].indexCount, m_allocation.indexType,
+        m_allocation.GetIndexOffset(),
+        positionsOnly ? m_allocation.positionBaseVertex : m_allocation.baseVertex);
+}
+
+void Mesh::DrawPositionsInstanced(const Program* program, int instanceCount) const {
+    if (!m_instanceBuffer) {
+        SPDLOG_ERROR("instanced draw without an instance buffer");
+        return;
+    }
+    bool positionsOnly = HasPositionStream();
+    m_arena->Bind(m_instanceBuffer.get(), positionsOnly);
+    SetPositionTransform(program);
+    glDrawElementsInstancedBaseVertex(m_primitiveType, m_lods[0].indexCount,
+        m_allocation.indexType, m_allocation.GetIndexOffset(), instanceCount,
+        positionsOnly ? m_allocation.positionBaseVertex : m_allocation.baseVertex);
 }
 
 MeshUPtr Mesh::CreateBox() {
@@ -80,7 +183,7 @@ MeshUPtr Mesh::CreateBox() {
         20, 22, 21, 22, 20, 23,
     };
 
-    return Create(vertices, indices, GL_TRIANGLES);
+    return Create(vertices, indices, GL_TRIANGLES, VERTEX_FORMAT_PACKED, true);
 }
 
 MeshUPtr Mesh::CreatePlane() {
@@ -118,7 +221,7 @@ MeshUPtr Mesh::CreateSphere(uint32_t latiSegmentCount, uint32_t longiSegmentCoun
                 cosPhi * cosTheta, sinPhi, -cosPhi * sinTheta);
             
             vertices[i * circleVertCount + j] = Vertex {
-                point * 0.5f, point, glm::vec2(u, v), glm::vec3(0.0f)
+                point * 0.5f, point, glm::vec2(u, v), glm::vec4(0.0f)
             };
         }
     }
@@ -137,72 +240,25 @@ MeshUPtr Mesh::CreateSphere(uint32_t latiSegmentCount, uint32_t longiSegmentCoun
         }
     }
 
-    return Create(vertices, indices, GL_TRIANGLES);
+    // rows of quads are far from cache friendly
+    MeshOptimizer::Optimize(vertices, indices);
+    return Create(vertices, indices, GL_TRIANGLES, VERTEX_FORMAT_PACKED, true);
 }
 
 void Material::SetToProgram(const Program* program) const {
     int textureCount = 0;
     if (diffuse) {
-        glActiveTexture(GL_TEXTURE0 + textureCount);
+        GLState::ActiveTexture(GL_TEXTURE0 + textureCount);
         program->SetUniform("material.diffuse", textureCount);
         diffuse->Bind();
         textureCount++;
     }
     if (specular) {
-        glActiveTexture(GL_TEXTURE0 + textureCount);
+        GLState::ActiveTexture(GL_TEXTURE0 + textureCount);
         program->SetUniform("material.specular", textureCount);
         specular->Bind();
         textureCount++;
     }
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     program->SetUniform("material.shininess", shininess);
 }
-
-void Mesh::ComputeTangents(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
-    auto compute = [](
-        const glm::vec3& pos1, const glm::vec3& pos2, const glm::vec3& pos3,
-        const glm::vec2& uv1, const glm::vec2& uv2, const glm::vec2& uv3)
-        -> glm::vec3 {
-            auto edge1 = pos2 - pos1;
-            auto edge2 = pos3 - pos1;
-            auto deltaUV1 = uv2 - uv1;
-            auto deltaUV2 = uv3 - uv1;
-            float det = (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-            if (det != 0.0f) {
-                auto invDet = 1.0f / det;
-                return invDet * (deltaUV2.y * edge1 - deltaUV1.y * edge2);
-            }
-            else {
-                return glm::vec3(0.0f, 0.0f, 0.0f);
-            }
-    };
-
-    // initialize
-    std::vector<glm::vec3> tangents;
-    tangents.resize(vertices.size());
-    memset(tangents.data(), 0, tangents.size() * sizeof(glm::vec3));
-
-    // accumulate triangle tangents to each vertex
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        auto v1 = indices[i  ];
-        auto v2 = indices[i+1];
-        auto v3 = indices[i+2];
-
-        tangents[v1] += compute(
-            vertices[v1].position, vertices[v2].position, vertices[v3].position,
-            vertices[v1].texCoord, vertices[v2].texCoord, vertices[v3].texCoord);
-
-        tangents[v2] = compute(
-            vertices[v2].position, vertices[v3].position, vertices[v1].position,
-            vertices[v2].texCoord, vertices[v3].texCoord, vertices[v1].texCoord);
-
-        tangents[v3] = compute(
-            vertices[v3].position, vertices[v1].position, vertices[v2].position,
-            vertices[v3].texCoord, vertices[v1].texCoord, vertices[v2].texCoord);
-    }
-
-    // normalize
-    for (size_t i = 0; i < vertices.size(); i++) {
-        vertices[i].tangent = glm::normalize(tangents[i]);
-    }
-}
\ No newline at end of file
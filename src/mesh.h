@@ -3,16 +3,11 @@
 
 #include "common.h"
 #include "buffer.h"
-#include "vertex_layout.h"
+#include "vertex_format.h"
+#include "geometry_arena.h"
 #include "texture.h"
 #include "program.h"
-
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 texCoord;
-    glm::vec3 tangent;
-};
+#include "thread_pool.h"
 
 CLASS_PTR(Material);
 class Material {
@@ -28,42 +23,89 @@ private:
     Material() {}
 };
 
+// levels of detail: level 0 is the full mesh, every level after it about
+// half the triangles of the one before
+const int MAX_MESH_LOD_COUNT = 4;
+
+// one level of detail, a range of the mesh indices; error is the distance
+// (model units) the surface may move from level 0
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
 CLASS_PTR(Mesh);
 class Mesh {
 public:
     static MeshUPtr Create(
         const std::vector<Vertex>& vertices,
         const std::vector<uint32_t>& indices,
-        uint32_t primitiveType);
+        uint32_t primitiveType,
+        VertexFormat vertexFormat = VERTEX_FORMAT_PACKED,
+        bool positionStream = false,
+        ThreadPool* threadPool = nullptr);
+    // vertices come with their tangents, e.g. straight from a cooked mesh
+    static MeshUPtr Create(
+        const Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount,
+        uint32_t primitiveType,
+        VertexFormat vertexFormat = VERTEX_FORMAT_PACKED,
+        bool positionStream = false,
+        const VertexBounds* bounds = nullptr);
+    // the primitives keep a position stream, they double as raymarch proxies
     static MeshUPtr CreateBox();
     static MeshUPtr CreatePlane();
     static MeshUPtr CreateSphere(uint32_t latiSegmentCount = 16, uint32_t longiSegmentCount = 32);
     void SetMaterial(MaterialPtr material) { m_material = material; }
     MaterialPtr GetMaterial() const { return m_material; }
 
-    const VertexLayout* GetVertexLayout() const {
-        return m_vertexLayout.get();
-    }
-    BufferPtr GetVertexBuffer() const { return m_vertexBuffer; }
-    BufferPtr GetIndexBuffer() const { return m_indexBuffer; }
+    ~Mesh();
+
+    // vertices and indices live in the shared arena of the vertex format
+    GeometryArenaPtr GetArena() const { return m_arena; }
+    const GeometryAllocation& GetAllocation() const { return m_allocation; }
+    bool HasPositionStream() const { return m_allocation.positionBaseVertex != INVALID_RANGE; }
+    VertexFormat GetVertexFormat() const { return m_vertexFormat; }
+    // GL_UNSIGNED_SHORT when every vertex fits, GL_UNSIGNED_INT otherwise
+    uint32_t GetIndexType() const { return m_allocation.indexType; }
+    uint32_t GetPrimitiveType() const { return m_primitiveType; }
+    const glm::vec3& GetPositionScale() const { return m_positionScale; }
+    const glm::vec3& GetPositionOffset() const { return m_positionOffset; }
+
+    // ranges of the index buffer, a single level over every index by default
+    void SetLods(const MeshLod* lods, int lodCount);
+    int GetLodCount() const { return (int)m_lods.size(); }
+    const MeshLod& GetLod(int level) const { return m_lods[level]; }
 
     void Mesh::Draw(const Program* program) const;
-    static void ComputeTangents(
-        std::vector<Vertex>& vertices,
-        const std::vector<uint32_t>& indices);
+    // instanceBuffer holds one glm::mat4 model matrix per instance
+    void SetInstanceBuffer(BufferPtr instanceBuffer);
+    void DrawInstanced(const Program* program, int instanceCount) const;
+    // for programs that read aPos only (depth, shadow and proxy passes):
+    // binds just the position stream, no material
+    void DrawPositions(const Program* program) const;
+    void DrawPositionsInstanced(const Program* program, int instanceCount) const;
+    // uPositionScale / uPositionOffset of quantized meshes
+    void SetPositionTransform(const Program* program) const;
 
 private:
     Mesh() {}
     void Init(
-        const std::vector<Vertex>& vertices,
-        const std::vector<uint32_t>& indices,
-        uint32_t primitiveType);
+        const Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount,
+        uint32_t primitiveType, VertexFormat vertexFormat, bool positionStream,
+        const VertexBounds* bounds);
 
     MaterialPtr m_material;
     uint32_t m_primitiveType { GL_TRIANGLES };
-    VertexLayoutUPtr m_vertexLayout;
-    BufferPtr m_vertexBuffer;
-    BufferPtr m_indexBuffer;
+    VertexFormat m_vertexFormat { VERTEX_FORMAT_FLOAT };
+    glm::vec3 m_positionScale { 1.0f };
+    glm::vec3 m_positionOffset { 0.0f };
+    GeometryArenaPtr m_arena;
+    GeometryAllocation m_allocation;
+    BufferPtr m_instanceBuffer;
+    std::vector<MeshLod> m_lods;
 };
 
 #endif // __MESH_H__
\ No newline at end of file
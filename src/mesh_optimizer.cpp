@@ -0,0 +1,278 @@
+#include "mesh_optimizer.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t INVALID_INDEX = 0xffffffff;
+
+// triangles using each vertex, triangles of vertex v are
+// triangles[offsets[v] .. offsets[v + 1])
+struct TriangleAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+TriangleAdjacency BuildAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount) {
+    TriangleAdjacency adjacency;
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; i++)
+        adjacency.offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    adjacency.triangles.resize(indexCount);
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++)
+        adjacency.triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+    return adjacency;
+}
+
+// FIFO post-transform cache, a vertex is cached while fewer than
+// size misses happened since its own
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, uint32_t size)
+        : m_times(vertexCount, 0), m_timestamp(size + 1), m_size(size) {}
+
+    // 1 on a miss
+    uint32_t Access(uint32_t vertex) {
+        if (m_timestamp - m_times[vertex] <= m_size)
+            return 0;
+        m_times[vertex] = m_timestamp++;
+        return 1;
+    }
+    uint32_t AccessTriangle(const uint32_t* triangle) {
+        return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]);
+    }
+    void Clear() { m_timestamp += m_size + 1; }
+
+private:
+    std::vector<uint32_t> m_times;
+    uint32_t m_timestamp;
+    uint32_t m_size;
+};
+
+} // namespace
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount,
+    size_t vertexCount, uint32_t cacheSize) {
+    VertexCacheStats stats;
+    if (indexCount < 3)
+        return stats;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> used(vertexCount, false);
+    size_t usedCount = 0;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        misses += cache.Access(indices[i]);
+        if (!used[indices[i]]) {
+            used[indices[i]] = true;
+            usedCount++;
+        }
+    }
+    stats.acmr = (float)misses / (indexCount / 3);
+    stats.atvr = (float)misses / usedCount;
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize) {
+    TRACE_SCOPE("MeshOptimizer::OptimizeVertexCache");
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+    auto adjacency = BuildAdjacency(indices, triangleCount * 3, vertexCount);
+    std::vector<uint32_t> liveCounts(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        liveCounts[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    uint32_t timestamp = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    // the most recent vertex with triangles left, else the next one in input order
+    auto SkipDeadEnd = [&]() -> uint32_t {
+        while (!deadEnds.empty()) {
+            auto vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveCounts[vertex] > 0)
+                return vertex;
+        }
+        for (; cursor < vertexCount; cursor++) {
+            if (liveCounts[cursor] > 0)
+                return cursor;
+        }
+        return INVALID_INDEX;
+    };
+
+    auto fanning = SkipDeadEnd();
+    while (fanning != INVALID_INDEX) {
+        candidates.clear();
+        for (uint32_t i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++) {
+            auto triangle = adjacency.triangles[i];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+            for (uint32_t k = 0; k < 3; k++) {
+                auto vertex = indices[triangle * 3 + k];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCounts[vertex]--;
+                if (timestamp - cacheTimes[vertex] > cacheSize)
+                    cacheTimes[vertex] = timestamp++;
+            }
+        }
+
+        // the oldest candidate that is still cached once its own fan is emitted
+        auto next = INVALID_INDEX;
+        int64_t bestPriority = -1;
+        for (auto vertex: candidates) {
+            if (liveCounts[vertex] == 0)
+                continue;
+            int64_t priority = 0;
+            if (timestamp - cacheTimes[vertex] + 2 * liveCounts[vertex] <= cacheSize)
+                priority = timestamp - cacheTimes[vertex];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        fanning = next != INVALID_INDEX ? next : SkipDeadEnd();
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexCount,
+    const Vertex* vertices, size_t vertexCount, float threshold, uint32_t cacheSize) {
+    TRACE_SCOPE("MeshOptimizer::OptimizeOverdraw");
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // hard boundaries where all three vertices miss the cache
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<uint32_t> hardBoundaries;
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (cache.AccessTriangle(indices + t * 3) == 3 || t == 0)
+            hardBoundaries.push_back((uint32_t)t);
+    }
+    hardBoundaries.push_back((uint32_t)triangleCount);
+
+    // soft boundaries inside them, as soon as the ACMR of the cold started
+    // cluster gets within threshold of the ACMR in cache order
+    std::vector<uint32_t> clusters;
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); c++) {
+        uint32_t begin = hardBoundaries[c];
+        uint32_t end = hardBoundaries[c + 1];
+        cache.Clear();
+        uint32_t misses = 0;
+        for (uint32_t t = begin; t < end; t++)
+            misses += cache.AccessTriangle(indices + t * 3);
+        float targetAcmr = threshold * misses / (end - begin);
+
+        cache.Clear();
+        clusters.push_back(begin);
+        uint32_t clusterBegin = begin;
+        misses = 0;
+        for (uint32_t t = begin; t + 1 < end; t++) {
+            misses += cache.AccessTriangle(indices + t * 3);
+            if (misses <= targetAcmr * (t + 1 - clusterBegin)) {
+                clusterBegin = t + 1;
+                clusters.push_back(clusterBegin);
+                cache.Clear();
+                misses = 0;
+            }
+        }
+    }
+    clusters.push_back((uint32_t)triangleCount);
+
+    // area weighted centroid and normal of every cluster against the mesh centroid,
+    // the normal of a triangle is twice its area long
+    auto GetNormal = [&](uint32_t t, glm::vec3& centroid) {
+        auto& p0 = vertices[indices[t * 3]].position;
+        auto& p1 = vertices[indices[t * 3 + 1]].position;
+        auto& p2 = vertices[indices[t * 3 + 2]].position;
+        centroid = (p0 + p1 + p2) / 3.0f;
+        return glm::cross(p1 - p0, p2 - p0);
+    };
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.0f;
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            glm::vec3 centroid;
+            auto normal = GetNormal(t, centroid);
+            float area = glm::length(normal);
+            clusterCentroids[c] += centroid * area;
+            clusterNormals[c] += normal;
+            meshCentroid += centroid * area;
+            clusterArea += area;
+        }
+        clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : glm::vec3(0.0f);
+        meshArea += clusterArea;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float length = glm::length(clusterNormals[c]);
+        sortKeys[c] = length > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]) / length : 0.0f;
+        order[c] = (uint32_t)c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (auto c: order)
+        result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    std::copy(result.begin(), result.end(), indices);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(Vertex* vertices, size_t vertexCount,
+    uint32_t* indices, size_t indexCount) {
+    TRACE_SCOPE("MeshOptimizer::OptimizeVertexFetch");
+    std::vector<uint32_t> remap(vertexCount, INVALID_INDEX);
+    uint32_t nextVertex = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        auto& vertex = remap[indices[i]];
+        if (vertex == INVALID_INDEX)
+            vertex = nextVertex++;
+        indices[i] = vertex;
+    }
+    std::vector<Vertex> source(vertices, vertices + vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] != INVALID_INDEX)
+            vertices[remap[v]] = source[v];
+    }
+    return nextVertex;
+}
+
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    TRACE_SCOPE("MeshOptimizer::Optimize");
+    if (indices.size() < 3)
+        return;
+    size_t vertexCount = vertices.size();
+    auto before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    auto source = indices;
+    OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+    OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+    // meshes that barely share vertices can lose a little to the clusters
+    if (AnalyzeVertexCache(indices.data(), indices.size(), vertices.size()).acmr > before.acmr)
+        indices = std::move(source);
+    vertices.resize(OptimizeVertexFetch(vertices.data(), vertices.size(), indices.data(), indices.size()));
+    auto after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    SPDLOG_INFO("mesh optimized: #vert: {} -> {}, #face: {}, acmr {:.3f} -> {:.3f}, atvr {:.3f} -> {:.3f}",
+        vertexCount, vertices.size(), indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+}
@@ -0,0 +1,47 @@
+#ifndef __MESH_OPTIMIZER_H__
+#define __MESH_OPTIMIZER_H__
+
+#include "common.h"
+#include "mesh.h"
+#include <vector>
+
+// post-transform cache size the index order is tuned and measured for
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    // transformed vertices per triangle, 0.5 .. 3
+    float acmr { 0.0f };
+    // transformed vertices per referenced vertex, 1 is optimal
+    float atvr { 0.0f };
+};
+
+// Index / vertex reordering of indexed triangle lists, done once when a
+// mesh is cooked or generated:
+// - vertex cache: Tipsify (Sander et al. 2007), fans around the vertex that
+//   stays longest in a FIFO cache of cacheSize, linear in the triangle count
+// - overdraw: the vertex cache order is cut into clusters where the cache
+//   is cold or the ACMR allows it, clusters facing away from the mesh
+//   center are drawn first
+// - vertex fetch: vertices in order of first use, unused ones dropped
+class MeshOptimizer {
+public:
+    static VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount,
+        size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    static void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+        uint32_t cacheSize = VERTEX_CACHE_SIZE);
+    // indices must be in vertex cache order, threshold is the ACMR a cluster
+    // may lose against the cache order
+    static void OptimizeOverdraw(uint32_t* indices, size_t indexCount,
+        const Vertex* vertices, size_t vertexCount, float threshold = 1.05f,
+        uint32_t cacheSize = VERTEX_CACHE_SIZE);
+    // returns the number of vertices left
+    static size_t OptimizeVertexFetch(Vertex* vertices, size_t vertexCount,
+        uint32_t* indices, size_t indexCount);
+
+    // all three passes, logs ACMR / ATVR before and after.
+    // The input order is kept when the reordered one has a higher ACMR.
+    static void Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+};
+
+#endif // __MESH_OPTIMIZER_H__
@@ -0,0 +1,434 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+const uint32_t INVALID_INDEX = 0xffffffff;
+
+// level i targets LOD_REDUCTION^i of the triangles of level 0
+const float LOD_REDUCTION = 0.5f;
+// a level keeping more than this fraction of the one before is dropped
+const float LOD_MIN_REDUCTION = 0.8f;
+// collapse error limit, relative to the diagonal of the mesh bounds
+const float LOD_MAX_ERROR = 0.05f;
+// a collapse may turn a triangle normal by about 75 degrees at most
+const float MAX_NORMAL_TURN = 0.25f;
+// positions per parallel chunk of the collapse candidate search
+const size_t CANDIDATE_GRAIN = 4096;
+
+// sum of squared distances to weighted planes, symmetric 4x4 as
+// A (3x3), b and c of x^T A x + 2 b.x + c
+struct Quadric {
+    double a00 { 0.0 }, a11 { 0.0 }, a22 { 0.0 };
+    double a01 { 0.0 }, a02 { 0.0 }, a12 { 0.0 };
+    double b0 { 0.0 }, b1 { 0.0 }, b2 { 0.0 };
+    double c { 0.0 };
+    double weight { 0.0 };
+
+    void AddPlane(const glm::vec3& n, double d, double w) {
+        a00 += w * n.x * n.x; a11 += w * n.y * n.y; a22 += w * n.z * n.z;
+        a01 += w * n.x * n.y; a02 += w * n.x * n.z; a12 += w * n.y * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+    void Add(const Quadric& q) {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a01 += q.a01; a02 += q.a02; a12 += q.a12;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+    // RMS distance of p to the planes
+    float GetError(const glm::vec3& p) const {
+        if (weight <= 0.0)
+            return 0.0f;
+        double x = p.x, y = p.y, z = p.z;
+        double error = a00 * x * x + a11 * y * y + a22 * z * z +
+            2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+            2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return (float)std::sqrt(std::max(error, 0.0) / weight);
+    }
+};
+
+struct Collapse {
+    uint32_t source;
+    uint32_t target;
+    float error;
+};
+
+template <typename Func>
+void ForEach(ThreadPool* threadPool, size_t count, size_t grainSize, const Func& func) {
+    if (threadPool)
+        threadPool->ParallelFor(count, grainSize, func);
+    else
+        func(0, count, 0);
+}
+
+// every vertex to the lowest index at its position
+std::vector<uint32_t> BuildPositionRemap(const Vertex* vertices, size_t vertexCount) {
+    std::vector<uint32_t> order(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        order[v] = (uint32_t)v;
+    auto Less = [&](uint32_t a, uint32_t b) {
+        auto& pa = vertices[a].position;
+        auto& pb = vertices[b].position;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), Less);
+    std::vector<uint32_t> remap(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        bool same = i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position;
+        remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+    }
+    return remap;
+}
+
+// triangles around every position, triangles of position p are
+// triangles[offsets[p] .. offsets[p + 1])
+struct PositionAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+PositionAdjacency BuildAdjacency(const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& remap) {
+    PositionAdjacency adjacency;
+    adjacency.offsets.assign(remap.size() + 1, 0);
+    for (auto index: indices)
+        adjacency.offsets[remap[index] + 1]++;
+    for (size_t v = 0; v < remap.size(); v++)
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    adjacency.triangles.resize(indices.size());
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency.triangles[fill[remap[indices[i]]]++] = (uint32_t)(i / 3);
+    return adjacency;
+}
+
+// positions on open borders and non-manifold edges, which never move
+std::vector<bool> FindLockedPositions(const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& remap) {
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = remap[indices[i + k]];
+            uint64_t b = remap[indices[i + (k + 1) % 3]];
+            if (a != b)
+                edges.push_back(a << 32 | b);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // an inner edge is used once in each direction
+    std::vector<bool> locked(remap.size(), false);
+    for (size_t i = 0; i < edges.size();) {
+        size_t count = 1;
+        while (i + count < edges.size() && edges[i + count] == edges[i])
+            count++;
+        uint32_t a = (uint32_t)(edges[i] >> 32);
+        uint32_t b = (uint32_t)edges[i];
+        auto reverse = std::equal_range(edges.begin(), edges.end(), (uint64_t)b << 32 | a);
+        if (count != 1 || reverse.second - reverse.first != 1) {
+            locked[a] = true;
+            locked[b] = true;
+        }
+        i += count;
+    }
+    return locked;
+}
+
+class Simplifier {
+public:
+    Simplifier(const Vertex* vertices, size_t vertexCount, std::vector<uint32_t>& indices,
+        ThreadPool* threadPool)
+        : m_vertices(vertices), m_indices(indices), m_threadPool(threadPool) {
+        m_remap = BuildPositionRemap(vertices, vertexCount);
+        // circular list of the vertices at each position
+        m_wedges.resize(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            m_wedges[v] = (uint32_t)v;
+        for (size_t v = 0; v < vertexCount; v++) {
+            uint32_t position = m_remap[v];
+            if (position != v) {
+                m_wedges[v] = m_wedges[position];
+                m_wedges[position] = (uint32_t)v;
+            }
+        }
+        m_locked = FindLockedPositions(indices, m_remap);
+
+        m_quadrics.resize(vertexCount);
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            auto& p0 = vertices[indices[i]].position;
+            auto& p1 = vertices[indices[i + 1]].position;
+            auto& p2 = vertices[indices[i + 2]].position;
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+            normal /= length;
+            // area weighted, so small triangles do not dominate the error
+            double d = -glm::dot(normal, p0);
+            for (int k = 0; k < 3; k++)
+                m_quadrics[m_remap[indices[i + k]]].AddPlane(normal, d, length * 0.5);
+        }
+        m_collapseRemap.resize(vertexCount);
+        m_touched.resize(vertexCount);
+        m_candidates.resize(vertexCount);
+    }
+
+    // one pass of non overlapping collapses, cheapest first; returns false
+    // when no collapse was possible. Without keepSeams a vertex may also
+    // leave a seam, its attributes replaced by the closest ones at the target.
+    bool Pass(size_t targetIndexCount, float maxError, bool keepSeams, float& resultError) {
+        m_adjacency = BuildAdjacency(m_indices, m_remap);
+        for (size_t v = 0; v < m_collapseRemap.size(); v++)
+            m_collapseRemap[v] = (uint32_t)v;
+        std::fill(m_touched.begin(), m_touched.end(), false);
+        // the search only reads the mesh, so the positions are evaluated in parallel
+        ForEach(m_threadPool, m_remap.size(), CANDIDATE_GRAIN, [&](size_t begin, size_t end, int) {
+            for (size_t v = begin; v < end; v++) {
+                auto& best = m_candidates[v];
+                best = Collapse { (uint32_t)v, INVALID_INDEX, FLT_MAX };
+                if (m_remap[v] != v || m_locked[v])
+                    continue;
+                ForEachTriangle((uint32_t)v, [&](const uint32_t* triangle) {
+                    for (int k = 0; k < 3; k++) {
+                        uint32_t target = m_remap[triangle[k]];
+                        if (target == v || target == best.target)
+                            continue;
+                        float error = m_quadrics[v].GetError(m_vertices[target].position);
+                        if (error < best.error && MatchWedges((uint32_t)v, target, keepSeams, false)) {
+                            best.target = target;
+                            best.error = error;
+                        }
+                    }
+                });
+            }
+        });
+        std::vector<Collapse> collapses;
+        for (auto& candidate: m_candidates) {
+            if (candidate.target != INVALID_INDEX && candidate.error <= maxError)
+                collapses.push_back(candidate);
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error || (a.error == b.error && a.source < b.source);
+        });
+
+        size_t indexCount = m_indices.size();
+        bool collapsed = false;
+        for (auto& collapse: collapses) {
+            if (indexCount <= targetIndexCount)
+                break;
+            if (m_touched[collapse.source] || m_touched[collapse.target])
+                continue;
+            if (Flips(collapse.source, collapse.target))
+                continue;
+            indexCount -= 3 * CountShared(collapse.source, collapse.target);
+            MatchWedges(collapse.source, collapse.target, keepSeams, true);
+            m_quadrics[collapse.target].Add(m_quadrics[collapse.source]);
+            m_touched[collapse.source] = true;
+            m_touched[collapse.target] = true;
+            resultError = std::max(resultError, collapse.error);
+            collapsed = true;
+        }
+        if (!collapsed)
+            return false;
+
+        size_t write = 0;
+        for (size_t i = 0; i + 2 < m_indices.size(); i += 3) {
+            uint32_t a = m_collapseRemap[m_indices[i]];
+            uint32_t b = m_collapseRemap[m_indices[i + 1]];
+            uint32_t c = m_collapseRemap[m_indices[i + 2]];
+            if (m_remap[a] == m_remap[b] || m_remap[b] == m_remap[c] || m_remap[c] == m_remap[a])
+                continue;
+            m_indices[write++] = a;
+            m_indices[write++] = b;
+            m_indices[write++] = c;
+        }
+        m_indices.resize(write);
+        return true;
+    }
+
+private:
+    // corners remapped by the collapses of the current pass
+    template <typename Func>
+    void ForEachTriangle(uint32_t position, const Func& func) const {
+        for (uint32_t i = m_adjacency.offsets[position]; i < m_adjacency.offsets[position + 1]; i++) {
+            auto triangle = &m_indices[m_adjacency.triangles[i] * 3];
+            uint32_t corners[3] = {
+                m_collapseRemap[triangle[0]],
+                m_collapseRemap[triangle[1]],
+                m_collapseRemap[triangle[2]],
+            };
+            func(corners);
+        }
+    }
+
+    // every vertex at source moves to a vertex at target it shares a triangle
+    // with, so the attributes on both sides of a seam are kept; without
+    // keepSeams the vertex of closest attributes is taken when there is none
+    bool MatchWedges(uint32_t source, uint32_t target, bool keepSeams, bool apply) {
+        uint32_t wedge = source;
+        do {
+            uint32_t match = INVALID_INDEX;
+            ForEachTriangle(source, [&](const uint32_t* triangle) {
+                if (triangle[0] != wedge && triangle[1] != wedge && triangle[2] != wedge)
+                    return;
+                for (int k = 0; k < 3; k++) {
+                    if (m_remap[triangle[k]] == target && match == INVALID_INDEX)
+                        match = triangle[k];
+                }
+            });
+            if (match == INVALID_INDEX && !keepSeams)
+                match = FindClosestWedge(wedge, target);
+            if (match == INVALID_INDEX)
+                return false;
+            if (apply)
+                m_collapseRemap[wedge] = match;
+            wedge = m_wedges[wedge];
+        } while (wedge != source);
+        return true;
+    }
+
+    uint32_t FindClosestWedge(uint32_t vertex, uint32_t position) const {
+        auto& attributes = m_vertices[vertex];
+        uint32_t closest = position;
+        float closestDistance = FLT_MAX;
+        uint32_t wedge = position;
+        do {
+            auto& candidate = m_vertices[wedge];
+            auto normal = candidate.normal - attributes.normal;
+            auto texCoord = candidate.texCoord - attributes.texCoord;
+            float distance = glm::dot(normal, normal) + glm::dot(texCoord, texCoord);
+            if (distance < closestDistance) {
+                closest = wedge;
+                closestDistance = distance;
+            }
+            wedge = m_wedges[wedge];
+        } while (wedge != position);
+        return closest;
+    }
+
+    bool Flips(uint32_t source, uint32_t target) const {
+        bool flips = false;
+        auto& moved = m_vertices[target].position;
+        ForEachTriangle(source, [&](const uint32_t* triangle) {
+            glm::vec3 p[3];
+            int corner = -1;
+            for (int k = 0; k < 3; k++) {
+                uint32_t position = m_remap[triangle[k]];
+                if (position == target)
+                    return;
+                if (position == source)
+                    corner = k;
+                p[k] = m_vertices[triangle[k]].position;
+            }
+            if (corner < 0)
+                return;
+            auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            p[corner] = moved;
+            auto after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) < MAX_NORMAL_TURN * glm::length(before) * glm::length(after))
+                flips = true;
+        });
+        return flips;
+    }
+
+    // triangles the collapse removes
+    size_t CountShared(uint32_t source, uint32_t target) const {
+        size_t count = 0;
+        ForEachTriangle(source, [&](const uint32_t* triangle) {
+            if (m_remap[triangle[0]] == target || m_remap[triangle[1]] == target ||
+                m_remap[triangle[2]] == target)
+                count++;
+        });
+        return count;
+    }
+
+    const Vertex* m_vertices;
+    std::vector<uint32_t>& m_indices;
+    std::vector<uint32_t> m_remap;
+    std::vector<uint32_t> m_wedges;
+    std::vector<bool> m_locked;
+    std::vector<Quadric> m_quadrics;
+    PositionAdjacency m_adjacency;
+    std::vector<uint32_t> m_collapseRemap;
+    std::vector<bool> m_touched;
+    // best collapse of every position in the current pass
+    std::vector<Collapse> m_candidates;
+    ThreadPool* m_threadPool;
+};
+
+} // namespace
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount, size_t targetIndexCount,
+    float maxError, float* error, ThreadPool* threadPool) {
+    TRACE_SCOPE("MeshSimplifier::Simplify");
+    std::vector<uint32_t> result(indices, indices + indexCount - indexCount % 3);
+    float resultError = 0.0f;
+    if (result.size() > targetIndexCount) {
+        Simplifier simplifier(vertices, vertexCount, result, threadPool);
+        // seams are crossed only once the target is out of reach along them
+        for (bool keepSeams: { true, false }) {
+            while (result.size() > targetIndexCount &&
+                simplifier.Pass(targetIndexCount, maxError, keepSeams, resultError)) {}
+        }
+    }
+    if (error)
+        *error = resultError;
+    return result;
+}
+
+void MeshSimplifier::BuildLods(std::vector<CookedMeshData>& meshes, ThreadPool* threadPool) {
+    TRACE_SCOPE("MeshSimplifier::BuildLods");
+    for (auto& mesh: meshes) {
+        mesh.lods.assign(1, MeshLod { 0, (uint32_t)mesh.indices.size(), 0.0f });
+        if (mesh.indices.size() < 3)
+            continue;
+        auto boundsMin = glm::vec3(FLT_MAX);
+        auto boundsMax = glm::vec3(-FLT_MAX);
+        for (auto& vertex: mesh.vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+        float maxError = LOD_MAX_ERROR * glm::length(boundsMax - boundsMin);
+
+        // every level is simplified from the one before; its error adds to
+        // the error of that level, which also comes off the budget
+        size_t baseTriangleCount = mesh.indices.size() / 3;
+        std::vector<uint32_t> previous = mesh.indices;
+        for (int level = 1; level < MAX_MESH_LOD_COUNT; level++) {
+            auto last = mesh.lods.back();
+            if (last.error >= maxError)
+                break;
+            size_t triangleCount = (size_t)(baseTriangleCount * std::pow(LOD_REDUCTION, level));
+            float error = 0.0f;
+            auto indices = Simplify(mesh.vertices.data(), mesh.vertices.size(),
+                previous.data(), previous.size(), triangleCount * 3,
+                maxError - last.error, &error, threadPool);
+            // stopped by the error budget, the next level would stop at the same point
+            if (indices.empty() || indices.size() > last.indexCount * LOD_MIN_REDUCTION)
+                break;
+            MeshOptimizer::OptimizeVertexCache(indices.data(), indices.size(), mesh.vertices.size());
+            mesh.lods.push_back(MeshLod { (uint32_t)mesh.indices.size(),
+                (uint32_t)indices.size(), last.error + error });
+            mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+            previous = std::move(indices);
+        }
+
+        std::string levels;
+        for (auto& lod: mesh.lods)
+            levels += fmt::format(" {} ({:.4f})", lod.indexCount / 3, lod.error);
+        SPDLOG_INFO("mesh lods: #face (error):{}", levels);
+    }
+}
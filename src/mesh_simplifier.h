@@ -0,0 +1,37 @@
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+#include "common.h"
+#include "mesh.h"
+#include "cooked_mesh.h"
+#include "thread_pool.h"
+#include <vector>
+
+// Quadric error (Garland and Heckbert 1997) simplification by half edge
+// collapses: a vertex moves onto a neighbour, so the vertices are never
+// modified and every level of detail is an index list over the same
+// vertex buffer.
+// - vertices at the same position are collapsed together; a vertex with
+//   several attribute sets (a uv or normal seam) moves along the seam, and
+//   across it only once the target is out of reach otherwise (flat shaded
+//   voxel models are seams everywhere)
+// - open borders and non-manifold edges are locked
+// - collapses that flip a triangle are rejected
+class MeshSimplifier {
+public:
+    // at most targetIndexCount indices, fewer collapses when the next one
+    // would exceed maxError. error receives the largest collapse error, an
+    // RMS distance to the planes of the input triangles in model units.
+    // The collapse candidates of every pass are searched in parallel.
+    static std::vector<uint32_t> Simplify(const Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount, size_t targetIndexCount,
+        float maxError, float* error = nullptr, ThreadPool* threadPool = nullptr);
+
+    // replaces the indices of every mesh with its levels back to back,
+    // level 0 (the input) first, each simplified from the one before to
+    // about half its triangles. A level's error is the sum of the errors
+    // along the chain, a bound of its distance to level 0.
+    static void BuildLods(std::vector<CookedMeshData>& meshes, ThreadPool* threadPool = nullptr);
+};
+
+#endif // __MESH_SIMPLIFIER_H__
@@ -0,0 +1,304 @@
+#include "mip_generator.h"
+#include "pixel_convert.h"
+#include "simd.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float PI = 3.14159265358979f;
+const size_t ROW_GRAIN = 16;
+
+// working level, 4 floats per pixel
+struct FloatLevel {
+    int width { 0 };
+    int height { 0 };
+    std::vector<float> data;
+};
+
+// source pixels and weights of every output pixel along one axis, tapCount each
+struct FilterTaps {
+    int tapCount { 0 };
+    std::vector<int> indices;
+    std::vector<float> weights;
+};
+
+float Sinc(float x) {
+    if (fabsf(x) < 1e-6f)
+        return 1.0f;
+    x *= PI;
+    return sinf(x) / x;
+}
+
+// zeroth order modified Bessel function of the first kind
+float BesselI0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+    float halfX = x * 0.5f;
+    for (int k = 1; k < 32; k++) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-8f)
+            break;
+    }
+    return sum;
+}
+
+float GetFilterRadius(MipFilter filter) {
+    return filter == MIP_FILTER_BOX ? 0.5f : 3.0f;
+}
+
+float EvaluateFilter(MipFilter filter, float x) {
+    float radius = GetFilterRadius(filter);
+    if (fabsf(x) >= radius)
+        return 0.0f;
+    switch (filter) {
+        case MIP_FILTER_BOX:
+            return 1.0f;
+        case MIP_FILTER_LANCZOS:
+            return Sinc(x) * Sinc(x / radius);
+        default: {
+            const float beta = 4.0f;
+            float t = x / radius;
+            return Sinc(x) * BesselI0(beta * sqrtf(1.0f - t * t)) / BesselI0(beta);
+        }
+    }
+}
+
+// taps of a srcSize -> dstSize downsample, the filter is stretched by the scale
+// and the edges are clamped
+FilterTaps ComputeTaps(MipFilter filter, int srcSize, int dstSize) {
+    FilterTaps taps;
+    if (srcSize == dstSize) {
+        taps.tapCount = 1;
+        for (int i = 0; i < dstSize; i++) {
+            taps.indices.push_back(i);
+            taps.weights.push_back(1.0f);
+        }
+        return taps;
+    }
+    float scale = (float)srcSize / dstSize;
+    float support = GetFilterRadius(filter) * scale;
+    taps.tapCount = (int)ceilf(support * 2.0f) + 1;
+    taps.indices.resize((size_t)dstSize * taps.tapCount);
+    taps.weights.resize((size_t)dstSize * taps.tapCount);
+    for (int i = 0; i < dstSize; i++) {
+        float center = (i + 0.5f) * scale - 0.5f;
+        int first = (int)floorf(center - support) + 1;
+        float sum = 0.0f;
+        for (int t = 0; t < taps.tapCount; t++) {
+            float weight = EvaluateFilter(filter, (first + t - center) / scale);
+            taps.indices[i * taps.tapCount + t] = std::clamp(first + t, 0, srcSize - 1);
+            taps.weights[i * taps.tapCount + t] = weight;
+            sum += weight;
+        }
+        for (int t = 0; t < taps.tapCount; t++)
+            taps.weights[i * taps.tapCount + t] /= sum;
+    }
+    return taps;
+}
+
+// dst[i] += src[i] * weight
+void AccumulateRow(float* dst, const float* src, float weight, size_t count) {
+    size_t i = 0;
+#if SIMD_AVX2
+    __m256 w8 = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_fmadd_ps(_mm256_loadu_ps(src + i), w8, _mm256_loadu_ps(dst + i));
+        _mm256_storeu_ps(dst + i, sum);
+    }
+#endif
+#if SIMD_SSE2
+    __m128 w4 = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w4));
+        _mm_storeu_ps(dst + i, sum);
+    }
+#elif SIMD_NEON
+    float32x4_t w4 = vdupq_n_f32(weight);
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), w4));
+#endif
+    for (; i < count; i++)
+        dst[i] += src[i] * weight;
+}
+
+// one RGBA pixel as the weighted sum of the tapped pixels of a row
+void FilterPixel(float* dst, const float* row, const int* indices, const float* weights, int tapCount) {
+#if SIMD_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (int t = 0; t < tapCount; t++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + indices[t] * 4), _mm_set1_ps(weights[t])));
+    _mm_storeu_ps(dst, sum);
+#elif SIMD_NEON
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (int t = 0; t < tapCount; t++)
+        sum = vmlaq_n_f32(sum, vld1q_f32(row + indices[t] * 4), weights[t]);
+    vst1q_f32(dst, sum);
+#else
+    float sum[4] = {};
+    for (int t = 0; t < tapCount; t++) {
+        for (int c = 0; c < 4; c++)
+            sum[c] += row[indices[t] * 4 + c] * weights[t];
+    }
+    memcpy(dst, sum, sizeof(sum));
+#endif
+}
+
+float SrgbToLinear(float value) {
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+void Normalize(float* pixel) {
+    float length = sqrtf(pixel[0] * pixel[0] + pixel[1] * pixel[1] + pixel[2] * pixel[2]);
+    if (length < 1e-8f) {
+        pixel[0] = pixel[1] = 0.0f;
+        pixel[2] = 1.0f;
+        return;
+    }
+    for (int c = 0; c < 3; c++)
+        pixel[c] /= length;
+}
+
+template <typename Func>
+void ForEachRow(ThreadPool* threadPool, int rowCount, const Func& func) {
+    auto run = [&](size_t begin, size_t end, int) {
+        for (size_t y = begin; y < end; y++)
+            func((int)y);
+    };
+    if (threadPool)
+        threadPool->ParallelFor(rowCount, ROW_GRAIN, run);
+    else
+        run(0, rowCount, 0);
+}
+
+// base image to linear float RGBA, normal maps to [-1, 1]
+FloatLevel ToFloatLevel(const Image* image, const MipOptions& options, ThreadPool* threadPool) {
+    FloatLevel level;
+    level.width = image->GetWidth();
+    level.height = image->GetHeight();
+    level.data.resize((size_t)level.width * level.height * 4);
+    bool half = image->GetStorage() == IMAGE_STORAGE_HALF;
+    int channelCount = image->GetChannelCount();
+
+    float table[256];
+    for (int i = 0; i < 256; i++) {
+        float value = i / 255.0f;
+        table[i] = options.normalMap ? value * 2.0f - 1.0f :
+            options.srgb ? SrgbToLinear(value) : value;
+    }
+    ForEachRow(threadPool, level.height, [&](int y) {
+        float* dst = level.data.data() + (size_t)y * level.width * 4;
+        for (int x = 0; x < level.width; x++, dst += 4) {
+            size_t src = ((size_t)y * level.width + x) * channelCount;
+            if (half) {
+                auto pixels = (const uint16_t*)image->GetData();
+                for (int c = 0; c < 3; c++)
+                    dst[c] = HalfToFloat(pixels[src + c]);
+                dst[3] = 1.0f;
+            }
+            else {
+                auto pixels = image->GetData();
+                for (int c = 0; c < 3; c++)
+                    dst[c] = table[pixels[src + c]];
+                dst[3] = pixels[src + 3] / 255.0f;
+            }
+        }
+    });
+    return level;
+}
+
+FloatLevel Downsample(const FloatLevel& src, const MipOptions& options, bool hdr, ThreadPool* threadPool) {
+    FloatLevel dst;
+    dst.width = std::max(src.width >> 1, 1);
+    dst.height = std::max(src.height >> 1, 1);
+    auto tapsX = ComputeTaps(options.filter, src.width, dst.width);
+    auto tapsY = ComputeTaps(options.filter, src.height, dst.height);
+
+    // horizontal pass over every source row
+    std::vector<float> temp((size_t)dst.width * src.height * 4);
+    ForEachRow(threadPool, src.height, [&](int y) {
+        const float* row = src.data.data() + (size_t)y * src.width * 4;
+        float* out = temp.data() + (size_t)y * dst.width * 4;
+        for (int x = 0; x < dst.width; x++) {
+            FilterPixel(out + x * 4, row,
+                tapsX.indices.data() + x * tapsX.tapCount,
+                tapsX.weights.data() + x * tapsX.tapCount, tapsX.tapCount);
+        }
+    });
+
+    // vertical pass, whole rows at a time, then the ringing of the
+    // negative lobes is clamped back to the valid range
+    dst.data.assign((size_t)dst.width * dst.height * 4, 0.0f);
+    size_t rowSize = (size_t)dst.width * 4;
+    ForEachRow(threadPool, dst.height, [&](int y) {
+        float* out = dst.data.data() + y * rowSize;
+        for (int t = 0; t < tapsY.tapCount; t++) {
+            int index = tapsY.indices[y * tapsY.tapCount + t];
+            AccumulateRow(out, temp.data() + index * rowSize, tapsY.weights[y * tapsY.tapCount + t], rowSize);
+        }
+        for (int x = 0; x < dst.width; x++) {
+            float* pixel = out + x * 4;
+            if (options.normalMap)
+                Normalize(pixel);
+            else {
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = hdr ? std::max(pixel[c], 0.0f) : std::clamp(pixel[c], 0.0f, 1.0f);
+            }
+            pixel[3] = std::clamp(pixel[3], 0.0f, 1.0f);
+        }
+    });
+    return dst;
+}
+
+ImageUPtr ToImage(const FloatLevel& level, const Image* base, const MipOptions& options, ThreadPool* threadPool) {
+    bool half = base->GetStorage() == IMAGE_STORAGE_HALF;
+    int channelCount = base->GetChannelCount();
+    auto image = Image::Create(level.width, level.height, channelCount, half ? 2 : 1);
+    ForEachRow(threadPool, level.height, [&](int y) {
+        const float* src = level.data.data() + (size_t)y * level.width * 4;
+        for (int x = 0; x < level.width; x++, src += 4) {
+            size_t dst = ((size_t)y * level.width + x) * channelCount;
+            if (half) {
+                auto pixels = (uint16_t*)image->GetData();
+                for (int c = 0; c < 3; c++)
+                    pixels[dst + c] = FloatToHalf(std::min(src[c], 65504.0f));
+                continue;
+            }
+            auto pixels = image->GetData();
+            for (int c = 0; c < 3; c++) {
+                float value = options.normalMap ? src[c] * 0.5f + 0.5f :
+                    options.srgb ? LinearToSrgb(src[c]) : src[c];
+                pixels[dst + c] = (uint8_t)lroundf(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+            }
+            pixels[dst + 3] = (uint8_t)lroundf(src[3] * 255.0f);
+        }
+    });
+    return image;
+}
+
+} // namespace
+
+std::vector<ImageUPtr> MipGenerator::Generate(const Image* image, const MipOptions& options,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("MipGenerator::Generate");
+    std::vector<ImageUPtr> levels;
+    bool hdr = image->GetStorage() == IMAGE_STORAGE_HALF;
+    if (hdr ? image->GetChannelCount() != 3 :
+        (image->GetStorage() != IMAGE_STORAGE_UINT8 || image->GetChannelCount() != 4)) {
+        SPDLOG_ERROR("mip generation needs an RGBA8 or RGB half image");
+        return levels;
+    }
+
+    auto level = ToFloatLevel(image, options, threadPool);
+    while (level.width > 1 || level.height > 1) {
+        level = Downsample(level, options, hdr, threadPool);
+        levels.push_back(ToImage(level, image, options, threadPool));
+    }
+    return levels;
+}
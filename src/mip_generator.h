@@ -0,0 +1,34 @@
+#ifndef __MIP_GENERATOR_H__
+#define __MIP_GENERATOR_H__
+
+#include "common.h"
+#include "image.h"
+#include "thread_pool.h"
+#include <vector>
+
+enum MipFilter {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,      // windowed sinc, radius 3, beta 4
+    MIP_FILTER_LANCZOS,     // lanczos3
+};
+
+struct MipOptions {
+    MipFilter filter { MIP_FILTER_KAISER };
+    // rgb is sRGB encoded and filtered in linear light, alpha stays linear
+    bool srgb { false };
+    // rgb holds a unit vector mapped to [0, 1] and is renormalized on every level
+    bool normalMap { false };
+};
+
+// CPU mip chain of an RGBA8 or RGB half image.
+// Each level is downsampled from the previous one, kept in float RGBA,
+// with a separable filter whose taps are computed once per level.
+// Rows of both passes are split across the thread pool.
+class MipGenerator {
+public:
+    // every level below the base image down to 1x1, in the storage of the base image
+    static std::vector<ImageUPtr> Generate(const Image* image, const MipOptions& options,
+        ThreadPool* threadPool = nullptr);
+};
+
+#endif // __MIP_GENERATOR_H__
@@ -1,13 +1,118 @@
 #include "model.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "tangent_generator.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <filesystem>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+namespace {
+
+// a level is used while its error projects to at most this many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+
+uint64_t s_submittedTriangleCount = 0;
+
+void ProcessMesh(aiMesh* mesh, std::vector<CookedMeshData>& meshes, ThreadPool* threadPool) {
+    SPDLOG_INFO("process mesh: {}, #vert: {}, #face: {}",
+        mesh->mName.C_Str(), mesh->mNumVertices, mesh->mNumFaces);
+
+    CookedMeshData data;
+    auto& vertices = data.vertices;
+    vertices.resize(mesh->mNumVertices);
+    for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
+        auto& v = vertices[i];
+        v.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        v.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        v.texCoord = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+    }
+
+    auto& indices = data.indices;
+    indices.resize(mesh->mNumFaces * 3);
+    for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
+        indices[3*i  ] = mesh->mFaces[i].mIndices[0];
+        indices[3*i+1] = mesh->mFaces[i].mIndices[1];
+        indices[3*i+2] = mesh->mFaces[i].mIndices[2];
+    }
+
+    TangentGenerator::Generate(vertices.data(), vertices.size(), indices.data(), indices.size(),
+        threadPool);
+    data.materialIndex = (int)mesh->mMaterialIndex;
+    meshes.push_back(std::move(data));
+}
+
+void ProcessNode(aiNode* node, const aiScene* scene, std::vector<CookedMeshData>& meshes,
+    ThreadPool* threadPool) {
+    for (uint32_t i = 0; i < node->mNumMeshes; i++) {
+        auto meshIndex = node->mMeshes[i];
+        auto mesh = scene->mMeshes[meshIndex];
+        ProcessMesh(mesh, meshes, threadPool);
+    }
+
+    for (uint32_t i = 0; i < node->mNumChildren; i++) {
+        ProcessNode(node->mChildren[i], scene, meshes, threadPool);
+    }
+}
+
+} // namespace
+
+ModelUPtr Model::Load(const std::string& filename, ThreadPool* threadPool) {
+    TRACE_SCOPE("Model::Load");
+    auto cookedFilename = CookedMesh::GetCookedFilename(MESH_CACHE_DIRECTORY, filename);
 
-ModelUPtr Model::Load(const std::string& filename) {
     auto model = ModelUPtr(new Model());
-    if (!model->LoadByAssimp(filename))
+    auto cooked = CookedMesh::IsUpToDate(cookedFilename, filename) ?
+        CookedMesh::Load(cookedFilename) : nullptr;
+    if (cooked) {
+        SPDLOG_INFO("mesh cache hit: {}", cookedFilename);
+        model->LoadCooked(filename, cooked.get());
+        model->BuildDrawBatches();
+        return std::move(model);
+    }
+
+    std::vector<CookedMeshData> meshes;
+    std::vector<CookedMaterial> materials;
+    auto extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    bool imported = extension == ".obj" ?
+        ObjLoader::Load(filename, meshes, materials, threadPool) :
+        LoadByAssimp(filename, meshes, materials, threadPool);
+    if (!imported)
         return nullptr;
+    for (auto& mesh: meshes)
+        MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+    MeshSimplifier::BuildLods(meshes, threadPool);
+    CookedMesh::Write(cookedFilename, filename, meshes, materials);
+
+    // this launch uploads the imported data, the next one reads the cache
+    model->LoadMaterials(filename, materials);
+    model->m_boundsMin = glm::vec3(FLT_MAX);
+    model->m_boundsMax = glm::vec3(-FLT_MAX);
+    for (auto& mesh: meshes) {
+        for (auto& vertex: mesh.vertices) {
+            model->m_boundsMin = glm::min(model->m_boundsMin, vertex.position);
+            model->m_boundsMax = glm::max(model->m_boundsMax, vertex.position);
+        }
+    }
+    for (auto& mesh: meshes) {
+        model->AddMesh(mesh.vertices.data(), mesh.vertices.size(),
+            mesh.indices.data(), mesh.indices.size(), mesh.materialIndex,
+            mesh.lods.data(), (int)mesh.lods.size());
+    }
+    model->BuildDrawBatches();
     return std::move(model);
 }
 
-bool Model::LoadByAssimp(const std::string& filename) {
+bool Model::LoadByAssimp(const std::string& filename,
+    std::vector<CookedMeshData>& meshes, std::vector<CookedMaterial>& materials,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("Model::LoadByAssimp");
     Assimp::Importer importer;
     auto scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -16,71 +121,220 @@ bool Model::LoadByAssimp(const std::string& filename) {
         return false;
     }
 
-    auto dirname = filename.substr(0, filename.find_last_of("/"));
-    auto LoadTexture = [&](aiMaterial* material, aiTextureType type) -> TexturePtr {
+    auto GetTexturePath = [&](aiMaterial* material, aiTextureType type) -> std::string {
         if (material->GetTextureCount(type) <= 0)
-            return nullptr;
+            return std::string();
         aiString filepath;
         material->GetTexture(type, 0, &filepath);
-        auto image = Image::Load(fmt::format("{}/{}", dirname, filepath.C_Str()));
-        if (!image)
-            return nullptr;
-        return Texture::CreateFromImage(image.get());
+        return filepath.C_Str();
     };
 
     for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
         auto material = scene->mMaterials[i];
-        auto glMaterial = Material::Create();
-        glMaterial->diffuse = LoadTexture(material, aiTextureType_DIFFUSE);
-        glMaterial->specular = LoadTexture(material, aiTextureType_SPECULAR);
-        m_materials.push_back(std::move(glMaterial));
+        CookedMaterial cookedMaterial;
+        cookedMaterial.diffuse = GetTexturePath(material, aiTextureType_DIFFUSE);
+        cookedMaterial.specular = GetTexturePath(material, aiTextureType_SPECULAR);
+        materials.push_back(std::move(cookedMaterial));
     }
 
-    ProcessNode(scene->mRootNode, scene);
+    ProcessNode(scene->mRootNode, scene, meshes, threadPool);
     return true;
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene) {
-    for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-        auto meshIndex = node->mMeshes[i];
-        auto mesh = scene->mMeshes[meshIndex];
-        ProcessMesh(mesh, scene);
+void Model::LoadCooked(const std::string& filename, const CookedMesh* cooked) {
+    TRACE_SCOPE("Model::LoadCooked");
+    std::vector<CookedMaterial> materials;
+    for (int i = 0; i < cooked->GetMaterialCount(); i++)
+        materials.push_back(cooked->GetMaterial(i));
+    LoadMaterials(filename, materials);
+
+    // the mapped vertex / index data goes to the GL buffers as is
+    m_boundsMin = cooked->GetBoundsMin();
+    m_boundsMax = cooked->GetBoundsMax();
+    for (int i = 0; i < cooked->GetMeshCount(); i++) {
+        AddMesh(cooked->GetVertices(i), cooked->GetVertexCount(i),
+            cooked->GetIndices(i), cooked->GetIndexCount(i), cooked->GetMaterialIndex(i),
+            cooked->GetLods(i), cooked->GetLodCount(i));
     }
+}
 
-    for (uint32_t i = 0; i < node->mNumChildren; i++) {
-        ProcessNode(node->mChildren[i], scene);
+void Model::LoadMaterials(const std::string& filename, const std::vector<CookedMaterial>& materials) {
+    auto dirname = filename.substr(0, filename.find_last_of("/"));
+    auto LoadTexture = [&](const std::string& filepath) -> TexturePtr {
+        if (filepath.empty())
+            return nullptr;
+        auto image = Image::Load(fmt::format("{}/{}", dirname, filepath));
+        if (!image)
+            return nullptr;
+        return Texture::CreateFromImage(image.get());
+    };
+
+    for (auto& material: materials) {
+        auto glMaterial = Material::Create();
+        glMaterial->diffuse = LoadTexture(material.diffuse);
+        glMaterial->specular = LoadTexture(material.specular);
+        m_materials.push_back(std::move(glMaterial));
     }
 }
 
-void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene) {
-    SPDLOG_INFO("process mesh: {}, #vert: {}, #face: {}",
-        mesh->mName.C_Str(), mesh->mNumVertices, mesh->mNumFaces);
+void Model::AddMesh(const Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount, int materialIndex,
+    const MeshLod* lods, int lodCount) {
+    VertexBounds bounds { m_boundsMin, m_boundsMax };
+    auto glMesh = Mesh::Create(vertices, vertexCount, indices, indexCount,
+        GL_TRIANGLES, VERTEX_FORMAT_QUANTIZED, false, &bounds);
+    glMesh->SetLods(lods, lodCount);
+    if (materialIndex >= 0 && materialIndex < (int)m_materials.size())
+        glMesh->SetMaterial(m_materials[materialIndex]);
+    m_meshes.push_back(std::move(glMesh));
+}
 
-    std::vector<Vertex> vertices;
-    vertices.resize(mesh->mNumVertices);
-    for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
-        auto& v = vertices[i];
-        v.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        v.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-        v.texCoord = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+void Model::BuildDrawBatches() {
+    // batches in order of their first mesh, meshes in order within a batch
+    std::vector<std::vector<MeshPtr>> batchMeshes;
+    for (auto& mesh: m_meshes) {
+        if (mesh->GetAllocation().indexCount == 0)
+            continue;
+        auto SameBatch = [&](const std::vector<MeshPtr>& batch) {
+            auto& first = batch.front();
+            return first->GetMaterial() == mesh->GetMaterial() &&
+                first->GetArena() == mesh->GetArena() &&
+                first->GetIndexType() == mesh->GetIndexType() &&
+                first->GetPrimitiveType() == mesh->GetPrimitiveType() &&
+                first->GetPositionScale() == mesh->GetPositionScale() &&
+                first->GetPositionOffset() == mesh->GetPositionOffset();
+        };
+        auto batch = std::find_if(batchMeshes.begin(), batchMeshes.end(), SameBatch);
+        if (batch == batchMeshes.end())
+            batchMeshes.push_back({ mesh });
+        else
+            batch->push_back(mesh);
     }
 
-    std::vector<uint32_t> indices;
-    indices.resize(mesh->mNumFaces * 3);
-    for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-        indices[3*i  ] = mesh->mFaces[i].mIndices[0];
-        indices[3*i+1] = mesh->mFaces[i].mIndices[1];
-        indices[3*i+2] = mesh->mFaces[i].mIndices[2];
+    int lodCount = 1;
+    for (auto& mesh: m_meshes)
+        lodCount = std::max(lodCount, mesh->GetLodCount());
+    m_lodErrors.assign(lodCount, 0.0f);
+    m_lodTriangleCounts.assign(lodCount, 0);
+
+    m_drawBatches.clear();
+    m_drawCommands.clear();
+    for (int lod = 0; lod < lodCount; lod++) {
+        uint32_t firstCommand = 0;
+        for (auto& meshes: batchMeshes) {
+            if (lod == 0) {
+                DrawBatch batch;
+                batch.mesh = meshes.front();
+                batch.firstCommand = firstCommand;
+                batch.commandCount = (uint32_t)meshes.size();
+                m_drawBatches.push_back(std::move(batch));
+            }
+            firstCommand += (uint32_t)meshes.size();
+            for (auto& mesh: meshes) {
+                auto& allocation = mesh->GetAllocation();
+                auto& meshLod = mesh->GetLod(std::min(lod, mesh->GetLodCount() - 1));
+                m_drawCommands.push_back(DrawElementsIndirectCommand {
+                    meshLod.indexCount, 1, allocation.GetFirstIndex() + meshLod.firstIndex,
+                    (int32_t)allocation.baseVertex, 0 });
+                m_lodErrors[lod] = std::max(m_lodErrors[lod], meshLod.error);
+                m_lodTriangleCounts[lod] += meshLod.indexCount / 3;
+            }
+        }
     }
+    if (m_drawCommands.empty())
+        return;
 
-    auto glMesh = Mesh::Create(vertices, indices, GL_TRIANGLES);
-    if (mesh->mMaterialIndex >= 0)
-        glMesh->SetMaterial(m_materials[mesh->mMaterialIndex]);
-    m_meshes.push_back(std::move(glMesh));
+    auto commands = m_drawCommands;
+    commands.insert(commands.end(), m_drawCommands.begin(), m_drawCommands.end());
+    m_indirectBuffer = Buffer::CreateWithData(GL_DRAW_INDIRECT_BUFFER, GL_DYNAMIC_DRAW,
+        commands.data(), sizeof(DrawElementsIndirectCommand), commands.size());
+    m_indirectInstanceRanges.assign(lodCount, glm::ivec2(1, 0));
+    std::string levels;
+    for (int lod = 0; lod < lodCount; lod++)
+        levels += fmt::format(" {}", m_lodTriangleCounts[lod]);
+    SPDLOG_INFO("model batches: {} meshes in {} draws, #face per lod:{}",
+        m_drawCommands.size() / lodCount, m_drawBatches.size(), levels);
+}
+
+int Model::SelectLod(const glm::mat4& projection, const glm::mat4& modelView, float viewportHeight) const {
+    // errors are in model units, scaled by the largest axis of the model matrix
+    float scale = std::max({ glm::length(glm::vec3(modelView[0])),
+        glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2])) });
+    auto center = glm::vec3(modelView * glm::vec4((m_boundsMin + m_boundsMax) * 0.5f, 1.0f));
+    float radius = glm::length(m_boundsMax - m_boundsMin) * 0.5f * scale;
+    // the nearest point of the bounding sphere, level 0 once the camera is inside
+    float distance = -center.z - radius;
+    if (distance <= 0.0f)
+        return 0;
+    float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f / distance;
+    int lod = 0;
+    while (lod + 1 < GetLodCount() && m_lodErrors[lod + 1] * scale * pixelsPerUnit <= LOD_PIXEL_ERROR)
+        lod++;
+    return lod;
+}
+
+uint64_t Model::GetSubmittedTriangleCount() {
+    return s_submittedTriangleCount;
+}
+
+void Model::ResetSubmittedTriangleCount() {
+    s_submittedTriangleCount = 0;
+}
+
+void Model::Draw(const Program* program, int lod) const {
+    DrawBatches(program, nullptr, 1, lod, 0);
 }
 
-void Model::Draw(const Program* program) const {
+void Model::SetInstanceBuffer(BufferPtr instanceBuffer) {
+    m_instanceBuffer = instanceBuffer;
     for (auto& mesh: m_meshes) {
-        mesh->Draw(program);
+        mesh->SetInstanceBuffer(instanceBuffer);
+    }
+}
+
+void Model::DrawInstanced(const Program* program, int instanceCount, int lod, int firstInstance) const {
+    if (!m_instanceBuffer) {
+        SPDLOG_ERROR("instanced draw without an instance buffer");
+        return;
     }
-}
\ No newline at end of file
+    DrawBatches(program, m_instanceBuffer.get(), instanceCount, lod, firstInstance);
+}
+
+void Model::DrawBatches(const Program* program, const Buffer* instanceBuffer,
+    int instanceCount, int lod, int firstInstance) const {
+    if (m_drawBatches.empty() || instanceCount <= 0)
+        return;
+    lod = std::clamp(lod, 0, GetLodCount() - 1);
+    uint32_t levelCommandCount = (uint32_t)(m_drawCommands.size() / GetLodCount());
+    uint32_t commandOffset = levelCommandCount * lod;
+    m_indirectBuffer->Bind();
+    if (instanceBuffer) {
+        commandOffset += (uint32_t)m_drawCommands.size();
+        // the instance range of a level rarely changes, so this is rarely an upload
+        auto range = glm::ivec2(instanceCount, firstInstance);
+        if (range != m_indirectInstanceRanges[lod]) {
+            std::vector<DrawElementsIndirectCommand> commands(
+                m_drawCommands.begin() + levelCommandCount * lod,
+                m_drawCommands.begin() + levelCommandCount * (lod + 1));
+            for (auto& command: commands) {
+                command.instanceCount = instanceCount;
+                command.baseInstance = firstInstance;
+            }
+            m_indirectBuffer->SetData(commands.data(), sizeof(DrawElementsIndirectCommand) * commands.size(),
+                sizeof(DrawElementsIndirectCommand) * commandOffset);
+            m_indirectInstanceRanges[lod] = range;
+        }
+    }
+    s_submittedTriangleCount += (uint64_t)m_lodTriangleCounts[lod] * instanceCount;
+
+    for (auto& batch: m_drawBatches) {
+        batch.mesh->GetArena()->Bind(instanceBuffer);
+        if (auto material = batch.mesh->GetMaterial()) {
+            material->SetToProgram(program);
+        }
+        batch.mesh->SetPositionTransform(program);
+        glMultiDrawElementsIndirect(batch.mesh->GetPrimitiveType(), batch.mesh->GetIndexType(),
+            (const void*)(sizeof(DrawElementsIndirectCommand) * (commandOffset + batch.firstCommand)),
+            batch.commandCount, 0);
+    }
+}
@@ -3,28 +3,78 @@
 
 #include "common.h"
 #include "mesh.h"
-
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include "cooked_mesh.h"
+#include "thread_pool.h"
 
 CLASS_PTR(Model);
 class Model {
 public:
-    static ModelUPtr Load(const std::string& filename);
+    // reads the cooked mesh from MESH_CACHE_DIRECTORY, imports the source
+    // (ObjLoader for .obj, Assimp otherwise) and cooks it first when the
+    // cache is missing or stale
+    static ModelUPtr Load(const std::string& filename, ThreadPool* threadPool = nullptr);
+    // the cook step of everything but .obj, the only user of Assimp
+    static bool LoadByAssimp(const std::string& filename,
+        std::vector<CookedMeshData>& meshes, std::vector<CookedMaterial>& materials,
+        ThreadPool* threadPool = nullptr);
 
     int GetMeshCount() const { return (int)m_meshes.size(); }
     MeshPtr GetMesh(int index) const { return m_meshes[index]; }
-    void Model::Draw(const Program* program) const;
+    const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+    // levels of detail built at cook time, the most of any mesh
+    int GetLodCount() const { return (int)m_lodErrors.size(); }
+    uint32_t GetLodTriangleCount(int lod) const { return m_lodTriangleCounts[lod]; }
+    // the coarsest level whose error covers at most LOD_PIXEL_ERROR pixels of
+    // a viewport viewportHeight pixels high, seen through modelView
+    int SelectLod(const glm::mat4& projection, const glm::mat4& modelView, float viewportHeight) const;
+
+    // one glMultiDrawElementsIndirect per material
+    void Model::Draw(const Program* program, int lod = 0) const;
+    void SetInstanceBuffer(BufferPtr instanceBuffer);
+    // instanceCount instances of the instance buffer from firstInstance on, batched like Draw
+    void DrawInstanced(const Program* program, int instanceCount, int lod = 0, int firstInstance = 0) const;
+
+    // triangles of every model draw since the last reset, instances included
+    static uint64_t GetSubmittedTriangleCount();
+    static void ResetSubmittedTriangleCount();
 
 private:
     Model() {}
-    bool LoadByAssimp(const std::string& filename);
-    void ProcessMesh(aiMesh* mesh, const aiScene* scene);
-    void ProcessNode(aiNode* node, const aiScene* scene);
+    void LoadCooked(const std::string& filename, const CookedMesh* cooked);
+    void LoadMaterials(const std::string& filename, const std::vector<CookedMaterial>& materials);
+    // quantized to the model bounds, so every mesh shares one position transform
+    void AddMesh(const Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount, int materialIndex,
+        const MeshLod* lods, int lodCount);
+    void BuildDrawBatches();
+    void DrawBatches(const Program* program, const Buffer* instanceBuffer,
+        int instanceCount, int lod, int firstInstance) const;
+
+    // meshes of one material, arena and index type
+    struct DrawBatch {
+        // the first mesh, its arena, material and position transform hold for all
+        MeshPtr mesh;
+        uint32_t firstCommand { 0 };
+        uint32_t commandCount { 0 };
+    };
         
     std::vector<MeshPtr> m_meshes;
     std::vector<MaterialPtr> m_materials;
+    glm::vec3 m_boundsMin { 0.0f };
+    glm::vec3 m_boundsMax { 0.0f };
+    std::vector<DrawBatch> m_drawBatches;
+    // the commands of every batch, one set per level of detail; a mesh with
+    // fewer levels repeats its coarsest one
+    std::vector<DrawElementsIndirectCommand> m_drawCommands;
+    // m_drawCommands twice, with instanceCount 1 for Draw and the last
+    // instance range of DrawInstanced per level
+    BufferUPtr m_indirectBuffer;
+    mutable std::vector<glm::ivec2> m_indirectInstanceRanges;
+    BufferPtr m_instanceBuffer;
+    // per level: the largest error of any mesh and the triangles of the model
+    std::vector<float> m_lodErrors;
+    std::vector<uint32_t> m_lodTriangleCounts;
 };
 
-#endif // __MODEL_H__
\ No newline at end of file
+#endif // __MODEL_H__
@@ -0,0 +1,615 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "tangent_generator.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const size_t MIN_CHUNK_SIZE = 256 * 1024;
+const size_t CORNER_GRAIN = 64 * 1024;
+const uint32_t INVALID_INDEX = 0xffffffff;
+
+enum ObjLine {
+    OBJ_LINE_OTHER,
+    OBJ_LINE_POSITION,
+    OBJ_LINE_TEXCOORD,
+    OBJ_LINE_NORMAL,
+    OBJ_LINE_FACE,
+    OBJ_LINE_USEMTL,
+    OBJ_LINE_MTLLIB,
+};
+
+// position, texcoord and normal index of a face corner, INVALID_INDEX when omitted
+struct ObjCorner {
+    uint32_t position;
+    uint32_t texCoord;
+    uint32_t normal;
+};
+
+struct MaterialRun {
+    size_t firstTriangle;
+    std::string name;
+};
+
+struct ObjChunk {
+    const char* begin { nullptr };
+    const char* end { nullptr };
+    size_t positionCount { 0 };
+    size_t texCoordCount { 0 };
+    size_t normalCount { 0 };
+    size_t triangleCount { 0 };
+    size_t positionBase { 0 };
+    size_t texCoordBase { 0 };
+    size_t normalBase { 0 };
+    // three corners per triangle
+    std::vector<ObjCorner> corners;
+    std::vector<MaterialRun> runs;
+    std::string mtllib;
+    bool failed { false };
+};
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool IsDigit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+const char* SkipSpace(const char* p, const char* end) {
+    while (p < end && IsSpace(*p))
+        p++;
+    return p;
+}
+
+const char* FindLineEnd(const char* p, const char* end) {
+    auto newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// the rest of the line without surrounding spaces
+std::string ReadRest(const char* p, const char* end) {
+    p = SkipSpace(p, end);
+    while (end > p && IsSpace(end[-1]))
+        end--;
+    return std::string(p, end);
+}
+
+// moves p past the keyword of the line
+ObjLine ClassifyLine(const char*& p, const char* end) {
+    p = SkipSpace(p, end);
+    auto keyword = p;
+    while (p < end && !IsSpace(*p))
+        p++;
+    size_t length = p - keyword;
+    auto is = [&](const char* name) {
+        return length == strlen(name) && memcmp(keyword, name, length) == 0;
+    };
+    if (length == 0 || keyword[0] == '#')
+        return OBJ_LINE_OTHER;
+    if (is("v")) return OBJ_LINE_POSITION;
+    if (is("vt")) return OBJ_LINE_TEXCOORD;
+    if (is("vn")) return OBJ_LINE_NORMAL;
+    if (is("f")) return OBJ_LINE_FACE;
+    if (is("usemtl")) return OBJ_LINE_USEMTL;
+    if (is("mtllib")) return OBJ_LINE_MTLLIB;
+    return OBJ_LINE_OTHER;
+}
+
+// decimal float: up to 19 significant digits are gathered in an integer and
+// scaled by an exact power of ten in double, within one ulp of strtof;
+// longer mantissas, large exponents and nan / inf fall back to strtof
+bool ParseFloat(const char*& p, const char* end, float& value) {
+    static const double POWERS[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    p = SkipSpace(p, end);
+    auto start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digitCount = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    bool exact = true;
+    for (; p < end && IsDigit(*p); p++) {
+        hasDigits = true;
+        if (digitCount < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digitCount += mantissa != 0;
+        }
+        else {
+            exponent++;
+            exact = false;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && IsDigit(*p); p++) {
+            hasDigits = true;
+            if (digitCount < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digitCount += mantissa != 0;
+                exponent--;
+            }
+            else
+                exact = false;
+        }
+    }
+    if (hasDigits && p < end && (*p == 'e' || *p == 'E')) {
+        auto q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && IsDigit(*q)) {
+            int e = 0;
+            for (; q < end && IsDigit(*q); q++)
+                e = std::min(e * 10 + (*q - '0'), 10000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    if (hasDigits && exact && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double)mantissa;
+        result = exponent < 0 ? result / POWERS[-exponent] : result * POWERS[exponent];
+        value = (float)(negative ? -result : result);
+        return true;
+    }
+
+    char buffer[64];
+    size_t length = std::min((size_t)(FindLineEnd(start, end) - start), sizeof(buffer) - 1);
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    char* parsedEnd = nullptr;
+    value = strtof(buffer, &parsedEnd);
+    if (parsedEnd == buffer)
+        return false;
+    p = start + (parsedEnd - buffer);
+    return true;
+}
+
+bool ParseIndex(const char*& p, const char* end, int64_t& value) {
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p >= end || !IsDigit(*p))
+        return false;
+    auto start = p;
+    value = 0;
+    for (; p < end && IsDigit(*p); p++)
+        value = value * 10 + (*p - '0');
+    if (p - start > 10)
+        value = INT32_MAX;
+    if (negative)
+        value = -value;
+    return true;
+}
+
+// 1-based or relative to the records read so far, base is where the chunk starts
+bool ResolveIndex(int64_t index, size_t base, size_t localCount, size_t totalCount, uint32_t& result) {
+    int64_t absolute = index > 0 ? index - 1 : (int64_t)(base + localCount) + index;
+    if (index == 0 || absolute < 0 || absolute >= (int64_t)totalCount)
+        return false;
+    result = (uint32_t)absolute;
+    return true;
+}
+
+template <typename Func>
+void ForEach(ThreadPool* threadPool, size_t count, size_t grainSize, const Func& func) {
+    if (threadPool)
+        threadPool->ParallelFor(count, grainSize, func);
+    else
+        func(0, count, 0);
+}
+
+std::vector<ObjChunk> SplitChunks(const char* data, size_t size, ThreadPool* threadPool) {
+    size_t threadCount = threadPool ? threadPool->GetThreadCount() : 1;
+    size_t chunkCount = std::max<size_t>(std::min(size / MIN_CHUNK_SIZE, threadCount * 4), 1);
+    std::vector<ObjChunk> chunks(chunkCount);
+    auto end = data + size;
+    auto begin = data;
+    for (size_t i = 0; i < chunkCount; i++) {
+        auto chunkEnd = end;
+        if (i + 1 < chunkCount) {
+            chunkEnd = FindLineEnd(std::max(data + size * (i + 1) / chunkCount, begin), end);
+            if (chunkEnd < end)
+                chunkEnd++;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        begin = chunkEnd;
+    }
+    return chunks;
+}
+
+void CountRecords(ObjChunk& chunk) {
+    for (auto p = chunk.begin; p < chunk.end;) {
+        auto lineEnd = FindLineEnd(p, chunk.end);
+        switch (ClassifyLine(p, lineEnd)) {
+            case OBJ_LINE_POSITION: chunk.positionCount++; break;
+            case OBJ_LINE_TEXCOORD: chunk.texCoordCount++; break;
+            case OBJ_LINE_NORMAL: chunk.normalCount++; break;
+            case OBJ_LINE_FACE: {
+                // corners are the space separated tokens, the fan has two less triangles
+                size_t cornerCount = 0;
+                for (p = SkipSpace(p, lineEnd); p < lineEnd && *p != '#'; p = SkipSpace(p, lineEnd)) {
+                    cornerCount++;
+                    while (p < lineEnd && !IsSpace(*p))
+                        p++;
+                }
+                chunk.triangleCount += cornerCount > 2 ? cornerCount - 2 : 0;
+                break;
+            }
+            default: break;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+struct ObjAttributes {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+};
+
+void ParseChunk(ObjChunk& chunk, ObjAttributes& attributes) {
+    size_t positionCount = 0;
+    size_t texCoordCount = 0;
+    size_t normalCount = 0;
+    std::vector<ObjCorner> polygon;
+    chunk.corners.reserve(chunk.triangleCount * 3);
+    for (auto p = chunk.begin; p < chunk.end && !chunk.failed;) {
+        auto lineEnd = FindLineEnd(p, chunk.end);
+        auto type = ClassifyLine(p, lineEnd);
+        float v[3] = {};
+        switch (type) {
+            case OBJ_LINE_POSITION:
+            case OBJ_LINE_NORMAL:
+                chunk.failed = !ParseFloat(p, lineEnd, v[0]) ||
+                    !ParseFloat(p, lineEnd, v[1]) || !ParseFloat(p, lineEnd, v[2]);
+                if (type == OBJ_LINE_POSITION)
+                    attributes.positions[chunk.positionBase + positionCount++] = glm::vec3(v[0], v[1], v[2]);
+                else
+                    attributes.normals[chunk.normalBase + normalCount++] = glm::vec3(v[0], v[1], v[2]);
+                break;
+            case OBJ_LINE_TEXCOORD:
+                // a missing v reads as 0, like the other readers
+                chunk.failed = !ParseFloat(p, lineEnd, v[0]);
+                if (!ParseFloat(p, lineEnd, v[1]))
+                    v[1] = 0.0f;
+                attributes.texCoords[chunk.texCoordBase + texCoordCount++] = glm::vec2(v[0], 1.0f - v[1]);
+                break;
+            case OBJ_LINE_FACE: {
+                polygon.clear();
+                while (!chunk.failed) {
+                    p = SkipSpace(p, lineEnd);
+                    if (p >= lineEnd || *p == '#')
+                        break;
+                    ObjCorner corner { INVALID_INDEX, INVALID_INDEX, INVALID_INDEX };
+                    int64_t index = 0;
+                    bool valid = ParseIndex(p, lineEnd, index) && ResolveIndex(index,
+                        chunk.positionBase, positionCount, attributes.positions.size(), corner.position);
+                    if (valid && p < lineEnd && *p == '/') {
+                        p++;
+                        if (p < lineEnd && *p != '/') {
+                            valid = ParseIndex(p, lineEnd, index) && ResolveIndex(index,
+                                chunk.texCoordBase, texCoordCount, attributes.texCoords.size(), corner.texCoord);
+                        }
+                        if (valid && p < lineEnd && *p == '/') {
+                            p++;
+                            valid = ParseIndex(p, lineEnd, index) && ResolveIndex(index,
+                                chunk.normalBase, normalCount, attributes.normals.size(), corner.normal);
+                        }
+                    }
+                    chunk.failed = !valid || (p < lineEnd && !IsSpace(*p));
+                    polygon.push_back(corner);
+                }
+                // triangle fan
+                for (size_t i = 2; i < polygon.size(); i++) {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i - 1]);
+                    chunk.corners.push_back(polygon[i]);
+                }
+                break;
+            }
+            case OBJ_LINE_USEMTL:
+                chunk.runs.push_back({ chunk.corners.size() / 3, ReadRest(p, lineEnd) });
+                break;
+            case OBJ_LINE_MTLLIB:
+                chunk.mtllib = ReadRest(p, lineEnd);
+                break;
+            default:
+                break;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+bool LoadMtl(const std::string& filename, std::vector<CookedMaterial>& materials,
+    std::unordered_map<std::string, int>& materialIndices) {
+    auto file = MappedFile::Open(filename);
+    if (!file) {
+        SPDLOG_ERROR("failed to read: {}", filename);
+        return false;
+    }
+    auto data = (const char*)file->GetData();
+    auto end = data + file->GetSize();
+    for (auto p = data; p < end;) {
+        auto lineEnd = FindLineEnd(p, end);
+        p = SkipSpace(p, lineEnd);
+        auto keyword = p;
+        while (p < lineEnd && !IsSpace(*p))
+            p++;
+        std::string name(keyword, p);
+        auto value = ReadRest(p, lineEnd);
+        // texture options come first, the path is the last token
+        if (!value.empty() && value[0] == '-')
+            value = value.substr(value.find_last_of(" \t") + 1);
+        if (name == "newmtl") {
+            materialIndices[value] = (int)materials.size();
+            materials.push_back(CookedMaterial());
+        }
+        else if (name == "map_Kd" && !materials.empty())
+            materials.back().diffuse = value;
+        else if (name == "map_Ks" && !materials.empty())
+            materials.back().specular = value;
+        p = lineEnd + 1;
+    }
+    return true;
+}
+
+bool operator==(const ObjCorner& a, const ObjCorner& b) {
+    return a.position == b.position && a.texCoord == b.texCoord && a.normal == b.normal;
+}
+
+// unique corners become vertices in order of first use.
+// The dedup map is keyed by position index: buckets holds the first unique
+// corner of every position and the ones with other texcoords / normals are
+// chained behind it. Faces reference nearby positions, so the buckets are
+// read almost in order instead of missing the cache on every corner.
+// buckets is all INVALID_INDEX on entry and on return.
+void BuildMesh(const std::vector<ObjCorner>& corners, const ObjAttributes& attributes,
+    std::vector<uint32_t>& buckets, CookedMeshData& mesh, ThreadPool* threadPool) {
+    TRACE_SCOPE("ObjLoader::BuildMesh");
+    size_t cornerCount = corners.size();
+    size_t positionCount = attributes.positions.size();
+
+    // one position range per thread, first uses are counted per range
+    size_t partitionCount = threadPool ? threadPool->GetThreadCount() : 1;
+    std::vector<uint32_t> partitionBegins(partitionCount + 1);
+    for (size_t i = 0; i <= partitionCount; i++)
+        partitionBegins[i] = (uint32_t)(positionCount * i / partitionCount);
+    // corners counting sorted by partition, in corner order within each
+    std::vector<uint32_t> cornerPartitions(cornerCount);
+    ForEach(threadPool, cornerCount, CORNER_GRAIN, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            cornerPartitions[i] = (uint32_t)(std::upper_bound(partitionBegins.begin() + 1,
+                partitionBegins.end(), corners[i].position) - partitionBegins.begin() - 1);
+        }
+    });
+    std::vector<uint32_t> partitionOffsets(partitionCount + 1, 0);
+    for (auto partition: cornerPartitions)
+        partitionOffsets[partition + 1]++;
+    for (size_t i = 0; i < partitionCount; i++)
+        partitionOffsets[i + 1] += partitionOffsets[i];
+    std::vector<uint32_t> partitionCorners(cornerCount);
+    {
+        std::vector<uint32_t> fill(partitionOffsets.begin(), partitionOffsets.end() - 1);
+        for (size_t i = 0; i < cornerCount; i++)
+            partitionCorners[fill[cornerPartitions[i]]++] = (uint32_t)i;
+    }
+
+    std::vector<uint32_t> localIds(cornerCount);
+    std::vector<uint32_t> uniqueCounts(partitionCount + 1, 0);
+    ForEach(threadPool, partitionCount, 1, [&](size_t begin, size_t end, int) {
+        for (size_t partition = begin; partition < end; partition++) {
+            // representative corner and next id in the bucket, per local id
+            std::vector<uint32_t> uniqueCorners;
+            std::vector<uint32_t> next;
+            for (uint32_t k = partitionOffsets[partition]; k < partitionOffsets[partition + 1]; k++) {
+                uint32_t i = partitionCorners[k];
+                auto position = corners[i].position;
+                uint32_t id = buckets[position];
+                while (id != INVALID_INDEX && !(corners[uniqueCorners[id]] == corners[i]))
+                    id = next[id];
+                if (id == INVALID_INDEX) {
+                    id = (uint32_t)uniqueCorners.size();
+                    uniqueCorners.push_back(i);
+                    next.push_back(buckets[position]);
+                    buckets[position] = id;
+                }
+                localIds[i] = id;
+            }
+            uniqueCounts[partition + 1] = (uint32_t)uniqueCorners.size();
+            for (auto corner: uniqueCorners)
+                buckets[corners[corner].position] = INVALID_INDEX;
+        }
+    });
+    for (size_t i = 0; i < partitionCount; i++)
+        uniqueCounts[i + 1] += uniqueCounts[i];
+
+    std::vector<uint32_t> remap(uniqueCounts[partitionCount], INVALID_INDEX);
+    std::vector<uint32_t> firstCorners;
+    firstCorners.reserve(remap.size());
+    mesh.indices.resize(cornerCount);
+    for (size_t i = 0; i < cornerCount; i++) {
+        auto& vertexIndex = remap[uniqueCounts[cornerPartitions[i]] + localIds[i]];
+        if (vertexIndex == INVALID_INDEX) {
+            vertexIndex = (uint32_t)firstCorners.size();
+            firstCorners.push_back((uint32_t)i);
+        }
+        mesh.indices[i] = vertexIndex;
+    }
+
+    bool missingNormals = false;
+    mesh.vertices.resize(firstCorners.size());
+    ForEach(threadPool, firstCorners.size(), CORNER_GRAIN, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            auto& corner = corners[firstCorners[i]];
+            auto& vertex = mesh.vertices[i];
+            vertex.position = attributes.positions[corner.position];
+            vertex.texCoord = corner.texCoord != INVALID_INDEX ?
+                attributes.texCoords[corner.texCoord] : glm::vec2(0.0f);
+            vertex.normal = corner.normal != INVALID_INDEX ?
+                attributes.normals[corner.normal] : glm::vec3(0.0f);
+            vertex.tangent = glm::vec4(0.0f);
+        }
+    });
+    for (auto index: firstCorners)
+        missingNormals |= corners[index].normal == INVALID_INDEX;
+
+    // area weighted face normals summed over every corner sharing the position
+    if (missingNormals) {
+        std::vector<glm::vec3> positionNormals(attributes.positions.size(), glm::vec3(0.0f));
+        for (size_t i = 0; i + 2 < cornerCount; i += 3) {
+            auto& p0 = attributes.positions[corners[i].position];
+            auto& p1 = attributes.positions[corners[i + 1].position];
+            auto& p2 = attributes.positions[corners[i + 2].position];
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            for (size_t j = 0; j < 3; j++)
+                positionNormals[corners[i + j].position] += normal;
+        }
+        for (size_t i = 0; i < firstCorners.size(); i++) {
+            auto& corner = corners[firstCorners[i]];
+            if (corner.normal != INVALID_INDEX)
+                continue;
+            auto normal = positionNormals[corner.position];
+            float length = glm::length(normal);
+            mesh.vertices[i].normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+    TangentGenerator::Generate(mesh.vertices.data(), mesh.vertices.size(),
+        mesh.indices.data(), mesh.indices.size(), threadPool);
+}
+
+} // namespace
+
+bool ObjLoader::Load(const std::string& filename,
+    std::vector<CookedMeshData>& meshes, std::vector<CookedMaterial>& materials,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("ObjLoader::Load");
+    auto start = std::chrono::steady_clock::now();
+    auto file = MappedFile::Open(filename);
+    if (!file) {
+        SPDLOG_ERROR("failed to load model: {}", filename);
+        return false;
+    }
+
+    auto data = (const char*)file->GetData();
+    auto chunks = SplitChunks(data, file->GetSize(), threadPool);
+    {
+        TRACE_SCOPE("ObjLoader::CountRecords");
+        ForEach(threadPool, chunks.size(), 1, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; i++)
+                CountRecords(chunks[i]);
+        });
+    }
+    ObjAttributes attributes;
+    size_t positionCount = 0;
+    size_t texCoordCount = 0;
+    size_t normalCount = 0;
+    for (auto& chunk: chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.normalBase = normalCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+    }
+    attributes.positions.resize(positionCount);
+    attributes.texCoords.resize(texCoordCount);
+    attributes.normals.resize(normalCount);
+    {
+        TRACE_SCOPE("ObjLoader::ParseChunks");
+        ForEach(threadPool, chunks.size(), 1, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; i++)
+                ParseChunk(chunks[i], attributes);
+        });
+    }
+    for (auto& chunk: chunks) {
+        if (chunk.failed) {
+            SPDLOG_ERROR("failed to parse model: {} (near byte {})", filename, chunk.begin - data);
+            return false;
+        }
+    }
+
+    auto slash = filename.find_last_of("/");
+    auto dirname = slash == std::string::npos ? std::string(".") : filename.substr(0, slash);
+    std::unordered_map<std::string, int> materialIndices;
+    for (auto& chunk: chunks) {
+        if (!chunk.mtllib.empty() &&
+            !LoadMtl(fmt::format("{}/{}", dirname, chunk.mtllib), materials, materialIndices))
+            SPDLOG_WARN("model without materials: {}", filename);
+    }
+
+    // triangles grouped into one mesh per material, in order of first use
+    std::vector<int> groupMaterials;
+    std::vector<std::vector<ObjCorner>> groupCorners;
+    size_t group = 0;
+    auto SelectMaterial = [&](int index) {
+        auto found = std::find(groupMaterials.begin(), groupMaterials.end(), index);
+        group = found - groupMaterials.begin();
+        if (found == groupMaterials.end()) {
+            groupMaterials.push_back(index);
+            groupCorners.emplace_back();
+        }
+    };
+    SelectMaterial(-1);
+    struct CornerSpan {
+        size_t group;
+        const ObjCorner* begin;
+        const ObjCorner* end;
+    };
+    std::vector<CornerSpan> spans;
+    for (auto& chunk: chunks) {
+        size_t triangle = 0;
+        for (size_t run = 0; run <= chunk.runs.size(); run++) {
+            size_t runEnd = run < chunk.runs.size() ? chunk.runs[run].firstTriangle : chunk.corners.size() / 3;
+            if (runEnd > triangle)
+                spans.push_back({ group, chunk.corners.data() + triangle * 3, chunk.corners.data() + runEnd * 3 });
+            triangle = runEnd;
+            if (run < chunk.runs.size()) {
+                auto found = materialIndices.find(chunk.runs[run].name);
+                SelectMaterial(found != materialIndices.end() ? found->second : -1);
+            }
+        }
+    }
+    std::vector<size_t> groupSizes(groupCorners.size(), 0);
+    for (auto& span: spans)
+        groupSizes[span.group] += span.end - span.begin;
+    for (size_t i = 0; i < groupCorners.size(); i++)
+        groupCorners[i].reserve(groupSizes[i]);
+    for (auto& span: spans)
+        groupCorners[span.group].insert(groupCorners[span.group].end(), span.begin, span.end);
+    chunks.clear();
+
+    std::vector<uint32_t> buckets(positionCount, INVALID_INDEX);
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    for (size_t i = 0; i < groupCorners.size(); i++) {
+        if (groupCorners[i].empty())
+            continue;
+        CookedMeshData mesh;
+        BuildMesh(groupCorners[i], attributes, buckets, mesh, threadPool);
+        mesh.materialIndex = groupMaterials[i];
+        vertexCount += mesh.vertices.size();
+        triangleCount += mesh.indices.size() / 3;
+        meshes.push_back(std::move(mesh));
+    }
+    SPDLOG_INFO("obj loaded: {} ({} meshes, #vert: {}, #face: {}, {:.1f} ms)", filename,
+        meshes.size(), vertexCount, triangleCount,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return !meshes.empty();
+}
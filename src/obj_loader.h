@@ -0,0 +1,27 @@
+#ifndef __OBJ_LOADER_H__
+#define __OBJ_LOADER_H__
+
+#include "common.h"
+#include "cooked_mesh.h"
+#include "thread_pool.h"
+#include <vector>
+
+// Wavefront OBJ reader for the cook step, in place of Assimp.
+// The mapped file is split into line aligned chunks that are parsed
+// across the thread pool: a counting pass gives every chunk the base of
+// its v / vt / vn records so positions land in their final slot and
+// relative face indices resolve without a second pass. Corners are then
+// deduplicated by (position, texcoord, normal): the positions are split
+// into one range per thread, each worker chains the distinct corners of
+// its positions behind a bucket per position, and vertices are numbered
+// by first use so the output does not depend on the thread count.
+// Faces are fan triangulated, one mesh per material, v is flipped like
+// aiProcess_FlipUVs and missing normals are generated smooth.
+class ObjLoader {
+public:
+    static bool Load(const std::string& filename,
+        std::vector<CookedMeshData>& meshes, std::vector<CookedMaterial>& materials,
+        ThreadPool* threadPool = nullptr);
+};
+
+#endif // __OBJ_LOADER_H__
@@ -0,0 +1,198 @@
+#include "pixel_convert.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (exponent == 0xFF)
+        return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    int halfExponent = (int)exponent - 127 + 15;
+    if (halfExponent >= 31)
+        return (uint16_t)(sign | 0x7C00);
+    if (halfExponent <= 0) {
+        // subnormal half, or zero when the value is too small
+        if (halfExponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    // a carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (uint16_t)(sign | half);
+}
+
+float HalfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            // normalize the subnormal half
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    }
+    else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+void ConvertFloatToHalf(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(SIMD_F16C)
+    for (; i + 8 <= count; i += 8) {
+        auto half = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), half);
+    }
+#elif defined(SIMD_NEON_A64)
+    for (; i + 4 <= count; i += 4)
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+#endif
+    for (; i < count; i++)
+        dst[i] = FloatToHalf(src[i]);
+}
+
+void ConvertHalfToFloat(const uint16_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#if defined(SIMD_F16C)
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+#elif defined(SIMD_NEON_A64)
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+#endif
+    for (; i < count; i++)
+        dst[i] = HalfToFloat(src[i]);
+}
+
+namespace {
+
+const int RGB9E5_MANTISSA_BITS = 9;
+const int RGB9E5_EXPONENT_BIAS = 15;
+const float RGB9E5_MAX = 65408.0f;  // (2^9 - 1) / 2^9 * 2^16
+
+float Pow2(int exponent) {
+    uint32_t bits = (uint32_t)(exponent + 127) << 23;
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+float ClampRGB9E5(float value) {
+    // also maps NaN to 0
+    return value > 0.0f ? std::min(value, RGB9E5_MAX) : 0.0f;
+}
+
+// 2^(e - 136) for every RGBE exponent byte, 0 for e == 0
+struct RgbeScaleTable {
+    RgbeScaleTable() {
+        scale[0] = 0.0f;
+        for (int e = 1; e < 256; e++)
+            scale[e] = ldexpf(1.0f, e - (128 + 8));
+    }
+    float scale[256];
+};
+
+const RgbeScaleTable RGBE_SCALE_TABLE;
+
+} // namespace
+
+uint32_t FloatToRGB9E5(float r, float g, float b) {
+    r = ClampRGB9E5(r);
+    g = ClampRGB9E5(g);
+    b = ClampRGB9E5(b);
+    float maxValue = std::max(r, std::max(g, b));
+
+    // floor(log2(maxValue)) from the float exponent, clamped to the smallest shared exponent
+    uint32_t bits;
+    memcpy(&bits, &maxValue, 4);
+    int exponent = std::max((int)((bits >> 23) & 0xFF) - 127, -RGB9E5_EXPONENT_BIAS - 1)
+        + 1 + RGB9E5_EXPONENT_BIAS;
+    float scale = Pow2(RGB9E5_EXPONENT_BIAS + RGB9E5_MANTISSA_BITS - exponent);
+    if ((int)(maxValue * scale + 0.5f) == (1 << RGB9E5_MANTISSA_BITS)) {
+        exponent++;
+        scale *= 0.5f;
+    }
+    uint32_t rm = (uint32_t)(r * scale + 0.5f);
+    uint32_t gm = (uint32_t)(g * scale + 0.5f);
+    uint32_t bm = (uint32_t)(b * scale + 0.5f);
+    return rm | (gm << 9) | (bm << 18) | ((uint32_t)exponent << 27);
+}
+
+void RGB9E5ToFloat(uint32_t value, float* rgb) {
+    float scale = Pow2((int)(value >> 27) - RGB9E5_EXPONENT_BIAS - RGB9E5_MANTISSA_BITS);
+    rgb[0] = (float)(value & 0x1FF) * scale;
+    rgb[1] = (float)((value >> 9) & 0x1FF) * scale;
+    rgb[2] = (float)((value >> 18) & 0x1FF) * scale;
+}
+
+void ConvertFloatToRGB9E5(const float* src, int srcChannelCount, uint32_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++, src += srcChannelCount)
+        dst[i] = FloatToRGB9E5(src[0], src[1], src[2]);
+}
+
+void ConvertRgbeToFloat(const uint8_t* rgbe, float* rgb, size_t count) {
+    auto table = RGBE_SCALE_TABLE.scale;
+    size_t i = 0;
+#if defined(SIMD_AVX2)
+    // 2 pixels per step, the 8 float store runs 2 floats into the next pair
+    auto exponentIndex = _mm256_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7);
+    auto packRgb = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    for (; i + 3 <= count; i += 2) {
+        auto values = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rgbe + i * 4)));
+        auto scale = _mm256_i32gather_ps(table, _mm256_permutevar8x32_epi32(values, exponentIndex), 4);
+        auto result = _mm256_mul_ps(_mm256_cvtepi32_ps(values), scale);
+        _mm256_storeu_ps(rgb + i * 3, _mm256_permutevar8x32_ps(result, packRgb));
+    }
+#elif defined(SIMD_SSE2)
+    // the 4 float store runs 1 float into the next pixel
+    auto zero = _mm_setzero_si128();
+    for (; i + 2 <= count; i++) {
+        int32_t bits;
+        memcpy(&bits, rgbe + i * 4, 4);
+        auto values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+        auto result = _mm_mul_ps(_mm_cvtepi32_ps(values), _mm_set1_ps(table[rgbe[i * 4 + 3]]));
+        _mm_storeu_ps(rgb + i * 3, result);
+    }
+#elif defined(SIMD_NEON)
+    for (; i + 2 <= count; i++) {
+        auto values = vmovl_u16(vget_low_u16(vmovl_u8(vld1_u8(rgbe + i * 4))));
+        auto result = vmulq_n_f32(vcvtq_f32_u32(values), table[rgbe[i * 4 + 3]]);
+        vst1q_f32(rgb + i * 3, result);
+    }
+#endif
+    for (; i < count; i++) {
+        float scale = table[rgbe[i * 4 + 3]];
+        rgb[i * 3 + 0] = rgbe[i * 4 + 0] * scale;
+        rgb[i * 3 + 1] = rgbe[i * 4 + 1] * scale;
+        rgb[i * 3 + 2] = rgbe[i * 4 + 2] * scale;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef __PIXEL_CONVERT_H__
+#define __PIXEL_CONVERT_H__
+
+#include "common.h"
+
+// IEEE 754 binary16 conversion, rounding to nearest even
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+void ConvertFloatToHalf(const float* src, uint16_t* dst, size_t count);
+void ConvertHalfToFloat(const uint16_t* src, float* dst, size_t count);
+
+// GL_RGB9_E5 shared exponent packing (GL_UNSIGNED_INT_5_9_9_9_REV),
+// negative values and NaN become 0, large values clamp to 65408
+uint32_t FloatToRGB9E5(float r, float g, float b);
+void RGB9E5ToFloat(uint32_t value, float* rgb);
+
+// src holds count pixels of srcChannelCount floats, only rgb is kept
+void ConvertFloatToRGB9E5(const float* src, int srcChannelCount, uint32_t* dst, size_t count);
+
+// Radiance RGBE pixels to RGB floats, same values as stb_image (mantissa * 2^(e - 136))
+void ConvertRgbeToFloat(const uint8_t* rgbe, float* rgb, size_t count);
+
+#endif // __PIXEL_CONVERT_H__
@@ -1,4 +1,8 @@
 #include "program.h"
+#include "trace.h"
+#include "gl_state.h"
+#include "frame_constants.h"
+#include <algorithm>
 
 ProgramUPtr Program::Create(const std::vector<ShaderPtr>& shaders) {
     auto program = ProgramUPtr(new Program());
@@ -19,11 +23,13 @@ ProgramUPtr Program::Create(
 
 Program::~Program() {
   if (m_program) {
+    GLState::OnProgramDeleted(m_program);
     glDeleteProgram(m_program);
   }
 }
 
 bool Program::Link(const std::vector<ShaderPtr>& shaders) {
+    TRACE_SCOPE("Program::Link");
     m_program = glCreateProgram();
     for (auto& shader: shaders)
         glAttachShader(m_program, shader->Get());
@@ -36,41 +42,175 @@ bool Program::Link(const std::vector<ShaderPtr>& shaders) {
         SPDLOG_ERROR("failed to link program: {}", infoLog);
         return false;
     }
+    ReflectUniforms(shaders);
+
+    // per-frame constants are shared by every program through a fixed binding point
+    auto blockIndex = glGetUniformBlockIndex(m_program, "FrameConstants");
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_program, blockIndex, FRAME_CONSTANTS_BINDING);
     return true;
 }
 
+void Program::ReflectUniforms(const std::vector<ShaderPtr>& shaders) {
+    int uniformCount = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<std::string> activeNames;
+    std::vector<std::pair<std::string, int32_t>> entries;
+    std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+    for (int i = 0; i < uniformCount; i++) {
+        int length = 0;
+        int size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_program, i, (GLsizei)nameBuffer.size(),
+            &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        auto location = glGetUniformLocation(m_program, name.c_str());
+        // uniform block members have no location
+        if (location < 0)
+            continue;
+
+        activeNames.push_back(name);
+        entries.emplace_back(name, location);
+        auto bracket = name.find('[');
+        if (bracket != std::string::npos) {
+            // arrays are reported as "name[0]", also register "name" and each element
+            auto baseName = name.substr(0, bracket);
+            entries.emplace_back(baseName, location);
+            for (int j = 1; j < size; j++) {
+                auto elementName = fmt::format("{}[{}]", baseName, j);
+                entries.emplace_back(elementName, glGetUniformLocation(m_program, elementName.c_str()));
+            }
+        }
+    }
+
+    // keep the table at most half full, array elements included
+    size_t capacity = 16;
+    while (capacity < entries.size() * 2)
+        capacity *= 2;
+    m_uniforms.assign(capacity, UniformSlot());
+    for (auto& entry: entries)
+        InsertUniform(entry.first, entry.second);
+
+    // report uniforms declared in the sources that the linker removed,
+    // setting them would otherwise be silently ignored
+    for (auto& shader: shaders) {
+        for (auto& declared: shader->GetUniformNames()) {
+            bool active = std::any_of(activeNames.begin(), activeNames.end(),
+                [&](const std::string& name) {
+                    return name == declared || (name.size() > declared.size() &&
+                        name.compare(0, declared.size(), declared) == 0 &&
+                        (name[declared.size()] == '.' || name[declared.size()] == '['));
+                });
+            if (active)
+                continue;
+            auto hash = UniformName::Hash(declared.c_str());
+            if (std::find(m_inactiveUniforms.begin(), m_inactiveUniforms.end(), hash) != m_inactiveUniforms.end())
+                continue;
+            m_inactiveUniforms.push_back(hash);
+            SPDLOG_WARN("uniform \"{}\" in \"{}\" is not active after linking, it will be ignored",
+                declared, shader->GetFilename());
+        }
+    }
+}
+
+void Program::InsertUniform(const std::string& name, int32_t location) {
+    auto hash = UniformName::Hash(name.c_str());
+    auto mask = m_uniforms.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        auto& slot = m_uniforms[i];
+        if (slot.hash == 0) {
+            slot.hash = hash;
+            slot.location = location;
+            slot.name = name;
+            return;
+        }
+        // names with the same hash take the next free slot
+        if (slot.hash == hash && slot.name == name)
+            return;
+    }
+}
+
+const Program::UniformSlot* Program::FindUniform(UniformName name) const {
+    if (m_uniforms.empty())
+        return nullptr;
+    auto mask = m_uniforms.size() - 1;
+    for (size_t i = name.hash & mask; ; i = (i + 1) & mask) {
+        auto& slot = m_uniforms[i];
+        if (slot.hash == name.hash && slot.name == name.name)
+            return &slot;
+        if (slot.hash == 0)
+            return nullptr;
+    }
+}
+
+int32_t Program::GetUniformLocation(UniformName name) const {
+    auto slot = FindUniform(name);
+    if (slot)
+        return slot->location;
+
+    // report unknown names once per program
+    bool inactive = std::find(m_inactiveUniforms.begin(), m_inactiveUniforms.end(), name.hash)
+        != m_inactiveUniforms.end();
+    bool reported = std::find(m_reportedUniforms.begin(), m_reportedUniforms.end(), name.hash)
+        != m_reportedUniforms.end();
+    if (!inactive && !reported) {
+        m_reportedUniforms.push_back(name.hash);
+        SPDLOG_WARN("unknown uniform \"{}\" in program {}", name.name, m_program);
+    }
+    return -1;
+}
+
 void Program::Use() const {
-    glUseProgram(m_program);
+    GLState::UseProgram(m_program);
+}
+
+void Program::SetUniform(UniformName name, int value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, int value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniform1i(loc, value);
+void Program::SetUniform(UniformName name, const glm::mat4& value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, const glm::mat4& value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+void Program::SetUniform(UniformName name, float value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, float value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniform1f(loc, value);
+void Program::SetUniform(UniformName name, const glm::vec2& value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, const glm::vec2& value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniform2fv(loc, 1, glm::value_ptr(value));
+void Program::SetUniform(UniformName name, const glm::vec3& value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, const glm::vec3& value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniform3fv(loc, 1, glm::value_ptr(value));
+void Program::SetUniform(UniformName name, const glm::vec4& value) const {
+    Upload(GetUniformLocation(name), value);
 }
 
-void Program::SetUniform(const std::string& name, const glm::vec4& value) const {
-    auto loc = glGetUniformLocation(m_program, name.c_str());
-    glUniform4fv(loc, 1, glm::value_ptr(value));
+void Program::Upload(int32_t location, int value) const {
+    glUniform1i(location, value);
 }
 
+void Program::Upload(int32_t location, const glm::mat4& value) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
 
+void Program::Upload(int32_t location, float value) const {
+    glUniform1f(location, value);
+}
+
+void Program::Upload(int32_t location, const glm::vec2& value) const {
+    glUniform2fv(location, 1, glm::value_ptr(value));
+}
+
+void Program::Upload(int32_t location, const glm::vec3& value) const {
+    glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void Program::Upload(int32_t location, const glm::vec4& value) const {
+    glUniform4fv(location, 1, glm::value_ptr(value));
+}
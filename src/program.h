@@ -4,6 +4,25 @@
 #include "common.h"
 #include "shader.h"
 
+// uniform name with its FNV-1a hash, computed at compile time for literals
+struct UniformName {
+    constexpr UniformName(const char* name) : hash(Hash(name)), name(name) {}
+    UniformName(const std::string& name) : hash(Hash(name.c_str())), name(name.c_str()) {}
+
+    static constexpr uint32_t Hash(const char* name) {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++) {
+            hash ^= (uint8_t)*name;
+            hash *= 16777619u;
+        }
+        // 0 marks an empty slot in the uniform table
+        return hash ? hash : 1u;
+    }
+
+    uint32_t hash;
+    const char* name;
+};
+
 CLASS_PTR(Program)
 class Program {
 public:
@@ -16,17 +35,45 @@ public:
     ~Program();
     uint32_t Get() const { return m_program; }
     void Use() const;
-    void SetUniform(const std::string& name, int value) const;
-    void SetUniform(const std::string& name, const glm::mat4& value) const;
-    void SetUniform(const std::string& name, float value) const;
-    void SetUniform(const std::string& name, const glm::vec2& value) const;
-    void SetUniform(const std::string& name, const glm::vec3& value) const;
-    void SetUniform(const std::string& name, const glm::vec4& value) const;
+
+    int32_t GetUniformLocation(UniformName name) const;
+    // no warning for optional uniforms
+    bool HasUniform(UniformName name) const { return FindUniform(name) != nullptr; }
+
+    void SetUniform(UniformName name, int value) const;
+    void SetUniform(UniformName name, const glm::mat4& value) const;
+    void SetUniform(UniformName name, float value) const;
+    void SetUniform(UniformName name, const glm::vec2& value) const;
+    void SetUniform(UniformName name, const glm::vec3& value) const;
+    void SetUniform(UniformName name, const glm::vec4& value) const;
 private:
+    // open addressing table of active uniforms, keyed by name hash;
+    // the name is kept so a colliding unknown name is not mistaken for it
+    struct UniformSlot {
+        uint32_t hash { 0 };
+        int32_t location { -1 };
+        std::string name;
+    };
+
     Program() {}
     bool Link(
         const std::vector<ShaderPtr>& shaders);
+    void ReflectUniforms(const std::vector<ShaderPtr>& shaders);
+    void InsertUniform(const std::string& name, int32_t location);
+    const UniformSlot* FindUniform(UniformName name) const;
+
+    void Upload(int32_t location, int value) const;
+    void Upload(int32_t location, const glm::mat4& value) const;
+    void Upload(int32_t location, float value) const;
+    void Upload(int32_t location, const glm::vec2& value) const;
+    void Upload(int32_t location, const glm::vec3& value) const;
+    void Upload(int32_t location, const glm::vec4& value) const;
+
     uint32_t m_program { 0 };
+    std::vector<UniformSlot> m_uniforms;
+    // names declared in the sources but optimized out by the linker
+    std::vector<uint32_t> m_inactiveUniforms;
+    mutable std::vector<uint32_t> m_reportedUniforms;
 };
 
-#endif // __PROGRAM_H__
\ No newline at end of file
+#endif // __PROGRAM_H__
@@ -0,0 +1,66 @@
+#include "render_target_pool.h"
+#include <algorithm>
+
+RenderTargetPoolUPtr RenderTargetPool::Create(uint32_t format, int granularity, int maxUnusedFrames) {
+    auto pool = RenderTargetPoolUPtr(new RenderTargetPool());
+    pool->m_format = format;
+    pool->m_granularity = std::max(granularity, 1);
+    pool->m_maxUnusedFrames = maxUnusedFrames;
+    return std::move(pool);
+}
+
+void RenderTargetPool::BeginFrame() {
+    m_frameIndex++;
+    m_targets.erase(std::remove_if(m_targets.begin(), m_targets.end(),
+        [this](const Target& target) {
+            return m_frameIndex - target.lastUsedFrame > (uint64_t)m_maxUnusedFrames;
+        }), m_targets.end());
+    for (auto& target: m_targets)
+        target.inUse = false;
+}
+
+const Framebuffer* RenderTargetPool::Acquire(int width, int height) {
+    Target* best = nullptr;
+    for (auto& target: m_targets) {
+        if (target.inUse || target.width < width || target.height < height)
+            continue;
+        if (!best || target.width * target.height < best->width * best->height)
+            best = &target;
+    }
+
+    if (!best) {
+        // a free target too small for the request is grown in place rather than
+        // kept next to the new one until it expires, the largest one so it
+        // still fits what it was used for
+        Target* grown = nullptr;
+        for (auto& target: m_targets) {
+            if (!target.inUse && (!grown || target.width * target.height > grown->width * grown->height))
+                grown = &target;
+        }
+        auto roundUp = [this](int size) {
+            return std::max((size + m_granularity - 1) / m_granularity * m_granularity, m_granularity);
+        };
+        Target target;
+        target.width = roundUp(std::max(width, grown ? grown->width : 0));
+        target.height = roundUp(std::max(height, grown ? grown->height : 0));
+        target.framebuffer = Framebuffer::Create({
+            Texture::Create(target.width, target.height, m_format) });
+        if (!target.framebuffer)
+            return nullptr;
+        if (grown) {
+            SPDLOG_INFO("render target pool: grew {}x{} target to {}x{}",
+                grown->width, grown->height, target.width, target.height);
+            *grown = std::move(target);
+            best = grown;
+        }
+        else {
+            SPDLOG_INFO("render target pool: created {}x{} target", target.width, target.height);
+            m_targets.push_back(std::move(target));
+            best = &m_targets.back();
+        }
+    }
+
+    best->inUse = true;
+    best->lastUsedFrame = m_frameIndex;
+    return best->framebuffer.get();
+}
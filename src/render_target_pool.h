@@ -0,0 +1,40 @@
+#ifndef __RENDER_TARGET_POOL_H__
+#define __RENDER_TARGET_POOL_H__
+
+#include "framebuffer.h"
+
+// Reuses offscreen framebuffers whose size changes every frame.
+// Sizes are rounded up to the granularity so small changes hit the
+// same target; when no free target is large enough, the largest free
+// one is grown to fit instead of adding another size to the pool.
+// Targets unused for maxUnusedFrames are released.
+CLASS_PTR(RenderTargetPool)
+class RenderTargetPool {
+public:
+    static RenderTargetPoolUPtr Create(uint32_t format = GL_RGBA,
+        int granularity = 64, int maxUnusedFrames = 120);
+
+    // frees every target for the new frame
+    void BeginFrame();
+    // smallest free target of at least width x height, valid until the next BeginFrame
+    const Framebuffer* Acquire(int width, int height);
+    int GetTargetCount() const { return (int)m_targets.size(); }
+
+private:
+    RenderTargetPool() {}
+
+    struct Target {
+        FramebufferUPtr framebuffer;
+        int width { 0 };
+        int height { 0 };
+        bool inUse { false };
+        uint64_t lastUsedFrame { 0 };
+    };
+    std::vector<Target> m_targets;
+    uint32_t m_format { GL_RGBA };
+    int m_granularity { 64 };
+    int m_maxUnusedFrames { 120 };
+    uint64_t m_frameIndex { 0 };
+};
+
+#endif // __RENDER_TARGET_POOL_H__
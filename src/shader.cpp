@@ -1,4 +1,7 @@
 #include "shader.h"
+#include "trace.h"
+#include <sstream>
+#include <filesystem>
 
 ShaderUPtr Shader::CreateFromFile(const std::string& filename, GLenum shaderType) {
     auto shader = std::unique_ptr<Shader>(new Shader());
@@ -15,11 +18,16 @@ Shader::~Shader() {
 }
 
 bool Shader::LoadFile(const std::string& filename, GLenum shaderType) {
+    TRACE_SCOPE("Shader::LoadFile");
     auto result = LoadTextFile(filename);
     if (!result.has_value())
         return false;
 
     auto& code = result.value();
+    m_filename = filename;
+    if (!ResolveIncludes(code))
+        return false;
+    ParseUniformNames(code);
     const char* codePtr = code.c_str();
     int32_t codeLength = (int32_t)code.length();
 
@@ -41,3 +49,57 @@ bool Shader::LoadFile(const std::string& filename, GLenum shaderType) {
     return true;
 }
 
+bool Shader::ResolveIncludes(std::string& code) const {
+    // the included lines count as source string 1, so compile errors
+    // keep the line numbers of both files
+    std::istringstream stream(code);
+    std::string resolved;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(stream, line)) {
+        lineNumber++;
+        auto start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            resolved += line + "\n";
+            continue;
+        }
+        auto nameStart = line.find('"', start);
+        auto nameEnd = nameStart == std::string::npos ? nameStart : line.find('"', nameStart + 1);
+        if (nameEnd == std::string::npos) {
+            SPDLOG_ERROR("invalid include in \"{}\" line {}", m_filename, lineNumber);
+            return false;
+        }
+        auto includeFilename = (std::filesystem::path(m_filename).parent_path() /
+            line.substr(nameStart + 1, nameEnd - nameStart - 1)).string();
+        auto included = LoadTextFile(includeFilename);
+        if (!included.has_value())
+            return false;
+        resolved += "#line 1 1\n" + included.value();
+        if (resolved.back() != '\n')
+            resolved += "\n";
+        resolved += fmt::format("#line {} 0\n", lineNumber + 1);
+    }
+    code = std::move(resolved);
+    return true;
+}
+
+void Shader::ParseUniformNames(const std::string& code) {
+    // collect names of plain "uniform <type> <name>;" declarations,
+    // uniform blocks are skipped
+    std::istringstream stream(code);
+    std::string line;
+    while (std::getline(stream, line)) {
+        auto start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "uniform ") != 0)
+            continue;
+        auto end = line.find_first_of(";[=", start);
+        if (end == std::string::npos)
+            continue;
+        auto declaration = line.substr(start, end - start);
+        auto nameEnd = declaration.find_last_not_of(" \t");
+        auto nameStart = declaration.find_last_of(" \t", nameEnd);
+        if (nameStart == std::string::npos)
+            continue;
+        m_uniformNames.push_back(declaration.substr(nameStart + 1, nameEnd - nameStart));
+    }
+}
@@ -2,6 +2,7 @@
 #define __SHADER_H__
 
 #include "common.h"
+#include <vector>
 
 CLASS_PTR(Shader);
 class Shader {
@@ -11,10 +12,17 @@ public:
 
     ~Shader();
     uint32_t Get() const { return m_shader; }        
+    const std::string& GetFilename() const { return m_filename; }
+    const std::vector<std::string>& GetUniformNames() const { return m_uniformNames; }
 private:
     Shader() {}
     bool LoadFile(const std::string& filename, GLenum shaderType);
+    // replaces #include "file" lines with the file next to the shader
+    bool ResolveIncludes(std::string& code) const;
+    void ParseUniformNames(const std::string& code);
     uint32_t m_shader { 0 };
+    std::string m_filename;
+    std::vector<std::string> m_uniformNames;
 };
 
 #endif // __SHADER_H__
\ No newline at end of file
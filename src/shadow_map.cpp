@@ -1,4 +1,5 @@
 #include "shadow_map.h"
+#include "gl_state.h"
 
 ShadowMapUPtr ShadowMap::Create(int width, int height) {
     auto shadowMap = ShadowMapUPtr(new ShadowMap());
@@ -9,12 +10,13 @@ ShadowMapUPtr ShadowMap::Create(int width, int height) {
 
 ShadowMap::~ShadowMap() {
     if (m_framebuffer) {
+        GLState::OnFramebufferDeleted(m_framebuffer);
         glDeleteFramebuffers(1, &m_framebuffer);
     }
 }
 
 void ShadowMap::Bind() const {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    GLState::BindFramebuffer(m_framebuffer);
 }
 
 bool ShadowMap::Init(int width, int height) {
@@ -33,9 +35,9 @@ bool ShadowMap::Init(int width, int height) {
     auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         SPDLOG_ERROR("failed to complete shadow map framebuffer: {:x}", status);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::BindFramebuffer(0);
         return false;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(0);
     return true;
 }
\ No newline at end of file
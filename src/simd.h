@@ -0,0 +1,30 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+// instruction sets enabled by the compiler flags
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+// half float conversion, implied by /arch:AVX2 on MSVC
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define SIMD_F16C 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+// AArch64 adds float division, rounding and half float conversion
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON_A64 1
+#endif
+#endif
+
+#endif // __SIMD_H__
@@ -0,0 +1,299 @@
+#include "tangent_generator.h"
+#include "simd.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const size_t TRIANGLE_GRAIN = 4096;
+// corners per chunk of the counting sort by vertex range
+const size_t CORNER_GRAIN = 64 * 1024;
+// triangles weighted at once, whole SIMD lanes
+const size_t TRIANGLE_BLOCK = 16;
+// contributions are at most pi long, summed in steps of 2^-32
+const float CONTRIBUTION_SCALE = 4294967296.0f;
+
+template <typename Func>
+void ForEach(ThreadPool* threadPool, size_t count, size_t grainSize, const Func& func) {
+    if (threadPool)
+        threadPool->ParallelFor(count, grainSize, func);
+    else
+        func(0, count, 0);
+}
+
+// 4 float lanes, so the corner kernel is written once for every instruction set
+#if defined(SIMD_SSE2)
+using Float4 = __m128;
+inline Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Splat(float v) { return _mm_set1_ps(v); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+inline Float4 Greater(Float4 a, Float4 b) { return _mm_cmpgt_ps(a, b); }
+inline Float4 And(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+// mask ? a : b
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#elif defined(SIMD_NEON_A64)
+using Float4 = float32x4_t;
+inline Float4 Load(const float* p) { return vld1q_f32(p); }
+inline void Store(float* p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Splat(float v) { return vdupq_n_f32(v); }
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+inline Float4 Min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 Sqrt(Float4 a) { return vsqrtq_f32(a); }
+inline Float4 Greater(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+inline Float4 And(Float4 a, Float4 b) {
+    return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+#else
+struct Float4 {
+    float v[4];
+};
+template <typename Op>
+inline Float4 Map(Float4 a, Float4 b, Op op) {
+    Float4 r;
+    for (int l = 0; l < 4; l++)
+        r.v[l] = op(a.v[l], b.v[l]);
+    return r;
+}
+inline Float4 Load(const float* p) { return Float4 { { p[0], p[1], p[2], p[3] } }; }
+inline void Store(float* p, Float4 v) { std::copy(v.v, v.v + 4, p); }
+inline Float4 Splat(float v) { return Float4 { { v, v, v, v } }; }
+inline Float4 Add(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return x + y; }); }
+inline Float4 Sub(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return x - y; }); }
+inline Float4 Mul(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return x * y; }); }
+inline Float4 Div(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return x / y; }); }
+inline Float4 Min(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return std::min(x, y); }); }
+inline Float4 Max(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return std::max(x, y); }); }
+inline Float4 Sqrt(Float4 a) { return Map(a, a, [](float x, float) { return std::sqrt(x); }); }
+// masks are 1 or 0 instead of all bits set
+inline Float4 Greater(Float4 a, Float4 b) { return Map(a, b, [](float x, float y) { return x > y ? 1.0f : 0.0f; }); }
+inline Float4 And(Float4 a, Float4 b) { return Mul(a, b); }
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+    Float4 r;
+    for (int l = 0; l < 4; l++)
+        r.v[l] = mask.v[l] != 0.0f ? a.v[l] : b.v[l];
+    return r;
+}
+#endif
+
+inline Float4 Dot(const Float4* a, const Float4* b) {
+    return Add(Add(Mul(a[0], b[0]), Mul(a[1], b[1])), Mul(a[2], b[2]));
+}
+
+// Abramowitz and Stegun 4.4.46, |error| <= 2e-8 on [-1, 1]
+inline Float4 Acos(Float4 x) {
+    auto zero = Splat(0.0f);
+    auto a = Max(x, Sub(zero, x));
+    auto p = Splat(-0.0012624911f);
+    p = Add(Mul(p, a), Splat(0.0066700901f));
+    p = Add(Mul(p, a), Splat(-0.0170881256f));
+    p = Add(Mul(p, a), Splat(0.0308918810f));
+    p = Add(Mul(p, a), Splat(-0.0501743046f));
+    p = Add(Mul(p, a), Splat(0.0889789874f));
+    p = Add(Mul(p, a), Splat(-0.2145988016f));
+    p = Add(Mul(p, a), Splat(1.5707963050f));
+    auto r = Mul(Sqrt(Max(Sub(Splat(1.0f), a), zero)), p);
+    return Select(Greater(zero, x), Sub(Splat(3.14159265f), r), r);
+}
+
+// triangles in structure of arrays form, zero padded to a multiple of 4
+struct TriangleBlock {
+    float position[3][3][TRIANGLE_BLOCK];
+    float normal[3][3][TRIANGLE_BLOCK];
+    float texCoord[3][2][TRIANGLE_BLOCK];
+};
+
+// the face tangent of every triangle, then for each of its corners the
+// tangent on the normal plane, normalized and weighted by the corner angle
+// measured on the same plane
+void WeightCorners(const TriangleBlock& block, size_t count, glm::vec4* contributions) {
+    auto zero = Splat(0.0f);
+    auto one = Splat(1.0f);
+    for (size_t i = 0; i < count; i += 4) {
+        Float4 p[3][3], uv[3][2];
+        for (int k = 0; k < 3; k++) {
+            for (int c = 0; c < 3; c++)
+                p[k][c] = Load(&block.position[k][c][i]);
+            for (int c = 0; c < 2; c++)
+                uv[k][c] = Load(&block.texCoord[k][c][i]);
+        }
+        // the uv gradient times the signed uv area, normalized with the sign kept
+        Float4 edge1[3], edge2[3], faceTangent[3];
+        for (int c = 0; c < 3; c++) {
+            edge1[c] = Sub(p[1][c], p[0][c]);
+            edge2[c] = Sub(p[2][c], p[0][c]);
+        }
+        auto deltaU1 = Sub(uv[1][0], uv[0][0]);
+        auto deltaV1 = Sub(uv[1][1], uv[0][1]);
+        auto deltaU2 = Sub(uv[2][0], uv[0][0]);
+        auto deltaV2 = Sub(uv[2][1], uv[0][1]);
+        auto signedArea = Sub(Mul(deltaU1, deltaV2), Mul(deltaV1, deltaU2));
+        for (int c = 0; c < 3; c++)
+            faceTangent[c] = Sub(Mul(deltaV2, edge1[c]), Mul(deltaV1, edge2[c]));
+        auto faceSquared = Dot(faceTangent, faceTangent);
+        auto orientation = Select(Greater(signedArea, zero), one, Splat(-1.0f));
+        auto faceValid = And(Greater(faceSquared, zero),
+            Greater(Max(signedArea, Sub(zero, signedArea)), zero));
+        auto faceScale = Select(faceValid, Div(orientation, Sqrt(Select(faceValid, faceSquared, one))), zero);
+        for (int c = 0; c < 3; c++)
+            faceTangent[c] = Mul(faceTangent[c], faceScale);
+
+        for (int k = 0; k < 3; k++) {
+            Float4 n[3], a[3], b[3], t[3];
+            for (int c = 0; c < 3; c++) {
+                n[c] = Load(&block.normal[k][c][i]);
+                a[c] = Sub(p[(k + 1) % 3][c], p[k][c]);
+                b[c] = Sub(p[(k + 2) % 3][c], p[k][c]);
+            }
+            auto na = Dot(n, a);
+            auto nb = Dot(n, b);
+            auto nt = Dot(n, faceTangent);
+            for (int c = 0; c < 3; c++) {
+                a[c] = Sub(a[c], Mul(n[c], na));
+                b[c] = Sub(b[c], Mul(n[c], nb));
+                t[c] = Sub(faceTangent[c], Mul(n[c], nt));
+            }
+            auto sidesSquared = Mul(Dot(a, a), Dot(b, b));
+            auto tangentSquared = Dot(t, t);
+            auto valid = And(Greater(sidesSquared, zero), Greater(tangentSquared, zero));
+            auto cosine = Div(Dot(a, b), Sqrt(Select(valid, sidesSquared, one)));
+            auto angle = Select(valid, Acos(Min(Max(cosine, Splat(-1.0f)), one)), zero);
+            auto scale = Div(angle, Sqrt(Select(valid, tangentSquared, one)));
+
+            float lanes[4][4];
+            for (int c = 0; c < 3; c++)
+                Store(lanes[c], Mul(t[c], scale));
+            Store(lanes[3], Mul(orientation, angle));
+            for (size_t l = 0; l < 4 && i + l < count; l++)
+                contributions[(i + l) * 3 + k] = glm::vec4(lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l]);
+        }
+    }
+}
+
+// a unit vector perpendicular to n, for vertices without a uv gradient
+glm::vec3 Perpendicular(const glm::vec3& n) {
+    auto axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    auto tangent = glm::cross(n, axis);
+    float length = glm::length(tangent);
+    return length > 0.0f ? tangent / length : glm::vec3(1.0f, 0.0f, 0.0f);
+}
+
+} // namespace
+
+void TangentGenerator::Generate(Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount, ThreadPool* threadPool) {
+    TRACE_SCOPE("TangentGenerator::Generate");
+    size_t triangleCount = indexCount / 3;
+
+    // per corner, xyz: the face tangent weighted by the corner angle,
+    // w: the angle, negative where the uv mapping is mirrored
+    std::vector<glm::vec4> contributions(triangleCount * 3);
+    ForEach(threadPool, triangleCount, TRIANGLE_GRAIN, [&](size_t begin, size_t end, int) {
+        TriangleBlock block {};
+        for (size_t first = begin; first < end; first += TRIANGLE_BLOCK) {
+            size_t count = std::min(TRIANGLE_BLOCK, end - first);
+            for (size_t j = 0; j < count; j++) {
+                for (int k = 0; k < 3; k++) {
+                    auto& vertex = vertices[indices[(first + j) * 3 + k]];
+                    for (int c = 0; c < 3; c++) {
+                        block.position[k][c][j] = vertex.position[c];
+                        block.normal[k][c][j] = vertex.normal[c];
+                    }
+                    for (int c = 0; c < 2; c++)
+                        block.texCoord[k][c][j] = vertex.texCoord[c];
+                }
+            }
+            // padding lanes of a partial block weigh nothing
+            for (size_t j = count; j % 4 != 0; j++) {
+                for (int k = 0; k < 3; k++) {
+                    for (int c = 0; c < 3; c++)
+                        block.position[k][c][j] = block.normal[k][c][j] = 0.0f;
+                    for (int c = 0; c < 2; c++)
+                        block.texCoord[k][c][j] = 0.0f;
+                }
+            }
+            WeightCorners(block, count, contributions.data() + first * 3);
+        }
+    });
+
+    // one vertex range per thread, the corners are counting sorted by range
+    // in parallel chunks so every range sums only its own corners. Sums are
+    // fixed point, integer sums do not depend on the order of the corners
+    size_t cornerCount = triangleCount * 3;
+    size_t rangeCount = threadPool ? threadPool->GetThreadCount() : 1;
+    size_t rangeSize = std::max<size_t>((vertexCount + rangeCount - 1) / rangeCount, 1);
+    std::vector<uint32_t> rangeOffsets { 0, (uint32_t)cornerCount };
+    // a single range walks the corners as they are
+    std::vector<uint32_t> rangeCorners;
+    if (rangeCount > 1) {
+        size_t chunkCount = (cornerCount + CORNER_GRAIN - 1) / CORNER_GRAIN;
+        // corner count of every range per chunk, then where the chunk writes them
+        std::vector<uint32_t> chunkOffsets(chunkCount * rangeCount, 0);
+        ForEach(threadPool, chunkCount, 1, [&](size_t begin, size_t end, int) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                auto offsets = chunkOffsets.data() + chunk * rangeCount;
+                size_t last = std::min(cornerCount, (chunk + 1) * CORNER_GRAIN);
+                for (size_t i = chunk * CORNER_GRAIN; i < last; i++)
+                    offsets[indices[i] / rangeSize]++;
+            }
+        });
+        // range major, so the corners of a range are contiguous and in corner order
+        rangeOffsets.resize(rangeCount + 1);
+        uint32_t offset = 0;
+        for (size_t range = 0; range < rangeCount; range++) {
+            rangeOffsets[range] = offset;
+            for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+                auto& count = chunkOffsets[chunk * rangeCount + range];
+                uint32_t next = offset + count;
+                count = offset;
+                offset = next;
+            }
+        }
+        rangeOffsets[rangeCount] = offset;
+        rangeCorners.resize(cornerCount);
+        ForEach(threadPool, chunkCount, 1, [&](size_t begin, size_t end, int) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                auto offsets = chunkOffsets.data() + chunk * rangeCount;
+                size_t last = std::min(cornerCount, (chunk + 1) * CORNER_GRAIN);
+                for (size_t i = chunk * CORNER_GRAIN; i < last; i++)
+                    rangeCorners[offsets[indices[i] / rangeSize]++] = (uint32_t)i;
+            }
+        });
+    }
+
+    std::vector<std::array<int64_t, 4>> sums(vertexCount);
+    ForEach(threadPool, rangeCount, 1, [&](size_t begin, size_t end, int) {
+        for (size_t range = begin; range < end; range++) {
+            for (uint32_t k = rangeOffsets[range]; k < rangeOffsets[range + 1]; k++) {
+                uint32_t i = rangeCorners.empty() ? k : rangeCorners[k];
+                auto& sum = sums[indices[i]];
+                for (int c = 0; c < 4; c++)
+                    sum[c] += (int64_t)(contributions[i][c] * CONTRIBUTION_SCALE);
+            }
+            size_t last = std::min(vertexCount, (range + 1) * rangeSize);
+            for (size_t v = range * rangeSize; v < last; v++) {
+                auto& sum = sums[v];
+                auto tangent = glm::vec3((float)sum[0], (float)sum[1], (float)sum[2]);
+                float length = glm::length(tangent);
+                tangent = length > 0.0f ? tangent / length : Perpendicular(vertices[v].normal);
+                vertices[v].tangent = glm::vec4(tangent, sum[3] < 0 ? -1.0f : 1.0f);
+            }
+        }
+    });
+}
@@ -0,0 +1,29 @@
+#ifndef __TANGENT_GENERATOR_H__
+#define __TANGENT_GENERATOR_H__
+
+#include "common.h"
+#include "vertex_format.h"
+#include "thread_pool.h"
+
+// Per-vertex tangent frames of an indexed triangle list, angle weighted
+// like MikkTSpace (Mikkelsen 2008) but not compatible with it:
+// - the tangent of a face is its normalized uv gradient, flipped where the
+//   uv mapping is mirrored
+// - every corner projects it onto the vertex normal plane and weights it by
+//   the corner angle
+// - tangent.w is the bitangent sign, B = tangent.w * cross(N, T)
+// Vertices are taken as they are, not welded or split. MikkTSpace keeps
+// mirrored and unmirrored faces apart; here a vertex shared by both sums
+// them into one frame, so its tangent can cancel out and it gets the sign
+// of the larger angle. Split such vertices first where that matters.
+// Faces run in parallel into per-corner contributions, four triangles per
+// SIMD lane group; every thread then sums the corners of its own vertex
+// range in fixed point, so the result is the same for any thread count and
+// triangle order.
+class TangentGenerator {
+public:
+    static void Generate(Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount, ThreadPool* threadPool = nullptr);
+};
+
+#endif // __TANGENT_GENERATOR_H__
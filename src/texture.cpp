@@ -1,4 +1,10 @@
 #include "texture.h"
+#include "cooked_texture.h"
+#include "gl_state.h"
+#include "pixel_convert.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
 
 TextureUPtr Texture::Create(int width, int height, uint32_t format, uint32_t type) {
     auto texture = TextureUPtr(new Texture());
@@ -17,12 +23,13 @@ TextureUPtr Texture::CreateFromImage(const Image* image) {
 
 Texture::~Texture() {
     if (m_texture) {
+        GLState::OnTextureDeleted(m_texture);
         glDeleteTextures(1, &m_texture);
     }
 }
 
 void Texture::Bind() const {
-    glBindTexture(GL_TEXTURE_2D, m_texture);
+    GLState::BindTexture(GL_TEXTURE_2D, m_texture);
 }
 
 void Texture::SetFilter(uint32_t minFilter, uint32_t magFilter) const {
@@ -35,6 +42,26 @@ void Texture::SetWrap(uint32_t sWrap, uint32_t tWrap) const {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tWrap);
 }
     
+TextureUPtr Texture::CreateFromHdrFile(const std::string& filepath, UploadStream* stream) {
+    TRACE_SCOPE("Texture::CreateFromHdrFile");
+    auto reader = HdrReader::Open(filepath);
+    if (!reader)
+        return nullptr;
+    auto texture = TextureUPtr(new Texture());
+    texture->CreateTexture();
+    if (!texture->SetTextureFromHdr(reader.get(), stream))
+        return nullptr;
+    return std::move(texture);
+}
+
+TextureUPtr Texture::CreateFromCooked(const CookedTexture* cooked) {
+    TRACE_SCOPE("Texture::CreateFromCooked");
+    auto texture = TextureUPtr(new Texture());
+    texture->CreateTexture();
+    texture->SetTextureFromCooked(cooked);
+    return std::move(texture);
+}
+
 void Texture::CreateTexture() {
     glGenTextures(1, &m_texture);
     // bind and set default filter and wrap option
@@ -43,38 +70,145 @@ void Texture::CreateTexture() {
     SetWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
 }
 
-void Texture::SetTextureFromImage(const Image* image) {
-    GLenum format = GL_RGBA;
+// client format and type that match the image storage, so the driver copies without converting
+static void GetImageUploadFormat(const Image* image,
+    GLenum& internalFormat, GLenum& format, GLenum& type) {
+    format = GL_RGBA;
     switch (image->GetChannelCount()) {
         default: break;
         case 1: format = GL_RED; break;
         case 2: format = GL_RG; break;
         case 3: format = GL_RGB; break;
     }
-    
-    m_width = image->GetWidth();
-    m_height = image->GetHeight();
-    m_format = format;
-    m_type = GL_UNSIGNED_BYTE;
 
-    if (image->GetBytePerChannel() == 4) {
-        m_type = GL_FLOAT;
-        switch (image->GetChannelCount()) {
-            default: break;
-            case 1: m_format = GL_R16F; break;
-            case 2: m_format = GL_RG16F; break;
-            case 3: m_format = GL_RGB16F; break;
-            case 4: m_format = GL_RGBA16F; break;
-        }
+    switch (image->GetStorage()) {
+        default:
+            internalFormat = format;
+            type = GL_UNSIGNED_BYTE;
+            break;
+        case IMAGE_STORAGE_FLOAT:
+        case IMAGE_STORAGE_HALF:
+            type = image->GetStorage() == IMAGE_STORAGE_HALF ? GL_HALF_FLOAT : GL_FLOAT;
+            switch (image->GetChannelCount()) {
+                case 1: internalFormat = GL_R16F; break;
+                case 2: internalFormat = GL_RG16F; break;
+                case 3: internalFormat = GL_RGB16F; break;
+                default: internalFormat = GL_RGBA16F; break;
+            }
+            break;
+        case IMAGE_STORAGE_RGB9E5:
+            internalFormat = GL_RGB9_E5;
+            type = GL_UNSIGNED_INT_5_9_9_9_REV;
+            break;
     }
+}
 
-    
+// rows of RGB / half images are not always 4 byte aligned
+static void SetUnpackAlignment(const Image* image) {
+    int rowSize = image->GetWidth() * image->GetBytePerPixel();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, rowSize % 4 == 0 ? 4 : 1);
+}
+
+void Texture::SetTextureFromImage(const Image* image) {
+    GLenum internalFormat, format, type;
+    GetImageUploadFormat(image, internalFormat, format, type);
+
+    m_width = image->GetWidth();
+    m_height = image->GetHeight();
+    m_format = internalFormat;
+    m_type = type;
+
+    SetUnpackAlignment(image);
     glTexImage2D(GL_TEXTURE_2D, 0, m_format,
         m_width, m_height, 0,
         format, m_type,
         image->GetData());
-    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // RGB9_E5 is not color renderable, so glGenerateMipmap can't fill its mips
+    if (m_format == GL_RGB9_E5) {
+        SetFilter(GL_LINEAR, GL_LINEAR);
+        return;
+    }
+    glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+bool Texture::SetTextureFromHdr(HdrReader* reader, UploadStream* stream) {
+    int width = reader->GetWidth();
+    int height = reader->GetHeight();
+    SetTextureFormat(width, height, GL_RGB16F, GL_HALF_FLOAT);
+
+    size_t rowSize = (size_t)width * 3 * sizeof(uint16_t);
+    size_t bandSize = stream ? stream->GetChunkSize() : rowSize * 64;
+    if (rowSize > bandSize) {
+        SPDLOG_ERROR("hdr row of {} bytes does not fit an upload chunk", rowSize);
+        return false;
+    }
+    int bandRowCount = (int)(bandSize / rowSize);
+    std::vector<float> scanline((size_t)width * 3);
+    std::vector<uint8_t> band;
+
+    bool result = true;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, rowSize % 4 == 0 ? 4 : 1);
+    while (result && reader->GetNextRow() < height) {
+        int firstRow = reader->GetNextRow();
+        int rowCount = std::min(bandRowCount, height - firstRow);
+        // a chunk that fails to map goes through client memory instead
+        auto dst = stream ? stream->BeginChunk() : nullptr;
+        bool streamed = dst != nullptr;
+        if (!streamed) {
+            band.resize(bandSize);
+            dst = band.data();
+        }
+        for (int i = 0; i < rowCount && result; i++) {
+            result = reader->ReadScanline(scanline.data());
+            // GL stores the bottom row first, so the band is filled upside down
+            if (result) {
+                ConvertFloatToHalf(scanline.data(),
+                    (uint16_t*)(dst + (rowCount - 1 - i) * rowSize), scanline.size());
+            }
+        }
+        const void* pixels = streamed ? stream->FlushChunk() : band.data();
+        if (result) {
+            Bind();
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, height - firstRow - rowCount,
+                width, rowCount, GL_RGB, GL_HALF_FLOAT, pixels);
+        }
+        if (streamed)
+            stream->EndChunk();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (!result)
+        return false;
+
     glGenerateMipmap(GL_TEXTURE_2D);
+    return true;
+}
+
+void Texture::SetTextureFromCooked(const CookedTexture* cooked) {
+    m_width = cooked->GetWidth();
+    m_height = cooked->GetHeight();
+    m_format = cooked->GetInternalFormat();
+    m_type = GL_UNSIGNED_BYTE;
+
+    // immutable storage for the whole chain, then every level as it was cooked.
+    // block rows are always 4 byte aligned, uncompressed levels are RGBA8
+    int levelCount = cooked->GetLevelCount();
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, m_format, m_width, m_height);
+    for (int level = 0; level < levelCount; level++) {
+        int width = cooked->GetLevelWidth(level);
+        int height = cooked->GetLevelHeight(level);
+        if (TextureCodec::IsCompressed(cooked->GetFormat())) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, m_format,
+                (GLsizei)cooked->GetLevelSize(level), cooked->GetLevelData(level));
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height,
+                GL_RGBA, GL_UNSIGNED_BYTE, cooked->GetLevelData(level));
+        }
+    }
+    if (levelCount == 1)
+        SetFilter(GL_LINEAR, GL_LINEAR);
 }
 
 static GLenum GetImageFormat(uint32_t internalFormat) {
@@ -84,7 +218,11 @@ static GLenum GetImageFormat(uint32_t internalFormat) {
     }
     else if (internalFormat == GL_RGB ||
         internalFormat == GL_RGB16F ||
-        internalFormat == GL_RGB32F) {
+        internalFormat == GL_RGB32F ||
+        // packed types (GL_UNSIGNED_INT_5_9_9_9_REV, GL_UNSIGNED_INT_10F_11F_11F_REV)
+        // are only valid with GL_RGB
+        internalFormat == GL_RGB9_E5 ||
+        internalFormat == GL_R11F_G11F_B10F) {
         imageFormat = GL_RGB;
     }
     else if (internalFormat == GL_RG ||
@@ -134,12 +272,13 @@ CubeTextureUPtr CubeTexture::Create(int width, int height, uint32_t format, uint
 
 CubeTexture::~CubeTexture() {   
     if (m_texture) {
+        GLState::OnTextureDeleted(m_texture);
         glDeleteTextures(1, &m_texture);
     }
 }
 
 void CubeTexture::Bind() const {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);    
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
 }
 
 bool CubeTexture::InitFromImages(const std::vector<Image*>& images) {
@@ -154,22 +293,18 @@ bool CubeTexture::InitFromImages(const std::vector<Image*>& images) {
 
     m_width = images[0]->GetWidth();
     m_height = images[0]->GetHeight();
-    m_type = images[0]->GetBytePerChannel() == 4 ? GL_FLOAT : GL_UNSIGNED_BYTE;
-    m_format = images[0]->GetBytePerChannel() == 4 ? GL_RGB16F : GL_RGB;
 
     for (uint32_t i = 0; i < (uint32_t)images.size(); i++) {
         auto image = images[i];
-        GLenum format = GL_RGBA;
-        switch (image->GetChannelCount()) {
-            default: break;
-            case 1: format = GL_RED; break;
-            case 2: format = GL_RG; break;
-            case 3: format = GL_RGB; break;
-        }
+        GLenum internalFormat, format;
+        GetImageUploadFormat(image, internalFormat, format, m_type);
+        m_format = internalFormat;
 
+        SetUnpackAlignment(image);
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, m_format, 
         m_width, m_height, 0, format, m_type, image->GetData());
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
     return true;
 }
@@ -196,7 +331,8 @@ void CubeTexture::Init(int width, int height, int format, uint32_t type) {
     }
 }
 
-void CubeTexture::GenerateMipmap() const {
+void CubeTexture::GenerateMipmap() {
+    m_mipLevelCount = (int)floor(log2((float)std::max(m_width, m_height))) + 1;
     Bind();
     glTexParameteri(GL_TEXTURE_CUBE_MAP,
         GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -204,3 +340,15 @@ void CubeTexture::GenerateMipmap() const {
         GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 }
+
+void CubeTexture::SetFaceData(int face, int level, uint32_t format, uint32_t type, const void* data) {
+    Bind();
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, m_format,
+        std::max(m_width >> level, 1), std::max(m_height >> level, 1), 0,
+        format, type, data);
+    if (level >= m_mipLevelCount) {
+        m_mipLevelCount = level + 1;
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+}
@@ -2,12 +2,20 @@
 #define __TEXTURE_H__
 
 #include "image.h"
+#include "upload_stream.h"
+
+class CookedTexture;
 
 CLASS_PTR(Texture)
 class Texture {
 public:
     static TextureUPtr Create(int width, int height, uint32_t format, uint32_t type = GL_UNSIGNED_BYTE);
     static TextureUPtr CreateFromImage(const Image* image);
+    // decodes a .hdr file band by band straight into RGB16F storage
+    // through the upload stream (client memory when stream is nullptr)
+    static TextureUPtr CreateFromHdrFile(const std::string& filepath, UploadStream* stream);
+    // immutable storage filled with the cooked mip chain, block compressed levels as is
+    static TextureUPtr CreateFromCooked(const CookedTexture* cooked);
     ~Texture();
 
     const uint32_t Get() const { return m_texture; }
@@ -25,6 +33,8 @@ private:
     Texture() {}
     void CreateTexture();
     void SetTextureFromImage(const Image* image);
+    bool SetTextureFromHdr(HdrReader* reader, UploadStream* stream);
+    void SetTextureFromCooked(const CookedTexture* cooked);
     void SetTextureFormat(int width, int height, uint32_t format, uint32_t type);
 
     uint32_t m_texture { 0 };
@@ -49,8 +59,11 @@ public:
     int GetHeight() const { return m_height; }
     uint32_t GetFormat() const { return m_format; }
     uint32_t GetType() const { return m_type; }
+    int GetMipLevelCount() const { return m_mipLevelCount; }
 
-    void GenerateMipmap() const;
+    void GenerateMipmap();
+    // uploads one face of a mip level; levels above 0 extend the mip chain
+    void SetFaceData(int face, int level, uint32_t format, uint32_t type, const void* data);
  
 private:
     CubeTexture() {}
@@ -62,6 +75,7 @@ private:
     int m_height { 0 };
     uint32_t m_format { GL_RGBA };
     uint32_t m_type { GL_UNSIGNED_BYTE };
+    int m_mipLevelCount { 1 };
 };
 
 
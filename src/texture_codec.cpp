@@ -0,0 +1,578 @@
+#include "texture_codec.h"
+#include "pixel_convert.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int BLOCK_SIZE = 16;
+// 4-bit index interpolation weights shared by BC6H and BC7
+const int WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// blocks are little endian bit streams
+class BitWriter {
+public:
+    BitWriter(uint8_t* dst) : m_dst(dst) { memset(dst, 0, BLOCK_SIZE); }
+    void Write(uint32_t value, int bitCount) {
+        for (int i = 0; i < bitCount; i++, m_position++) {
+            if ((value >> i) & 1)
+                m_dst[m_position >> 3] |= (uint8_t)(1 << (m_position & 7));
+        }
+    }
+
+private:
+    uint8_t* m_dst;
+    int m_position { 0 };
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* src) : m_src(src) {}
+    uint32_t Read(int bitCount) {
+        uint32_t value = 0;
+        for (int i = 0; i < bitCount; i++, m_position++)
+            value |= (uint32_t)((m_src[m_position >> 3] >> (m_position & 7)) & 1) << i;
+        return value;
+    }
+
+private:
+    const uint8_t* m_src;
+    int m_position { 0 };
+};
+
+// endpoints at the extreme projections of the points onto their principal axis
+void FitEndpoints(const float* points, int count, int channelCount, float* e0, float* e1) {
+    float mean[4] = {};
+    float minValue[4], maxValue[4];
+    for (int c = 0; c < channelCount; c++) {
+        minValue[c] = maxValue[c] = points[c];
+        for (int i = 0; i < count; i++) {
+            float value = points[i * channelCount + c];
+            mean[c] += value;
+            minValue[c] = std::min(minValue[c], value);
+            maxValue[c] = std::max(maxValue[c], value);
+        }
+        mean[c] /= count;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < count; i++) {
+        for (int a = 0; a < channelCount; a++) {
+            for (int b = 0; b < channelCount; b++) {
+                covariance[a][b] += (points[i * channelCount + a] - mean[a]) *
+                    (points[i * channelCount + b] - mean[b]);
+            }
+        }
+    }
+
+    // power iteration, starting from the bounding box diagonal
+    float axis[4];
+    for (int c = 0; c < channelCount; c++)
+        axis[c] = maxValue[c] - minValue[c];
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channelCount; a++) {
+            for (int b = 0; b < channelCount; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f)
+            break;
+        length = 1.0f / sqrtf(length);
+        for (int c = 0; c < channelCount; c++)
+            axis[c] = next[c] * length;
+    }
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channelCount; c++)
+            t += (points[i * channelCount + c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float axisLength2 = 0.0f;
+    for (int c = 0; c < channelCount; c++)
+        axisLength2 += axis[c] * axis[c];
+    if (axisLength2 > 0.0f) {
+        minT /= axisLength2;
+        maxT /= axisLength2;
+    }
+    for (int c = 0; c < channelCount; c++) {
+        e0[c] = mean[c] + axis[c] * minT;
+        e1[c] = mean[c] + axis[c] * maxT;
+    }
+}
+
+// least squares endpoints for fixed interpolation weights in [0, 1]
+bool RefineEndpoints(const float* points, const float* weights, int count, int channelCount,
+    float* e0, float* e1) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < count; i++) {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channelCount; c++) {
+            ax[c] += a * points[i * channelCount + c];
+            bx[c] += b * points[i * channelCount + c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < channelCount; c++) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    return true;
+}
+
+int Interpolate(int a, int b, int weight) {
+    return ((64 - weight) * a + weight * b + 32) >> 6;
+}
+
+// BC7 mode 6: one subset, RGBA 7-bit endpoints with a p-bit each, 4-bit indices
+struct Bc7Block {
+    int endpoints[2][4];    // 7 bits
+    int pbits[2];
+    int indices[16];
+    float error;
+};
+
+void QuantizeBc7(const float* pixels, const float* e0, const float* e1, Bc7Block& best) {
+    best.error = INFINITY;
+    for (int pbitMask = 0; pbitMask < 4; pbitMask++) {
+        Bc7Block block;
+        block.pbits[0] = pbitMask & 1;
+        block.pbits[1] = pbitMask >> 1;
+        int color[2][4];
+        for (int c = 0; c < 4; c++) {
+            block.endpoints[0][c] = std::clamp((int)lroundf((e0[c] - block.pbits[0]) * 0.5f), 0, 127);
+            block.endpoints[1][c] = std::clamp((int)lroundf((e1[c] - block.pbits[1]) * 0.5f), 0, 127);
+            color[0][c] = block.endpoints[0][c] * 2 + block.pbits[0];
+            color[1][c] = block.endpoints[1][c] * 2 + block.pbits[1];
+        }
+        int palette[16][4];
+        for (int j = 0; j < 16; j++) {
+            for (int c = 0; c < 4; c++)
+                palette[j][c] = Interpolate(color[0][c], color[1][c], WEIGHTS4[j]);
+        }
+        block.error = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float bestError = INFINITY;
+            for (int j = 0; j < 16; j++) {
+                float error = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    float d = palette[j][c] - pixels[i * 4 + c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    block.indices[i] = j;
+                }
+            }
+            block.error += bestError;
+        }
+        if (block.error < best.error)
+            best = block;
+    }
+}
+
+void EncodeBc7Block(const uint8_t* rgba, uint8_t* dst) {
+    float pixels[16 * 4];
+    for (int i = 0; i < 16 * 4; i++)
+        pixels[i] = rgba[i];
+    float e0[4], e1[4];
+    FitEndpoints(pixels, 16, 4, e0, e1);
+    Bc7Block best;
+    QuantizeBc7(pixels, e0, e1, best);
+    for (int iteration = 0; iteration < 2 && best.error > 0.0f; iteration++) {
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = WEIGHTS4[best.indices[i]] / 64.0f;
+        if (!RefineEndpoints(pixels, weights, 16, 4, e0, e1))
+            break;
+        Bc7Block block;
+        QuantizeBc7(pixels, e0, e1, block);
+        if (block.error >= best.error)
+            break;
+        best = block;
+    }
+
+    // the first index drops its top bit, so it must be below 8
+    if (best.indices[0] >= 8) {
+        for (int c = 0; c < 4; c++)
+            std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (int i = 0; i < 16; i++)
+            best.indices[i] = 15 - best.indices[i];
+    }
+    BitWriter writer(dst);
+    writer.Write(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.Write(best.endpoints[0][c], 7);
+        writer.Write(best.endpoints[1][c], 7);
+    }
+    writer.Write(best.pbits[0], 1);
+    writer.Write(best.pbits[1], 1);
+    writer.Write(best.indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.Write(best.indices[i], 4);
+}
+
+void DecodeBc7Block(const uint8_t* src, uint8_t* rgba) {
+    if ((src[0] & 0x7F) != 0x40) {
+        // not mode 6, shown as magenta
+        for (int i = 0; i < 16; i++) {
+            rgba[i * 4 + 0] = 255;
+            rgba[i * 4 + 1] = 0;
+            rgba[i * 4 + 2] = 255;
+            rgba[i * 4 + 3] = 255;
+        }
+        return;
+    }
+    BitReader reader(src);
+    reader.Read(7);
+    int color[2][4];
+    for (int c = 0; c < 4; c++) {
+        color[0][c] = reader.Read(7) << 1;
+        color[1][c] = reader.Read(7) << 1;
+    }
+    int pbit0 = reader.Read(1);
+    int pbit1 = reader.Read(1);
+    for (int c = 0; c < 4; c++) {
+        color[0][c] |= pbit0;
+        color[1][c] |= pbit1;
+    }
+    for (int i = 0; i < 16; i++) {
+        int index = reader.Read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++)
+            rgba[i * 4 + c] = (uint8_t)Interpolate(color[0][c], color[1][c], WEIGHTS4[index]);
+    }
+}
+
+// BC4 with the 8 interpolated values mode (e0 > e1)
+void EncodeBc4Block(const uint8_t* values, int stride, uint8_t* dst) {
+    int maxValue = 0;
+    int minValue = 255;
+    for (int i = 0; i < 16; i++) {
+        maxValue = std::max(maxValue, (int)values[i * stride]);
+        minValue = std::min(minValue, (int)values[i * stride]);
+    }
+    memset(dst, 0, 8);
+    dst[0] = (uint8_t)maxValue;
+    dst[1] = (uint8_t)minValue;
+    if (maxValue == minValue)
+        return;
+
+    float palette[8];
+    palette[0] = (float)maxValue;
+    palette[1] = (float)minValue;
+    for (int j = 2; j < 8; j++)
+        palette[j] = ((8 - j) * maxValue + (j - 1) * minValue) / 7.0f;
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++) {
+        int bestIndex = 0;
+        float bestError = INFINITY;
+        for (int j = 0; j < 8; j++) {
+            float error = fabsf(palette[j] - values[i * stride]);
+            if (error < bestError) {
+                bestError = error;
+                bestIndex = j;
+            }
+        }
+        bits |= (uint64_t)bestIndex << (i * 3);
+    }
+    for (int i = 0; i < 6; i++)
+        dst[2 + i] = (uint8_t)(bits >> (i * 8));
+}
+
+void DecodeBc4Block(const uint8_t* src, uint8_t* values, int stride) {
+    int e0 = src[0];
+    int e1 = src[1];
+    float palette[8];
+    palette[0] = (float)e0;
+    palette[1] = (float)e1;
+    if (e0 > e1) {
+        for (int j = 2; j < 8; j++)
+            palette[j] = ((8 - j) * e0 + (j - 1) * e1) / 7.0f;
+    }
+    else {
+        for (int j = 2; j < 6; j++)
+            palette[j] = ((6 - j) * e0 + (j - 1) * e1) / 5.0f;
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+        bits |= (uint64_t)src[2 + i] << (i * 8);
+    for (int i = 0; i < 16; i++)
+        values[i * stride] = (uint8_t)lroundf(palette[(bits >> (i * 3)) & 7]);
+}
+
+void EncodeBc5Block(const uint8_t* rgba, uint8_t* dst) {
+    EncodeBc4Block(rgba + 0, 4, dst);
+    EncodeBc4Block(rgba + 1, 4, dst + 8);
+}
+
+void DecodeBc5Block(const uint8_t* src, uint8_t* rgba) {
+    DecodeBc4Block(src, rgba + 0, 4);
+    DecodeBc4Block(src + 8, rgba + 1, 4);
+    for (int i = 0; i < 16; i++) {
+        rgba[i * 4 + 2] = 0;
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+// BC6H mode 11: one region, unsigned 10-bit endpoints, 4-bit indices.
+// Endpoints are fitted in the unquantized 16-bit space, which is the half
+// bit pattern scaled by 64 / 31, so errors weigh like relative errors.
+int UnquantizeBc6h(int value) {
+    if (value == 0)
+        return 0;
+    if (value == 1023)
+        return 0xFFFF;
+    return ((value << 16) + 0x8000) >> 10;
+}
+
+struct Bc6hBlock {
+    int endpoints[2][3];    // 10 bits
+    int indices[16];
+    float error;
+};
+
+void QuantizeBc6h(const float* values, const float* e0, const float* e1, Bc6hBlock& block) {
+    int color[2][3];
+    for (int c = 0; c < 3; c++) {
+        block.endpoints[0][c] = std::clamp((int)lroundf((e0[c] - 32.0f) / 64.0f), 0, 1023);
+        block.endpoints[1][c] = std::clamp((int)lroundf((e1[c] - 32.0f) / 64.0f), 0, 1023);
+        color[0][c] = UnquantizeBc6h(block.endpoints[0][c]);
+        color[1][c] = UnquantizeBc6h(block.endpoints[1][c]);
+    }
+    int palette[16][3];
+    for (int j = 0; j < 16; j++) {
+        for (int c = 0; c < 3; c++)
+            palette[j][c] = Interpolate(color[0][c], color[1][c], WEIGHTS4[j]);
+    }
+    block.error = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float bestError = INFINITY;
+        for (int j = 0; j < 16; j++) {
+            float error = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                float d = palette[j][c] - values[i * 3 + c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                block.indices[i] = j;
+            }
+        }
+        block.error += bestError;
+    }
+}
+
+void EncodeBc6hBlock(const uint16_t* rgb, uint8_t* dst) {
+    float values[16 * 3];
+    for (int i = 0; i < 16 * 3; i++) {
+        // negative values are not representable, inf and NaN clamp to the largest half
+        int half = rgb[i] & 0x8000 ? 0 : std::min((int)rgb[i], 0x7BFF);
+        values[i] = half * (64.0f / 31.0f);
+    }
+    float e0[3], e1[3];
+    FitEndpoints(values, 16, 3, e0, e1);
+    Bc6hBlock best;
+    QuantizeBc6h(values, e0, e1, best);
+    for (int iteration = 0; iteration < 2 && best.error > 0.0f; iteration++) {
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = WEIGHTS4[best.indices[i]] / 64.0f;
+        if (!RefineEndpoints(values, weights, 16, 3, e0, e1))
+            break;
+        Bc6hBlock block;
+        QuantizeBc6h(values, e0, e1, block);
+        if (block.error >= best.error)
+            break;
+        best = block;
+    }
+
+    if (best.indices[0] >= 8) {
+        for (int c = 0; c < 3; c++)
+            std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+        for (int i = 0; i < 16; i++)
+            best.indices[i] = 15 - best.indices[i];
+    }
+    BitWriter writer(dst);
+    writer.Write(0x03, 5);
+    for (int e = 0; e < 2; e++) {
+        for (int c = 0; c < 3; c++)
+            writer.Write(best.endpoints[e][c], 10);
+    }
+    writer.Write(best.indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.Write(best.indices[i], 4);
+}
+
+void DecodeBc6hBlock(const uint8_t* src, uint16_t* rgb) {
+    BitReader reader(src);
+    if (reader.Read(5) != 0x03) {
+        // not mode 11, shown as magenta
+        for (int i = 0; i < 16; i++) {
+            rgb[i * 3 + 0] = 0x3C00;
+            rgb[i * 3 + 1] = 0;
+            rgb[i * 3 + 2] = 0x3C00;
+        }
+        return;
+    }
+    int color[2][3];
+    for (int e = 0; e < 2; e++) {
+        for (int c = 0; c < 3; c++)
+            color[e][c] = UnquantizeBc6h(reader.Read(10));
+    }
+    for (int i = 0; i < 16; i++) {
+        int index = reader.Read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 3; c++)
+            rgb[i * 3 + c] = (uint16_t)((Interpolate(color[0][c], color[1][c], WEIGHTS4[index]) * 31) >> 6);
+    }
+}
+
+} // namespace
+
+uint32_t TextureCodec::GetInternalFormat(TextureCodecFormat format, bool srgb) {
+    switch (format) {
+        case TEXTURE_CODEC_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TEXTURE_CODEC_BC6H: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        case TEXTURE_CODEC_BC7:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+size_t TextureCodec::GetLevelSize(TextureCodecFormat format, int width, int height) {
+    if (!IsCompressed(format))
+        return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BLOCK_SIZE;
+}
+
+std::vector<uint8_t> TextureCodec::Encode(TextureCodecFormat format, const Image* image,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("TextureCodec::Encode");
+    bool hdr = format == TEXTURE_CODEC_BC6H;
+    if (hdr ? (image->GetStorage() != IMAGE_STORAGE_HALF || image->GetChannelCount() != 3) :
+        (image->GetStorage() != IMAGE_STORAGE_UINT8 || image->GetChannelCount() != 4)) {
+        SPDLOG_ERROR("unexpected image layout for texture codec format {}", (int)format);
+        return std::vector<uint8_t>();
+    }
+    int width = image->GetWidth();
+    int height = image->GetHeight();
+    if (!IsCompressed(format))
+        return std::vector<uint8_t>(image->GetData(), image->GetData() + (size_t)width * height * 4);
+
+    int blockCountX = (width + 3) / 4;
+    int blockCountY = (height + 3) / 4;
+    std::vector<uint8_t> result((size_t)blockCountX * blockCountY * BLOCK_SIZE);
+    auto encodeRows = [&](size_t begin, size_t end, int) {
+        uint8_t rgba[16 * 4];
+        uint16_t rgb[16 * 3];
+        for (size_t by = begin; by < end; by++) {
+            for (int bx = 0; bx < blockCountX; bx++) {
+                // edge blocks repeat the last row and column
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx * 4 + (i & 3), width - 1);
+                    int y = std::min((int)by * 4 + (i >> 2), height - 1);
+                    size_t pixel = (size_t)y * width + x;
+                    if (hdr)
+                        memcpy(rgb + i * 3, (const uint16_t*)image->GetData() + pixel * 3, 6);
+                    else
+                        memcpy(rgba + i * 4, image->GetData() + pixel * 4, 4);
+                }
+                auto dst = result.data() + (by * blockCountX + bx) * BLOCK_SIZE;
+                switch (format) {
+                    case TEXTURE_CODEC_BC5: EncodeBc5Block(rgba, dst); break;
+                    case TEXTURE_CODEC_BC6H: EncodeBc6hBlock(rgb, dst); break;
+                    default: EncodeBc7Block(rgba, dst); break;
+                }
+            }
+        }
+    };
+    if (threadPool)
+        threadPool->ParallelFor(blockCountY, 1, encodeRows);
+    else
+        encodeRows(0, blockCountY, 0);
+    return result;
+}
+
+ImageUPtr TextureCodec::Decode(TextureCodecFormat format, const uint8_t* data, int width, int height) {
+    bool hdr = format == TEXTURE_CODEC_BC6H;
+    auto image = Image::Create(width, height, hdr ? 3 : 4, hdr ? 2 : 1);
+    if (!image)
+        return nullptr;
+    if (!IsCompressed(format)) {
+        memcpy(image->GetData(), data, (size_t)width * height * 4);
+        return std::move(image);
+    }
+
+    int blockCountX = (width + 3) / 4;
+    int blockCountY = (height + 3) / 4;
+    uint8_t rgba[16 * 4];
+    uint16_t rgb[16 * 3];
+    for (int by = 0; by < blockCountY; by++) {
+        for (int bx = 0; bx < blockCountX; bx++) {
+            auto src = data + ((size_t)by * blockCountX + bx) * BLOCK_SIZE;
+            switch (format) {
+                case TEXTURE_CODEC_BC5: DecodeBc5Block(src, rgba); break;
+                case TEXTURE_CODEC_BC6H: DecodeBc6hBlock(src, rgb); break;
+                default: DecodeBc7Block(src, rgba); break;
+            }
+            for (int i = 0; i < 16; i++) {
+                int x = bx * 4 + (i & 3);
+                int y = by * 4 + (i >> 2);
+                if (x >= width || y >= height)
+                    continue;
+                size_t pixel = (size_t)y * width + x;
+                if (hdr)
+                    memcpy((uint16_t*)image->GetData() + pixel * 3, rgb + i * 3, 6);
+                else
+                    memcpy(image->GetData() + pixel * 4, rgba + i * 4, 4);
+            }
+        }
+    }
+    return std::move(image);
+}
+
+double TextureCodec::ComputePsnr(TextureCodecFormat format, const Image* reference, const Image* decoded) {
+    size_t pixelCount = (size_t)reference->GetWidth() * reference->GetHeight();
+    double squaredError = 0.0;
+    double peak = 255.0;
+    int channelCount = format == TEXTURE_CODEC_BC5 ? 2 : 3;
+    if (format == TEXTURE_CODEC_BC6H) {
+        auto a = (const uint16_t*)reference->GetData();
+        auto b = (const uint16_t*)decoded->GetData();
+        peak = 0.0;
+        for (size_t i = 0; i < pixelCount * 3; i++) {
+            double expected = log2(1.0 + std::max(HalfToFloat(a[i]), 0.0f));
+            double actual = log2(1.0 + std::max(HalfToFloat(b[i]), 0.0f));
+            squaredError += (expected - actual) * (expected - actual);
+            peak = std::max(peak, expected);
+        }
+    }
+    else {
+        auto a = reference->GetData();
+        auto b = decoded->GetData();
+        for (size_t i = 0; i < pixelCount; i++) {
+            for (int c = 0; c < channelCount; c++) {
+                double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+                squaredError += d * d;
+            }
+        }
+    }
+    double mse = squaredError / (double)(pixelCount * channelCount);
+    if (mse <= 0.0 || peak <= 0.0)
+        return INFINITY;
+    return 10.0 * log10(peak * peak / mse);
+}
@@ -0,0 +1,37 @@
+#ifndef __TEXTURE_CODEC_H__
+#define __TEXTURE_CODEC_H__
+
+#include "common.h"
+#include "image.h"
+#include "thread_pool.h"
+#include <vector>
+
+enum TextureCodecFormat {
+    TEXTURE_CODEC_RGBA8,
+    TEXTURE_CODEC_BC5,      // red and green, for normal maps
+    TEXTURE_CODEC_BC6H,     // unsigned half float rgb
+    TEXTURE_CODEC_BC7,
+};
+
+// CPU block compression used by the texture cook tool.
+// The encoders emit a single block mode each (BC7 mode 6, BC6H mode 11,
+// BC4 8-value blocks for BC5): principal axis endpoints, best p-bits and
+// least squares endpoint refinement. The decoders handle those modes and
+// are there to measure quality.
+// Inputs are RGBA8 images for RGBA8 / BC5 / BC7 and RGB half images for BC6H.
+class TextureCodec {
+public:
+    static uint32_t GetInternalFormat(TextureCodecFormat format, bool srgb = false);
+    static bool IsCompressed(TextureCodecFormat format) { return format != TEXTURE_CODEC_RGBA8; }
+    static size_t GetLevelSize(TextureCodecFormat format, int width, int height);
+
+    // blocks are split by rows across the thread pool
+    static std::vector<uint8_t> Encode(TextureCodecFormat format, const Image* image,
+        ThreadPool* threadPool = nullptr);
+    // back to the encoder input layout
+    static ImageUPtr Decode(TextureCodecFormat format, const uint8_t* data, int width, int height);
+    // PSNR in dB over the channels the format keeps, HDR over log2(1 + value)
+    static double ComputePsnr(TextureCodecFormat format, const Image* reference, const Image* decoded);
+};
+
+#endif // __TEXTURE_CODEC_H__
@@ -0,0 +1,90 @@
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+
+ThreadPoolUPtr ThreadPool::Create(int threadCount) {
+    auto pool = ThreadPoolUPtr(new ThreadPool());
+    pool->Init(threadCount);
+    return std::move(pool);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobCondition.notify_all();
+    for (auto& worker: m_workers)
+        worker.join();
+}
+
+void ThreadPool::Init(int threadCount) {
+    if (threadCount <= 0)
+        threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+    for (int i = 1; i < threadCount; i++)
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    SPDLOG_INFO("thread pool: {} threads", threadCount);
+}
+
+void ThreadPool::WorkerLoop(int threadIndex) {
+    Trace::SetThreadName(fmt::format("worker {}", threadIndex).c_str());
+
+    for (;;) {
+        std::function<void(int)> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobCondition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+            if (m_stop && m_jobs.empty())
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job(threadIndex);
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grainSize,
+    const std::function<void(size_t begin, size_t end, int threadIndex)>& func) {
+    if (count == 0)
+        return;
+    grainSize = std::max<size_t>(grainSize, 1);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (chunkCount == 1 || m_workers.empty()) {
+        func(0, count, 0);
+        return;
+    }
+
+    std::atomic<size_t> nextChunk { 0 };
+    auto run = [&](int threadIndex) {
+        for (;;) {
+            size_t chunk = nextChunk.fetch_add(1);
+            if (chunk >= chunkCount)
+                break;
+            size_t begin = chunk * grainSize;
+            func(begin, std::min(begin + grainSize, count), threadIndex);
+        }
+    };
+
+    // helpers reference this stack frame, so wait until every one of them has left
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    int helperCount = (int)std::min(m_workers.size(), chunkCount - 1);
+    int activeHelpers = helperCount;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < helperCount; i++) {
+            m_jobs.push_back([&](int threadIndex) {
+                run(threadIndex);
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (--activeHelpers == 0)
+                    doneCondition.notify_one();
+            });
+        }
+    }
+    m_jobCondition.notify_all();
+
+    run(0);
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCondition.wait(lock, [&]() { return activeHelpers == 0; });
+}
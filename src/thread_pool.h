@@ -0,0 +1,41 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include "common.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running data parallel loops.
+// The calling thread takes part in every loop as thread index 0,
+// workers use 1..GetThreadCount()-1, so per-thread data can be indexed
+// by the thread index. Loops are meant to be started from one thread.
+CLASS_PTR(ThreadPool)
+class ThreadPool {
+public:
+    // threadCount 0 uses every hardware thread
+    static ThreadPoolUPtr Create(int threadCount = 0);
+    ~ThreadPool();
+
+    int GetThreadCount() const { return (int)m_workers.size() + 1; }
+
+    // splits [0, count) into chunks of grainSize and blocks until all ran
+    void ParallelFor(size_t count, size_t grainSize,
+        const std::function<void(size_t begin, size_t end, int threadIndex)>& func);
+
+private:
+    ThreadPool() {}
+    void Init(int threadCount);
+    void WorkerLoop(int threadIndex);
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void(int)>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobCondition;
+    bool m_stop { false };
+};
+
+#endif // __THREAD_POOL_H__
@@ -0,0 +1,145 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> writeCount { 0 };
+    int pid { 1 };
+    int tid { 0 };
+    std::string threadName;
+};
+
+std::atomic<bool> s_enabled { false };
+std::chrono::steady_clock::time_point s_epoch;
+size_t s_capacity { 0 };
+
+std::mutex s_registryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> s_buffers;
+TraceBuffer* s_gpuBuffer { nullptr };
+thread_local TraceBuffer* t_buffer { nullptr };
+
+TraceBuffer* RegisterBuffer(int pid, const std::string& threadName) {
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    auto buffer = std::make_unique<TraceBuffer>();
+    buffer->events.resize(s_capacity);
+    buffer->pid = pid;
+    buffer->tid = (int)s_buffers.size();
+    buffer->threadName = threadName;
+    s_buffers.push_back(std::move(buffer));
+    return s_buffers.back().get();
+}
+
+TraceBuffer* GetThreadBuffer() {
+    if (!t_buffer)
+        t_buffer = RegisterBuffer(1, "");
+    return t_buffer;
+}
+
+void Push(TraceBuffer* buffer, const char* name, uint64_t start, uint64_t end) {
+    // single writer per buffer: fill the slot, then publish it
+    auto index = buffer->writeCount.load(std::memory_order_relaxed);
+    buffer->events[index % buffer->events.size()] = TraceEvent { name, start, end };
+    buffer->writeCount.store(index + 1, std::memory_order_release);
+}
+
+std::string EscapeJson(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    for (auto c: text) {
+        if (c == '"' || c == '\\')
+            result.push_back('\\');
+        result.push_back(c);
+    }
+    return result;
+}
+
+} // namespace
+
+void Trace::Enable(size_t capacityPerThread) {
+    if (s_enabled.load())
+        return;
+    s_capacity = std::max<size_t>(capacityPerThread, 1);
+    s_epoch = std::chrono::steady_clock::now();
+    s_gpuBuffer = RegisterBuffer(2, "GPU");
+    s_enabled.store(true);
+}
+
+bool Trace::IsEnabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Trace::Now() {
+    auto elapsed = std::chrono::steady_clock::now() - s_epoch;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Trace::Record(const char* name, uint64_t startNs, uint64_t endNs) {
+    if (!IsEnabled())
+        return;
+    Push(GetThreadBuffer(), name, startNs, endNs);
+}
+
+void Trace::RecordGpu(const char* name, uint64_t startNs, uint64_t endNs) {
+    if (!IsEnabled())
+        return;
+    Push(s_gpuBuffer, name, startNs, endNs);
+}
+
+void Trace::SetThreadName(const char* name) {
+    if (!IsEnabled())
+        return;
+    auto buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    buffer->threadName = name;
+}
+
+bool Trace::Dump(const std::string& filename) {
+    if (!IsEnabled())
+        return false;
+    std::ofstream fout(filename);
+    if (!fout.is_open()) {
+        SPDLOG_ERROR("failed to open file: {}", filename);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    size_t eventCount = 0;
+    fout << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    fout << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+    fout << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 2, \"args\": {\"name\": \"GPU\"}}";
+    for (auto& buffer: s_buffers) {
+        auto threadName = buffer->threadName.empty() ?
+            fmt::format("thread {}", buffer->tid) : buffer->threadName;
+        fout << fmt::format(",\n{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": {}, \"tid\": {}, "
+            "\"args\": {{\"name\": \"{}\"}}}}", buffer->pid, buffer->tid, EscapeJson(threadName));
+
+        auto count = buffer->writeCount.load(std::memory_order_acquire);
+        auto capacity = (uint64_t)buffer->events.size();
+        auto first = count > capacity ? count - capacity : 0;
+        for (auto i = first; i < count; i++) {
+            auto& event = buffer->events[i % capacity];
+            fout << fmt::format(",\n{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": {}, \"tid\": {}, "
+                "\"ts\": {:.3f}, \"dur\": {:.3f}}}",
+                EscapeJson(event.name), buffer->pid, buffer->tid,
+                (double)event.start * 1.0e-3, (double)(event.end - event.start) * 1.0e-3);
+        }
+        eventCount += (size_t)(count - first);
+    }
+    fout << "\n]}\n";
+
+    SPDLOG_INFO("trace written: {} ({} events)", filename, eventCount);
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "common.h"
+
+// Scoped CPU/GPU timeline recorder that dumps a Chrome trace (Perfetto JSON).
+// Each thread writes into its own ring buffer without locking;
+// the buffer is registered once under a mutex on the thread's first event.
+// Event names must outlive the trace (string literals).
+class Trace {
+public:
+    static void Enable(size_t capacityPerThread = 1 << 16);
+    static bool IsEnabled();
+
+    // nanoseconds since the trace was enabled
+    static uint64_t Now();
+    static void Record(const char* name, uint64_t startNs, uint64_t endNs);
+    static void RecordGpu(const char* name, uint64_t startNs, uint64_t endNs);
+    static void SetThreadName(const char* name);
+
+    static bool Dump(const std::string& filename);
+};
+
+class TraceScope {
+public:
+    TraceScope(const char* name) : m_name(name) {
+        if (Trace::IsEnabled())
+            m_start = Trace::Now();
+    }
+    ~TraceScope() {
+        if (Trace::IsEnabled())
+            Trace::Record(m_name, m_start, Trace::Now());
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_start { 0 };
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // __TRACE_H__
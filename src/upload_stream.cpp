@@ -0,0 +1,91 @@
+#include "upload_stream.h"
+#include "trace.h"
+#include <chrono>
+
+UploadStreamUPtr UploadStream::Create(size_t chunkSize, int chunkCount) {
+    auto stream = UploadStreamUPtr(new UploadStream());
+    if (!stream->Init(chunkSize, chunkCount))
+        return nullptr;
+    return std::move(stream);
+}
+
+UploadStream::~UploadStream() {
+    for (auto fence: m_fences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (m_buffer) {
+        if (m_persistent) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+}
+
+bool UploadStream::Init(size_t chunkSize, int chunkCount) {
+    m_chunkSize = chunkSize;
+    m_chunkCount = chunkCount;
+    m_fences.resize(chunkCount, nullptr);
+    m_persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+
+    size_t size = chunkSize * chunkCount;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    if (m_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        m_mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        if (!m_mapped) {
+            SPDLOG_ERROR("failed to map upload stream buffer");
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+    }
+    else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    SPDLOG_INFO("upload stream: {} x {} KB chunks, {}", chunkCount, chunkSize >> 10,
+        m_persistent ? "persistent" : "mapped per chunk");
+    return true;
+}
+
+uint8_t* UploadStream::BeginChunk() {
+    TRACE_SCOPE("UploadStream::BeginChunk");
+    auto& fence = m_fences[m_chunkIndex];
+    if (fence) {
+        auto start = std::chrono::steady_clock::now();
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+        m_waitTimeMs += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    size_t offset = m_chunkSize * m_chunkIndex;
+    if (m_persistent)
+        return m_mapped + offset;
+    // the fence already made the range free, no need for the driver to sync again
+    auto mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, m_chunkSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped) {
+        SPDLOG_ERROR("failed to map upload stream chunk");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    return mapped;
+}
+
+const void* UploadStream::FlushChunk() {
+    if (!m_persistent)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return (const void*)(m_chunkSize * m_chunkIndex);
+}
+
+void UploadStream::EndChunk() {
+    m_fences[m_chunkIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_chunkIndex = (m_chunkIndex + 1) % m_chunkCount;
+}
@@ -0,0 +1,47 @@
+#ifndef __UPLOAD_STREAM_H__
+#define __UPLOAD_STREAM_H__
+
+#include "common.h"
+#include <vector>
+
+// Ring of pixel unpack buffer chunks for streaming texture uploads.
+// With ARB_buffer_storage the buffer stays persistently mapped; otherwise
+// each chunk is mapped while it is filled. A fence guards every chunk,
+// so filling one waits only until the GPU has consumed its last upload
+// and the CPU never holds more than the ring in flight.
+//
+//   auto dst = stream->BeginChunk();       // fill up to GetChunkSize() bytes
+//   auto offset = stream->FlushChunk();    // use as the pixel pointer
+//   glTexSubImage2D(..., offset);
+//   stream->EndChunk();
+CLASS_PTR(UploadStream)
+class UploadStream {
+public:
+    static UploadStreamUPtr Create(size_t chunkSize = 4 << 20, int chunkCount = 3);
+    ~UploadStream();
+
+    size_t GetChunkSize() const { return m_chunkSize; }
+    bool IsPersistent() const { return m_persistent; }
+    // how long BeginChunk blocked on fences since creation
+    double GetWaitTimeMs() const { return m_waitTimeMs; }
+
+    // nullptr when the chunk cannot be mapped, nothing to flush or end then
+    uint8_t* BeginChunk();
+    const void* FlushChunk();
+    void EndChunk();
+
+private:
+    UploadStream() {}
+    bool Init(size_t chunkSize, int chunkCount);
+
+    uint32_t m_buffer { 0 };
+    size_t m_chunkSize { 0 };
+    int m_chunkCount { 0 };
+    int m_chunkIndex { 0 };
+    bool m_persistent { false };
+    uint8_t* m_mapped { nullptr };
+    std::vector<GLsync> m_fences;
+    double m_waitTimeMs { 0.0 };
+};
+
+#endif // __UPLOAD_STREAM_H__
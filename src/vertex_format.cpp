@@ -0,0 +1,166 @@
+#include "vertex_format.h"
+#include "pixel_convert.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+struct PackedAttributes {
+    uint32_t normal;
+    uint32_t tangent;
+    uint16_t texCoord[2];
+};
+
+struct PackedVertex {
+    glm::vec3 position;
+    PackedAttributes attributes;
+};
+
+struct QuantizedVertex {
+    // w pads the position to 8 bytes
+    uint16_t position[4];
+    PackedAttributes attributes;
+};
+
+static_assert(sizeof(PackedVertex) == 24, "packed vertex must be 24 bytes");
+static_assert(sizeof(QuantizedVertex) == 20, "quantized vertex must be 20 bytes");
+
+uint32_t PackSnorm10(float value) {
+    return (uint32_t)lroundf(std::clamp(value, -1.0f, 1.0f) * 511.0f) & 0x3ff;
+}
+
+PackedAttributes PackAttributes(const Vertex& vertex) {
+    PackedAttributes attributes;
+    attributes.normal = VertexPacker::PackSnorm1010102(vertex.normal);
+    attributes.tangent = VertexPacker::PackSnorm1010102(glm::vec3(vertex.tangent), vertex.tangent.w);
+    attributes.texCoord[0] = FloatToHalf(vertex.texCoord.x);
+    attributes.texCoord[1] = FloatToHalf(vertex.texCoord.y);
+    return attributes;
+}
+
+// positions quantized to the bounds, each axis on its own scale
+void QuantizePositions(const Vertex* vertices, size_t vertexCount, const VertexBounds* bounds,
+    PackedVertices& packed, uint8_t* dst, size_t stride) {
+    auto boundsMin = glm::vec3(FLT_MAX);
+    auto boundsMax = glm::vec3(-FLT_MAX);
+    if (bounds) {
+        boundsMin = bounds->min;
+        boundsMax = bounds->max;
+    }
+    else {
+        for (size_t i = 0; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertices[i].position);
+            boundsMax = glm::max(boundsMax, vertices[i].position);
+        }
+        if (vertexCount == 0)
+            boundsMin = boundsMax = glm::vec3(0.0f);
+    }
+    packed.positionScale = boundsMax - boundsMin;
+    packed.positionOffset = boundsMin;
+    glm::vec3 quantizeScale(0.0f);
+    for (int c = 0; c < 3; c++) {
+        if (packed.positionScale[c] > 0.0f)
+            quantizeScale[c] = 65535.0f / packed.positionScale[c];
+    }
+    for (size_t i = 0; i < vertexCount; i++, dst += stride) {
+        auto position = (vertices[i].position - boundsMin) * quantizeScale;
+        auto quantized = (uint16_t*)dst;
+        for (int c = 0; c < 3; c++)
+            quantized[c] = (uint16_t)std::clamp(lroundf(position[c]), 0l, 65535l);
+        quantized[3] = 0;
+    }
+}
+
+} // namespace
+
+uint32_t VertexPacker::GetStride(VertexFormat format) {
+    switch (format) {
+        case VERTEX_FORMAT_PACKED: return sizeof(PackedVertex);
+        case VERTEX_FORMAT_QUANTIZED: return sizeof(QuantizedVertex);
+        default: return sizeof(Vertex);
+    }
+}
+
+uint32_t VertexPacker::PackSnorm1010102(const glm::vec3& value, float w) {
+    uint32_t packedW = (uint32_t)lroundf(std::clamp(w, -1.0f, 1.0f)) & 0x3;
+    return PackSnorm10(value.x) | PackSnorm10(value.y) << 10 | PackSnorm10(value.z) << 20 | packedW << 30;
+}
+
+PackedVertices VertexPacker::Pack(VertexFormat format, const Vertex* vertices, size_t vertexCount,
+    const VertexBounds* bounds) {
+    PackedVertices packed;
+    packed.data.resize(GetStride(format) * vertexCount);
+    if (format == VERTEX_FORMAT_FLOAT) {
+        memcpy(packed.data.data(), vertices, packed.data.size());
+        return packed;
+    }
+    if (format == VERTEX_FORMAT_PACKED) {
+        auto dst = (PackedVertex*)packed.data.data();
+        for (size_t i = 0; i < vertexCount; i++) {
+            dst[i].position = vertices[i].position;
+            dst[i].attributes = PackAttributes(vertices[i]);
+        }
+        return packed;
+    }
+
+    auto dst = (QuantizedVertex*)packed.data.data();
+    QuantizePositions(vertices, vertexCount, bounds, packed, packed.data.data(), sizeof(QuantizedVertex));
+    for (size_t i = 0; i < vertexCount; i++)
+        dst[i].attributes = PackAttributes(vertices[i]);
+    return packed;
+}
+
+void VertexPacker::SetupLayout(VertexFormat format, const VertexLayout* vertexLayout, uint32_t binding) {
+    if (format == VERTEX_FORMAT_FLOAT) {
+        vertexLayout->SetAttribFormat(0, 3, GL_FLOAT, false, 0, binding);
+        vertexLayout->SetAttribFormat(1, 3, GL_FLOAT, false, offsetof(Vertex, normal), binding);
+        vertexLayout->SetAttribFormat(2, 2, GL_FLOAT, false, offsetof(Vertex, texCoord), binding);
+        vertexLayout->SetAttribFormat(3, 4, GL_FLOAT, false, offsetof(Vertex, tangent), binding);
+        return;
+    }
+
+    // vec3 inputs read xyz of the 4 component packed attributes, the 2-bit
+    // w of the tangent is its bitangent sign
+    uint32_t attributes = 0;
+    if (format == VERTEX_FORMAT_PACKED) {
+        vertexLayout->SetAttribFormat(0, 3, GL_FLOAT, false, 0, binding);
+        attributes = offsetof(PackedVertex, attributes);
+    }
+    else {
+        vertexLayout->SetAttribFormat(0, 4, GL_UNSIGNED_SHORT, true, 0, binding);
+        attributes = offsetof(QuantizedVertex, attributes);
+    }
+    vertexLayout->SetAttribFormat(1, 4, GL_INT_2_10_10_10_REV, true,
+        attributes + offsetof(PackedAttributes, normal), binding);
+    vertexLayout->SetAttribFormat(2, 2, GL_HALF_FLOAT, false,
+        attributes + offsetof(PackedAttributes, texCoord), binding);
+    vertexLayout->SetAttribFormat(3, 4, GL_INT_2_10_10_10_REV, true,
+        attributes + offsetof(PackedAttributes, tangent), binding);
+}
+
+uint32_t VertexPacker::GetPositionStride(VertexFormat format) {
+    return format == VERTEX_FORMAT_QUANTIZED ? sizeof(uint16_t) * 4 : sizeof(glm::vec3);
+}
+
+PackedVertices VertexPacker::PackPositions(VertexFormat format, const Vertex* vertices, size_t vertexCount,
+    const VertexBounds* bounds) {
+    PackedVertices packed;
+    size_t stride = GetPositionStride(format);
+    packed.data.resize(stride * vertexCount);
+    if (format == VERTEX_FORMAT_QUANTIZED) {
+        QuantizePositions(vertices, vertexCount, bounds, packed, packed.data.data(), stride);
+        return packed;
+    }
+    auto dst = (glm::vec3*)packed.data.data();
+    for (size_t i = 0; i < vertexCount; i++)
+        dst[i] = vertices[i].position;
+    return packed;
+}
+
+void VertexPacker::SetupPositionLayout(VertexFormat format, const VertexLayout* vertexLayout, uint32_t binding) {
+    if (format == VERTEX_FORMAT_QUANTIZED)
+        vertexLayout->SetAttribFormat(0, 4, GL_UNSIGNED_SHORT, true, 0, binding);
+    else
+        vertexLayout->SetAttribFormat(0, 3, GL_FLOAT, false, 0, binding);
+}
@@ -0,0 +1,61 @@
+#ifndef __VERTEX_FORMAT_H__
+#define __VERTEX_FORMAT_H__
+
+#include "common.h"
+#include "vertex_layout.h"
+#include <vector>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+    // w: bitangent sign, B = tangent.w * cross(N, T)
+    glm::vec4 tangent;
+};
+
+// GPU side layout of attributes 0..3, the CPU side is always Vertex
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,        // Vertex as is, 48 bytes
+    // float position, 10:10:10:2 snorm normal / tangent, half float uv, 24 bytes
+    VERTEX_FORMAT_PACKED,
+    // 16-bit unorm position in the mesh bounds, the rest packed, 20 bytes.
+    // The vertex shader has to apply uPositionScale / uPositionOffset.
+    VERTEX_FORMAT_QUANTIZED,
+    VERTEX_FORMAT_COUNT,
+};
+
+struct PackedVertices {
+    std::vector<uint8_t> data;
+    // position = attribute * positionScale + positionOffset, identity unless quantized
+    glm::vec3 positionScale { 1.0f };
+    glm::vec3 positionOffset { 0.0f };
+};
+
+// quantization bounds, meshes quantized to the same bounds share
+// uPositionScale / uPositionOffset and can be drawn in one batch
+struct VertexBounds {
+    glm::vec3 min { 0.0f };
+    glm::vec3 max { 0.0f };
+};
+
+class VertexPacker {
+public:
+    static uint32_t GetStride(VertexFormat format);
+    // bounds null quantizes to the bounds of the vertices themselves
+    static PackedVertices Pack(VertexFormat format, const Vertex* vertices, size_t vertexCount,
+        const VertexBounds* bounds = nullptr);
+    // formats of attributes 0..3, read from the buffer on binding
+    static void SetupLayout(VertexFormat format, const VertexLayout* vertexLayout, uint32_t binding);
+
+    // position only stream for depth / proxy passes: tight float3, or
+    // unorm16x4 with the same scale / offset as Pack for quantized meshes
+    static uint32_t GetPositionStride(VertexFormat format);
+    static PackedVertices PackPositions(VertexFormat format, const Vertex* vertices, size_t vertexCount,
+        const VertexBounds* bounds = nullptr);
+    // attribute 0 only
+    static void SetupPositionLayout(VertexFormat format, const VertexLayout* vertexLayout, uint32_t binding);
+    // xyz in [-1, 1] and w in {-1, 0, 1} as GL_INT_2_10_10_10_REV
+    static uint32_t PackSnorm1010102(const glm::vec3& value, float w = 0.0f);
+};
+
+#endif // __VERTEX_FORMAT_H__
@@ -1,4 +1,5 @@
 #include "vertex_layout.h"
+#include "gl_state.h"
 
 VertexLayoutUPtr VertexLayout::Create() {
     auto vertexLayout = VertexLayoutUPtr(new VertexLayout());
@@ -8,12 +9,13 @@ VertexLayoutUPtr VertexLayout::Create() {
 
 VertexLayout::~VertexLayout() {
     if (m_vertexArrayObject) {
+        GLState::OnVertexArrayDeleted(m_vertexArrayObject);
         glDeleteVertexArrays(1, &m_vertexArrayObject);
     }
 }
 
 void VertexLayout::Bind() const {
-    glBindVertexArray(m_vertexArrayObject);
+    GLState::BindVertexArray(m_vertexArrayObject);
 }
 
 void VertexLayout::SetAttrib(
@@ -25,6 +27,27 @@ void VertexLayout::SetAttrib(
         type, normalized, stride, (const void*)offset);
 }
 
+void VertexLayout::SetAttribDivisor(uint32_t attribIndex, uint32_t divisor) const {
+    glVertexAttribDivisor(attribIndex, divisor);
+}
+
+void VertexLayout::SetAttribFormat(
+    uint32_t attribIndex, int count,
+    uint32_t type, bool normalized,
+    uint32_t relativeOffset, uint32_t binding) const {
+    glEnableVertexAttribArray(attribIndex);
+    glVertexAttribFormat(attribIndex, count, type, normalized, relativeOffset);
+    glVertexAttribBinding(attribIndex, binding);
+}
+
+void VertexLayout::SetVertexBuffer(uint32_t binding, uint32_t buffer, size_t offset, size_t stride) const {
+    glBindVertexBuffer(binding, buffer, offset, stride);
+}
+
+void VertexLayout::SetBindingDivisor(uint32_t binding, uint32_t divisor) const {
+    glVertexBindingDivisor(binding, divisor);
+}
+
 void VertexLayout::Init() {
     glGenVertexArrays(1, &m_vertexArrayObject);
     Bind();
@@ -11,11 +11,24 @@ public:
 
     uint32_t Get() const { return m_vertexArrayObject; }
     void Bind() const;
+    // integer types with normalized read as [0, 1] / [-1, 1] floats, packed
+    // GL_INT_2_10_10_10_REV / GL_UNSIGNED_INT_2_10_10_10_REV take count 4
     void SetAttrib(
         uint32_t attribIndex, int count,
         uint32_t type, bool normalized,
         size_t stride, uint64_t offset) const;
     void DisableAttrib(int attribIndex) const;
+    // 1 advances the attribute once per instance instead of per vertex
+    void SetAttribDivisor(uint32_t attribIndex, uint32_t divisor) const;
+
+    // separate format / buffer binding (GL 4.3): the attribute reads from a
+    // binding point, whose buffer can be swapped without touching the format
+    void SetAttribFormat(
+        uint32_t attribIndex, int count,
+        uint32_t type, bool normalized,
+        uint32_t relativeOffset, uint32_t binding) const;
+    void SetVertexBuffer(uint32_t binding, uint32_t buffer, size_t offset, size_t stride) const;
+    void SetBindingDivisor(uint32_t binding, uint32_t divisor) const;
 
 private:
     VertexLayout() {}
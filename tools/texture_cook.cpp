@@ -0,0 +1,220 @@
+#include "common.h"
+#include "image.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "texture_codec.h"
+#include "cooked_texture.h"
+#include "mip_generator.h"
+#include <chrono>
+#include <filesystem>
+
+struct CookSettings {
+    TextureCodecFormat format { TEXTURE_CODEC_BC7 };
+    // sRGB internal format, implies gamma-correct mips
+    bool srgb { false };
+    bool mipmaps { true };
+    MipOptions mip;
+};
+
+// --all 로 굽는 기본 asset 목록
+struct CookEntry {
+    const char* input;
+    CookSettings settings;
+};
+
+CookSettings MakeSettings(TextureCodecFormat format, bool gammaMips, bool normalMap) {
+    CookSettings settings;
+    settings.format = format;
+    settings.mip.srgb = gammaMips;
+    settings.mip.normalMap = normalMap;
+    return settings;
+}
+
+// 색상 텍스처는 셰이더가 UNORM으로 읽으므로 포맷은 그대로 두고 mipmap만 linear 공간에서 필터링
+const CookEntry DEFAULT_ENTRIES[] = {
+    { "./image/Old_Plastered_Stone_Wall_1_Diffuse.png", MakeSettings(TEXTURE_CODEC_BC7, true, false) },
+    { "./image/Old_Plastered_Stone_Wall_1_Normal.png", MakeSettings(TEXTURE_CODEC_BC5, false, true) },
+    // 256x1 palette, block 압축하면 인접한 색이 섞이므로 그대로 저장
+    { "./model/Dino.vox.png", MakeSettings(TEXTURE_CODEC_RGBA8, true, false) },
+    { "./image/god_rays_sky_dome_8k.hdr", MakeSettings(TEXTURE_CODEC_BC6H, false, false) },
+    { "./image/dug_up_dark_soil_in_the_field_8k.hdr", MakeSettings(TEXTURE_CODEC_BC6H, false, false) },
+};
+
+bool ParseFormat(const std::string& name, TextureCodecFormat& format) {
+    if (name == "bc7") format = TEXTURE_CODEC_BC7;
+    else if (name == "bc5") format = TEXTURE_CODEC_BC5;
+    else if (name == "bc6h") format = TEXTURE_CODEC_BC6H;
+    else if (name == "rgba8") format = TEXTURE_CODEC_RGBA8;
+    else return false;
+    return true;
+}
+
+// stb keeps the channel count of the file, the encoders take RGBA8
+ImageUPtr ExpandToRgba8(const Image* image) {
+    auto result = Image::Create(image->GetWidth(), image->GetHeight(), 4, 1);
+    size_t pixelCount = (size_t)image->GetWidth() * image->GetHeight();
+    int channelCount = image->GetChannelCount();
+    auto src = image->GetData();
+    auto dst = result->GetData();
+    for (size_t i = 0; i < pixelCount; i++) {
+        for (int c = 0; c < 4; c++) {
+            if (c < channelCount)
+                dst[i * 4 + c] = src[i * channelCount + c];
+            else if (c == 3)
+                dst[i * 4 + c] = 255;
+            else
+                dst[i * 4 + c] = channelCount == 1 ? src[i] : 0;
+        }
+    }
+    return result;
+}
+
+ImageUPtr LoadSource(const std::string& filename, TextureCodecFormat format, ThreadPool* threadPool) {
+    if (format == TEXTURE_CODEC_BC6H)
+        return Image::LoadHdr(filename, threadPool, true, IMAGE_STORAGE_HALF);
+    auto image = Image::Load(filename);
+    if (!image)
+        return nullptr;
+    if (image->GetStorage() != IMAGE_STORAGE_UINT8) {
+        SPDLOG_ERROR("{} needs an 8-bit image: {}", format == TEXTURE_CODEC_BC5 ? "bc5" : "bc7 / rgba8", filename);
+        return nullptr;
+    }
+    return image->GetChannelCount() == 4 ? std::move(image) : ExpandToRgba8(image.get());
+}
+
+bool ParseFilter(const std::string& name, MipFilter& filter) {
+    if (name == "kaiser") filter = MIP_FILTER_KAISER;
+    else if (name == "lanczos") filter = MIP_FILTER_LANCZOS;
+    else if (name == "box") filter = MIP_FILTER_BOX;
+    else return false;
+    return true;
+}
+
+bool Cook(const std::string& input, const std::string& output, const CookSettings& settings,
+    ThreadPool* threadPool) {
+    TRACE_SCOPE("Cook");
+    auto format = settings.format;
+    auto image = LoadSource(input, format, threadPool);
+    if (!image)
+        return false;
+
+    std::vector<ImageUPtr> mips;
+    if (settings.mipmaps) {
+        auto start = std::chrono::steady_clock::now();
+        auto mipOptions = settings.mip;
+        mipOptions.srgb |= settings.srgb;
+        mips = MipGenerator::Generate(image.get(), mipOptions, threadPool);
+        SPDLOG_INFO("  {} mip levels generated, {:.1f} ms", mips.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::vector<CookedTextureLevel> levels;
+    double totalMs = 0.0;
+    for (size_t mip = 0; mip <= mips.size(); mip++) {
+        if (mip > 0)
+            image = std::move(mips[mip - 1]);
+        auto start = std::chrono::steady_clock::now();
+        CookedTextureLevel level;
+        level.width = image->GetWidth();
+        level.height = image->GetHeight();
+        level.data = TextureCodec::Encode(format, image.get(), threadPool);
+        if (level.data.empty())
+            return false;
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        totalMs += ms;
+
+        auto decoded = TextureCodec::Decode(format, level.data.data(), level.width, level.height);
+        SPDLOG_INFO("  level {:2} {:5}x{:<5} psnr {:6.2f} dB, {:.1f} ms",
+            levels.size(), level.width, level.height,
+            TextureCodec::ComputePsnr(format, image.get(), decoded.get()), ms);
+        levels.push_back(std::move(level));
+    }
+    if (!CookedTexture::Write(output, format, settings.srgb, input, levels))
+        return false;
+    SPDLOG_INFO("cooked {} -> {} ({} levels, {:.1f} ms)", input, output, levels.size(), totalMs);
+    return true;
+}
+
+// 원본이 바뀌지 않은 asset은 건너뜀
+int CookAll(ThreadPool* threadPool) {
+    std::error_code error;
+    std::filesystem::create_directories(COOKED_TEXTURE_DIRECTORY, error);
+    if (error) {
+        SPDLOG_ERROR("failed to create directory: {} ({})", COOKED_TEXTURE_DIRECTORY, error.message());
+        return -1;
+    }
+    int result = 0;
+    for (auto& entry: DEFAULT_ENTRIES) {
+        auto output = CookedTexture::GetCookedFilename(COOKED_TEXTURE_DIRECTORY, entry.input);
+        if (CookedTexture::IsUpToDate(output, entry.input)) {
+            SPDLOG_INFO("up to date: {}", output);
+            continue;
+        }
+        if (!Cook(entry.input, output, entry.settings, threadPool))
+            result = -1;
+    }
+    return result;
+}
+
+void PrintUsage() {
+    SPDLOG_INFO("usage: texture_cook <input> <output> [--format bc7|bc5|bc6h|rgba8] [--srgb] [--gamma-mips] [--normal-map]");
+    SPDLOG_INFO("                    [--filter kaiser|lanczos|box] [--no-mips] [--threads N] [--trace file]");
+    SPDLOG_INFO("       texture_cook --all");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    CookSettings settings;
+    bool all = false;
+    int threadCount = 0;
+    std::string tracePath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) {
+            if (!ParseFormat(argv[++i], settings.format)) {
+                SPDLOG_ERROR("unknown format: {}", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg == "--filter" && hasValue) {
+            if (!ParseFilter(argv[++i], settings.mip.filter)) {
+                SPDLOG_ERROR("unknown filter: {}", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg == "--srgb")
+            settings.srgb = true;
+        else if (arg == "--gamma-mips")
+            settings.mip.srgb = true;
+        else if (arg == "--normal-map")
+            settings.mip.normalMap = true;
+        else if (arg == "--no-mips")
+            settings.mipmaps = false;
+        else if (arg == "--all")
+            all = true;
+        else if (arg == "--threads" && hasValue)
+            threadCount = std::stoi(argv[++i]);
+        else if (arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if (arg[0] != '-')
+            paths.push_back(arg);
+        else
+            SPDLOG_WARN("unknown argument: {}", arg);
+    }
+    if (!all && paths.size() != 2) {
+        PrintUsage();
+        return -1;
+    }
+    if (!tracePath.empty()) {
+        Trace::Enable();
+        Trace::SetThreadName("main");
+    }
+
+    auto threadPool = ThreadPool::Create(threadCount);
+    int result = all ? CookAll(threadPool.get()) :
+        (Cook(paths[0], paths[1], settings, threadPool.get()) ? 0 : -1);
+    Trace::Dump(tracePath);
+    return result;
+}